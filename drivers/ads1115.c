@@ -0,0 +1,234 @@
+/*
+  ads1115.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "lsquaredc.h"
+#include "lsquaredc_poll.h"
+#include "ads1115.h"
+
+/*
+  Scan driver for the ADS1115 (and ADS1113/ADS1114/ADS1015) ADC. The device has a single converter and an input
+  multiplexer, so scanning several inputs means starting a single-shot conversion for each one in turn. The naive way
+  takes a config write, status polls and a result read per input. Here every input costs one ioctl, which reads the
+  result of the conversion in progress and starts the conversion of the next input:
+
+    config register (to check that the conversion is done), conversion register, config write (next input)
+
+  In between, we do not poll: we wait for the known conversion time. If a conversion turns out not to be done when we
+  read it (the data rate of the ADS1115 is only accurate to 10%), the config write of that transfer is ignored (the
+  device does not start a conversion while one is running) but changes the input under the conversion in progress. The
+  state of the converter is then unknown: we make the wait longer, drop the result of the next transfer, and have that
+  transfer write the config of the missed input again before the pipeline resumes.
+
+  The pipelined transfer reads before it writes, which not every adapter can do (the bcm2835 only reads in the last
+  message, the CP2112 only does a write followed by a read). On those, every input takes a status read, and then, only
+  once the converter is idle, a config write followed by a read of the conversion register (the new conversion does
+  not overwrite it before it ends): packed into one transfer if the adapter allows it, as two transfers otherwise.
+  Adapters without repeated starts cannot read the registers of the device at all.
+
+  ads1115_scan() does a complete scan, sleeping between transfers. ads1115_attach() instead runs the scan as a task of
+  a poller, so that the bus is free for other devices during the conversions, and reports every complete scan.
+*/
+
+#define POINTER_CONVERSION      0x00
+#define POINTER_CONFIG          0x01
+
+#define CONFIG_OS               0x8000  /* write: start a conversion, read: not converting */
+#define CONFIG_MODE_SINGLE      0x0100
+#define CONFIG_COMP_DISABLE     0x0003
+
+static const uint32_t samples_per_second[] = { 8, 16, 32, 64, 128, 250, 475, 860 };
+
+/* Puts the config that starts the conversion of the starting input into the sequence. */
+static void prepare(struct ads1115 *dev) {
+  uint16_t config = dev->config | (dev->inputs[dev->starting] << 12);
+
+  dev->sequence[16] = config >> 8;
+  dev->sequence[17] = config & 0xff;
+  dev->start[2] = config >> 8;
+  dev->start[3] = config & 0xff;
+}
+
+/* Counts a transfer of the sequence, and the bus clocks it takes. */
+static void count_transfer(struct ads1115 *dev, uint16_t *sequence, uint32_t sequence_length) {
+  dev->transfers++;
+  dev->clocks += i2c_sequence_clocks(sequence, sequence_length);
+}
+
+/*
+  Without the pipelined transfer, the status read in data[0..1] is followed by the config write and the read of the
+  result into data[2..3], but only if the converter is idle. Returns 0 on success, or -1 in case of an error.
+*/
+static int start_next(struct ads1115 *dev, uint8_t *data) {
+  if(dev->pipelined || !(data[0] & (CONFIG_OS >> 8))) return 0;
+  if(dev->split) {
+    count_transfer(dev, dev->start, 4);
+    if(i2c_send_sequence(dev->handle, dev->start, 4, 0) < 0) return -1;
+    count_transfer(dev, dev->start + 5, 6);
+    return i2c_send_sequence(dev->handle, dev->start + 5, 6, data + 2);
+  }
+  count_transfer(dev, dev->start, 11);
+  return i2c_send_sequence(dev->handle, dev->start, 11, data + 2);
+}
+
+
+/*
+  Sets up a scan of input_count inputs (ADS1115_AIN0 etc., at most ADS1115_MAX_INPUTS) with the given full scale range
+  and data rate. address is the shifted write address (ADS1115_ADDRESS). Returns 0 on success, or a negative number in
+  case of an error.
+*/
+int ads1115_init(struct ads1115 *dev, int handle, uint8_t address, const uint8_t *inputs, uint32_t input_count,
+                 uint8_t range, uint8_t rate) {
+  uint16_t sequence[] = {address, POINTER_CONFIG, I2C_RESTART, address | 1, I2C_READ, I2C_READ,
+                         I2C_RESTART, address, POINTER_CONVERSION, I2C_RESTART, address | 1, I2C_READ, I2C_READ,
+                         I2C_RESTART, address, POINTER_CONFIG, 0, 0};
+  uint16_t probe[] = {address, POINTER_CONFIG, I2C_RESTART, address | 1, I2C_READ, I2C_READ};
+  uint16_t start[] = {address, POINTER_CONFIG, 0, 0, I2C_RESTART, address, POINTER_CONVERSION, I2C_RESTART,
+                      address | 1, I2C_READ, I2C_READ};
+  struct i2c_limits limits;
+  uint8_t config[2];
+
+  if(input_count == 0 || input_count > ADS1115_MAX_INPUTS || range > 7 || rate > 7) return -1;
+  memset(dev, 0, sizeof(struct ads1115));
+  dev->handle = handle;
+  dev->address = address;
+  memcpy(dev->inputs, inputs, input_count);
+  dev->input_count = input_count;
+  dev->config = CONFIG_OS | (range << 9) | CONFIG_MODE_SINGLE | (rate << 5) | CONFIG_COMP_DISABLE;
+  dev->wait_us = 1100000 / samples_per_second[rate] + 50;
+  dev->pending = -1;
+  if(i2c_get_limits(handle, &limits) < 0) return -1;
+  /* five messages, reads before the last one */
+  dev->pipelined = i2c_can_pack(&limits, 4, 1, 1);
+  dev->split = !i2c_can_pack(&limits, 1, 0, 2);
+  if(dev->pipelined) {
+    memcpy(dev->sequence, sequence, sizeof(sequence));
+    dev->sequence_length = 18;
+  } else {
+    memcpy(dev->sequence, probe, sizeof(probe));
+    dev->sequence_length = 6;
+  }
+  memcpy(dev->start, start, sizeof(start));
+  prepare(dev);
+
+  if(i2c_send_sequence(handle, probe, 6, config) < 0) return -1;
+  return 0;
+}
+
+/*
+  Takes the config and conversion registers read by a step (data[2..3] only if the converter was idle) and moves on to
+  the next input. Returns 1 when it completes a scan.
+*/
+static int process(struct ads1115 *dev, uint8_t *data) {
+  uint16_t config = (data[0] << 8) | data[1];
+  uint32_t all = (1U << dev->input_count) - 1;
+  int complete = 0;
+
+  if(!(config & CONFIG_OS)) {
+    dev->missed++;
+    dev->wait_us += dev->wait_us / 8;
+    if(dev->task) dev->task->min_interval_us = dev->task->max_interval_us = dev->task->interval_us = dev->wait_us;
+    /* without the pipelined transfer nothing was written, and the conversion in progress is still good */
+    if(!dev->pipelined) return 0;
+    /* still converting: our config write was ignored, and the conversion in progress is garbage */
+    if(dev->pending >= 0) dev->starting = dev->pending;
+    dev->pending = -1;
+    prepare(dev);
+    return 0;
+  }
+
+  if(dev->pending >= 0) {
+    dev->conversions++;
+    dev->values[dev->pending] = (int16_t)((data[2] << 8) | data[3]);
+    dev->fresh |= 1U << dev->pending;
+    if(dev->fresh == all) {
+      memcpy(dev->results, dev->values, sizeof(dev->results));
+      dev->fresh = 0;
+      dev->scans++;
+      complete = 1;
+    }
+  }
+
+  dev->pending = dev->starting;
+  dev->starting = (dev->starting + 1) % dev->input_count;
+  /* after a miss, skip the inputs of this scan that have already been converted */
+  while(dev->fresh & (1U << dev->starting) && (dev->fresh | (1U << dev->pending)) != all) {
+    dev->starting = (dev->starting + 1) % dev->input_count;
+  }
+  prepare(dev);
+  return complete;
+}
+
+
+/*
+  Converts all inputs and stores the results (in counts, in the order of the inputs given to ads1115_init()). The
+  conversion of the first input of the next scan is already started when this returns, so scanning in a loop keeps the
+  converter busy all the time. Returns 0 on success, or -1 in case of an error.
+*/
+int ads1115_scan(struct ads1115 *dev, int16_t *results) {
+  uint8_t data[4];
+  int complete = 0;
+
+  while(!complete) {
+    /* (after a miss, this also gives the conversion in progress time to end) */
+    if(dev->started_ns) i2c_sleep_until(dev->started_ns + (uint64_t)dev->wait_us * 1000);
+    count_transfer(dev, dev->sequence, dev->sequence_length);
+    if(i2c_send_sequence(dev->handle, dev->sequence, dev->sequence_length, data) < 0) return -1;
+    if(start_next(dev, data) < 0) return -1;
+    if(dev->pipelined || (data[0] & (CONFIG_OS >> 8))) dev->started_ns = i2c_monotonic_ns();
+    complete = process(dev, data);
+  }
+  memcpy(results, dev->results, dev->input_count * sizeof(int16_t));
+  return 0;
+}
+
+static void conversion_published(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length,
+                                 uint64_t timestamp_ns, void *user) {
+  struct ads1115 *dev = user;
+  uint8_t registers[4];
+
+  (void)task;
+  memcpy(registers, data, data_length);
+  count_transfer(dev, dev->sequence, dev->sequence_length);
+  if(start_next(dev, registers) < 0) return;
+  if(process(dev, registers)) dev->on_scan(dev, dev->results, timestamp_ns, dev->user);
+}
+
+
+/*
+  Scans continuously as a poller task, calling on_scan with every complete scan. Between transfers, the bus is free
+  for the other tasks of the poller. The poller's tick should be well below the conversion time.
+*/
+struct i2c_poll_task *ads1115_attach(struct ads1115 *dev, struct i2c_poller *poller, ads1115_scan_fn on_scan,
+                                     void *user) {
+  dev->on_scan = on_scan;
+  dev->user = user;
+  dev->task = i2c_poll_add(poller, dev->handle, dev->sequence, dev->sequence_length, dev->wait_us, dev->wait_us,
+                           conversion_published, dev);
+  if(dev->task) dev->task->publish_always = 1;
+  return dev->task;
+}
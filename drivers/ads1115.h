@@ -0,0 +1,102 @@
+/*
+  ads1115.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef ADS1115_H
+#define ADS1115_H
+
+#include <stdint.h>
+#include "lsquaredc_poll.h"
+
+#define ADS1115_ADDRESS         0x90    /* 0x48 shifted left (ADDR to GND) */
+#define ADS1115_MAX_INPUTS      8
+
+/* Inputs (the MUX field of the config register) */
+#define ADS1115_AIN0_AIN1       0       /* differential */
+#define ADS1115_AIN0_AIN3       1
+#define ADS1115_AIN1_AIN3       2
+#define ADS1115_AIN2_AIN3       3
+#define ADS1115_AIN0            4       /* single-ended, against GND */
+#define ADS1115_AIN1            5
+#define ADS1115_AIN2            6
+#define ADS1115_AIN3            7
+
+/* Full scale ranges (PGA) */
+#define ADS1115_6_144V          0
+#define ADS1115_4_096V          1
+#define ADS1115_2_048V          2
+#define ADS1115_1_024V          3
+#define ADS1115_0_512V          4
+#define ADS1115_0_256V          5
+
+/* Data rates (DR) */
+#define ADS1115_8SPS            0
+#define ADS1115_16SPS           1
+#define ADS1115_32SPS           2
+#define ADS1115_64SPS           3
+#define ADS1115_128SPS          4
+#define ADS1115_250SPS          5
+#define ADS1115_475SPS          6
+#define ADS1115_860SPS          7
+
+struct ads1115;
+
+typedef void (*ads1115_scan_fn)(struct ads1115 *dev, const int16_t *results, uint64_t timestamp_ns, void *user);
+
+struct ads1115 {
+  int handle;
+  uint8_t address;
+  uint8_t inputs[ADS1115_MAX_INPUTS];   /* scanned in this order */
+  uint32_t input_count;
+  uint16_t config;                      /* everything but the input */
+  uint32_t wait_us;                     /* from starting a conversion until we read it, adapted */
+  int pending;                          /* index of the input being converted, -1 if none or unknown */
+  uint32_t starting;                    /* index of the input the next transfer starts */
+  uint32_t fresh;                       /* inputs converted in this scan, a bitmap */
+  int16_t values[ADS1115_MAX_INPUTS];   /* this scan so far */
+  int16_t results[ADS1115_MAX_INPUTS];  /* the last complete scan */
+  int pipelined;                        /* the adapter can read the result and start the next conversion at once */
+  int split;                            /* otherwise, start[] takes two transfers */
+  uint16_t sequence[18];                /* reads the result, starts the next conversion (or reads the status) */
+  uint32_t sequence_length;
+  uint16_t start[11];                   /* starts the next conversion, reads the result */
+  uint64_t started_ns;
+  struct i2c_poll_task *task;
+  ads1115_scan_fn on_scan;
+  void *user;
+  uint32_t transfers;
+  uint64_t clocks;                      /* bus clock cycles of all transfers */
+  uint32_t conversions;
+  uint32_t missed;                      /* conversions that were not done when we read them */
+  uint32_t scans;
+};
+
+int ads1115_init(struct ads1115 *dev, int handle, uint8_t address, const uint8_t *inputs, uint32_t input_count,
+                 uint8_t range, uint8_t rate);
+
+int ads1115_scan(struct ads1115 *dev, int16_t *results);
+
+struct i2c_poll_task *ads1115_attach(struct ads1115 *dev, struct i2c_poller *poller, ads1115_scan_fn on_scan,
+                                     void *user);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+  expander.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include "lsquaredc.h"
+#include "lsquaredc_poll.h"
+#include "expander.h"
+
+/*
+  Driver for 16-bit GPIO expanders (PCA9555 and MCP23017), written for many pin changes from many threads:
+
+  * The output and direction registers are shadowed, so changing a pin does not need a read-modify-write: the new
+    value of both ports is known, and written in one auto-increment burst. (With the direction, that is two writes in
+    one ioctl, or in two on adapters without combined transfers, like the CP2112.)
+  * Pin changes are written in groups. The first thread to change a pin waits window_us for others to join, then
+    writes the shadow registers once for all of them; changes made while a write is on the bus go out together in the
+    next one. Every caller still returns only when its change has been written, so the semantics of a plain write do
+    not change. With a window of 0 there is no waiting, and changes are only merged while the bus is busy.
+  * Inputs are read in one burst of both input ports, and with the interrupt output connected to a GPIO, only when an
+    input has changed. Reading the inputs also clears the interrupt.
+*/
+
+#define PCA9555_INPUT_0         0x00
+#define PCA9555_OUTPUT_0        0x02
+#define PCA9555_CONFIG_0        0x06
+
+#define MCP23017_IODIRA         0x00
+#define MCP23017_GPINTENA       0x04
+#define MCP23017_IOCON          0x0a
+#define MCP23017_GPIOA          0x12
+#define MCP23017_OLATA          0x14
+
+#define MCP23017_IOCON_MIRROR   0x40    /* INTA and INTB are one interrupt */
+#define MCP23017_IOCON_ODR      0x04    /* open-drain interrupt output, so that it can be shared */
+
+
+/*
+  Configures the expander: direction has a 1 for every input pin, output is the initial level of the outputs. address is
+  the shifted write address, type is EXPANDER_PCA9555 or EXPANDER_MCP23017. On the MCP23017, all inputs also get their
+  interrupt-on-change enabled, on one open-drain interrupt output. Returns 0 on success, or a negative number in case
+  of an error.
+*/
+int expander_init(struct expander *dev, int handle, uint8_t address, int type, uint16_t direction, uint16_t output) {
+  uint16_t mcp23017[] = {address, MCP23017_IOCON, MCP23017_IOCON_MIRROR | MCP23017_IOCON_ODR,
+                         I2C_RESTART, address, MCP23017_GPINTENA, direction & 0xff, direction >> 8};
+  uint16_t configure[] = {address, 0, output & 0xff, output >> 8,       /* outputs first, so pins start at the level */
+                          I2C_RESTART, address, 0, direction & 0xff, direction >> 8};
+  uint8_t inputs[2];
+
+  dev->handle = handle;
+  dev->address = address;
+  dev->type = type;
+  if(type == EXPANDER_MCP23017) {
+    dev->input_register = MCP23017_GPIOA;
+    dev->output_register = MCP23017_OLATA;
+    dev->direction_register = MCP23017_IODIRA;
+  } else {
+    dev->input_register = PCA9555_INPUT_0;
+    dev->output_register = PCA9555_OUTPUT_0;
+    dev->direction_register = PCA9555_CONFIG_0;
+  }
+  dev->read_sequence[0] = address;
+  dev->read_sequence[1] = dev->input_register;
+  dev->read_sequence[2] = I2C_RESTART;
+  dev->read_sequence[3] = address | 1;
+  dev->read_sequence[4] = I2C_READ;
+  dev->read_sequence[5] = I2C_READ;
+  dev->window_us = 0;
+  dev->output = dev->device_output = output;
+  dev->direction = dev->device_direction = direction;
+  dev->requested = dev->done = dev->failed = 0;
+  dev->writing = 0;
+  dev->on_change = 0;
+  dev->changes = dev->writes = 0;
+  pthread_mutex_init(&dev->lock, 0);
+  pthread_cond_init(&dev->written, 0);
+
+  configure[1] = dev->output_register;
+  configure[6] = dev->direction_register;
+  if(type == EXPANDER_MCP23017 && i2c_send_writes(handle, mcp23017, sizeof(mcp23017) / sizeof(mcp23017[0])) < 0) {
+    return -1;
+  }
+  if(i2c_send_writes(handle, configure, sizeof(configure) / sizeof(configure[0])) < 0) return -1;
+  if(i2c_send_sequence(handle, dev->read_sequence, 6, inputs) < 0) return -1;
+  dev->inputs = inputs[0] | (inputs[1] << 8);
+  return 0;
+}
+
+/*
+  Writes the shadow registers that differ from the device, in one ioctl if the adapter allows. Called without the
+  lock, by one thread.
+*/
+static int write_shadow(struct expander *dev, uint16_t output, uint16_t direction) {
+  uint16_t sequence[9];
+  uint32_t length = 0;
+
+  if(output != dev->device_output || direction != dev->device_direction) {
+    sequence[length++] = dev->address;
+    sequence[length++] = dev->output_register;
+    sequence[length++] = output & 0xff;
+    sequence[length++] = output >> 8;
+  }
+  if(direction != dev->device_direction) {
+    sequence[length++] = I2C_RESTART;
+    sequence[length++] = dev->address;
+    sequence[length++] = dev->direction_register;
+    sequence[length++] = direction & 0xff;
+    sequence[length++] = direction >> 8;
+  }
+  if(length == 0) return 0;
+  dev->writes++;
+  return i2c_send_writes(dev->handle, sequence, length) < 0 ? -1 : 0;
+}
+
+/* Applies a change to the shadow registers and returns when it has been written. Called with the lock held. */
+static int commit(struct expander *dev) {
+  uint64_t change = ++dev->requested;
+  uint64_t target;
+  uint16_t output, direction;
+  int result;
+
+  dev->changes++;
+  while(dev->done < change) {
+    if(dev->failed >= change) return -1;
+    if(dev->writing) {
+      pthread_cond_wait(&dev->written, &dev->lock);
+      continue;
+    }
+
+    /* we write, for everybody who is waiting */
+    dev->writing = 1;
+    if(dev->window_us) {
+      pthread_mutex_unlock(&dev->lock);
+      i2c_sleep_until(i2c_monotonic_ns() + (uint64_t)dev->window_us * 1000);
+      pthread_mutex_lock(&dev->lock);
+    }
+    target = dev->requested;
+    output = dev->output;
+    direction = dev->direction;
+    pthread_mutex_unlock(&dev->lock);
+    result = write_shadow(dev, output, direction);
+    pthread_mutex_lock(&dev->lock);
+    if(result == 0) {
+      dev->device_output = output;
+      dev->device_direction = direction;
+      dev->done = target;
+    } else {
+      dev->failed = target;
+    }
+    dev->writing = 0;
+    pthread_cond_broadcast(&dev->written);
+  }
+  return 0;
+}
+
+
+/*
+  Sets the outputs in mask to the levels in values, and returns when that has been written to the device (together
+  with the changes of other threads made in the meantime). Returns 0 on success, or -1 in case of an error.
+*/
+int expander_write_pins(struct expander *dev, uint16_t mask, uint16_t values) {
+  int result;
+
+  pthread_mutex_lock(&dev->lock);
+  dev->output = (dev->output & ~mask) | (values & mask);
+  result = commit(dev);
+  pthread_mutex_unlock(&dev->lock);
+  return result;
+}
+
+int expander_set_pin(struct expander *dev, uint32_t pin, int value) {
+  if(pin > 15) return -1;
+  return expander_write_pins(dev, 1 << pin, value ? 0xffff : 0);
+}
+
+/* Makes the pins in mask inputs (1 in inputs) or outputs (0). */
+int expander_set_direction(struct expander *dev, uint16_t mask, uint16_t inputs) {
+  int result;
+
+  pthread_mutex_lock(&dev->lock);
+  dev->direction = (dev->direction & ~mask) | (inputs & mask);
+  result = commit(dev);
+  pthread_mutex_unlock(&dev->lock);
+  return result;
+}
+
+/* Reads both input ports in one burst. */
+int expander_read_inputs(struct expander *dev, uint16_t *inputs) {
+  uint8_t data[2];
+
+  if(i2c_send_sequence(dev->handle, dev->read_sequence, 6, data) < 0) return -1;
+  *inputs = data[0] | (data[1] << 8);
+  pthread_mutex_lock(&dev->lock);
+  dev->inputs = *inputs;
+  pthread_mutex_unlock(&dev->lock);
+  return 0;
+}
+
+static void inputs_published(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length, uint64_t timestamp_ns,
+                             void *user) {
+  struct expander *dev = user;
+  uint16_t inputs = data[0] | (data[1] << 8);
+  uint16_t changed;
+
+  (void)task; (void)data_length;
+  pthread_mutex_lock(&dev->lock);
+  changed = (inputs ^ dev->inputs) & dev->direction;
+  dev->inputs = inputs;
+  pthread_mutex_unlock(&dev->lock);
+  if(changed) dev->on_change(dev, inputs, changed, timestamp_ns, dev->user);
+}
+
+
+/*
+  Reads the inputs whenever the interrupt output fires, and calls on_change with the input pins that changed. line is
+  the GPIO line connected to INT (opened with I2C_GPIO_FALLING).
+*/
+struct i2c_poll_task *expander_attach(struct expander *dev, struct i2c_poller *poller, int line,
+                                      expander_change_fn on_change, void *user) {
+  dev->on_change = on_change;
+  dev->user = user;
+  return i2c_poll_add_triggered(poller, line, dev->handle, dev->read_sequence, 6, inputs_published, dev);
+}
+
+void expander_destroy(struct expander *dev) {
+  pthread_cond_destroy(&dev->written);
+  pthread_mutex_destroy(&dev->lock);
+}
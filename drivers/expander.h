@@ -0,0 +1,87 @@
+/*
+  expander.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef EXPANDER_H
+#define EXPANDER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "lsquaredc_poll.h"
+
+#define PCA9555_ADDRESS         0x40    /* 0x20 shifted left, A2..A0 low */
+#define MCP23017_ADDRESS        0x40    /* 0x20 shifted left, A2..A0 low */
+
+/* Supported chips */
+#define EXPANDER_PCA9555        0       /* also PCA9535, PCA9539, TCA9555 */
+#define EXPANDER_MCP23017       1       /* with IOCON.BANK = 0, the power-on default */
+
+/* Pins are numbered 0-15: port 0 (or A) is 0-7, port 1 (or B) is 8-15. Pin masks are uint16_t in the same order. */
+
+struct expander;
+
+typedef void (*expander_change_fn)(struct expander *dev, uint16_t inputs, uint16_t changed, uint64_t timestamp_ns,
+                                   void *user);
+
+struct expander {
+  int handle;
+  uint8_t address;
+  int type;
+  uint8_t input_register;               /* first of the pair, for each of the three */
+  uint8_t output_register;
+  uint8_t direction_register;
+  uint16_t read_sequence[6];            /* burst read of both input ports */
+  uint32_t window_us;                   /* pin changes issued within this time go out in one write */
+  pthread_mutex_t lock;
+  pthread_cond_t written;
+  uint16_t output;                      /* shadow registers, as they will be written */
+  uint16_t direction;                   /* 1 is input */
+  uint16_t device_output;               /* what the device has */
+  uint16_t device_direction;
+  uint64_t requested;                   /* pin changes, counted */
+  uint64_t done;                        /* pin changes that have been written */
+  uint64_t failed;                      /* pin changes covered by the last failed write */
+  int writing;
+  uint16_t inputs;                      /* last read */
+  expander_change_fn on_change;
+  void *user;
+  uint32_t changes;
+  uint32_t writes;
+};
+
+int expander_init(struct expander *dev, int handle, uint8_t address, int type, uint16_t direction, uint16_t output);
+
+int expander_write_pins(struct expander *dev, uint16_t mask, uint16_t values);
+
+int expander_set_pin(struct expander *dev, uint32_t pin, int value);
+
+int expander_set_direction(struct expander *dev, uint16_t mask, uint16_t inputs);
+
+int expander_read_inputs(struct expander *dev, uint16_t *inputs);
+
+struct i2c_poll_task *expander_attach(struct expander *dev, struct i2c_poller *poller, int line,
+                                      expander_change_fn on_change, void *user);
+
+void expander_destroy(struct expander *dev);
+
+#endif
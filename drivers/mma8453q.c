@@ -0,0 +1,138 @@
+/*
+  mma8453q.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include "lsquaredc.h"
+#include "lsquaredc_poll.h"
+#include "mma8453q.h"
+
+/*
+  Reference driver for the MMA8453Q accelerometer, written to use the bus as little as possible:
+
+  * Configuration is a single ioctl: all register writes are segments of one sequence, and the four control registers
+    that follow CTRL_REG1 are written in one auto-increment burst. (Adapters without combined transfers, like the
+    CP2112, get one ioctl per write.)
+  * A sample is one burst read of STATUS and all output registers, instead of one transaction per register. In fast
+    read mode the device skips the LSB registers, so a sample is 4 bytes instead of 7.
+  * With the data-ready interrupt connected to a GPIO, we only read when there is a new sample, so no bus time is spent
+    on polls that return "not ready". The read of the output registers also clears the interrupt.
+
+  Note that unlike its MMA8451Q sibling, the MMA8453Q does not have a FIFO, so the data-ready interrupt is the best we
+  can do.
+*/
+
+#define CTRL_REG1_ACTIVE        0x01
+#define CTRL_REG1_F_READ        0x02
+#define CTRL_REG4_INT_EN_DRDY   0x01
+#define CTRL_REG5_INT_CFG_DRDY  0x01    /* route data-ready to INT1 */
+
+
+/*
+  Checks the device ID, configures the device and makes it active. address is the shifted write address
+  (MMA8453Q_ADDRESS), rate is one of MMA8453Q_RATE_*, range is 0, 1 or 2 for 2g, 4g or 8g full scale. Returns 0 on
+  success, or a negative number in case of an error.
+*/
+int mma8453q_init(struct mma8453q *dev, int handle, uint8_t address, uint8_t rate, uint8_t range, int flags) {
+  uint16_t who_am_i[] = {address, MMA8453Q_WHO_AM_I, I2C_RESTART, address | 1, I2C_READ};
+  uint8_t ctrl_reg1 = (uint8_t)((rate & 7) << 3) | ((flags & MMA8453Q_FAST_READ) ? CTRL_REG1_F_READ : 0);
+  uint8_t drdy = (flags & MMA8453Q_DATA_READY_INT) ? 1 : 0;
+  uint16_t configure[] = {address, MMA8453Q_CTRL_REG1, 0,     /* standby, required for changing the configuration */
+                          I2C_RESTART, address, MMA8453Q_XYZ_DATA_CFG, range & 3,
+                          I2C_RESTART, address, MMA8453Q_CTRL_REG1 + 1,
+                          0,                                  /* CTRL_REG2: normal oversampling, no sleep */
+                          0,                                  /* CTRL_REG3: push-pull, active low */
+                          drdy ? CTRL_REG4_INT_EN_DRDY : 0,
+                          drdy ? CTRL_REG5_INT_CFG_DRDY : 0,
+                          I2C_RESTART, address, MMA8453Q_CTRL_REG1, ctrl_reg1 | CTRL_REG1_ACTIVE};
+  uint8_t id;
+  uint32_t i;
+
+  dev->handle = handle;
+  dev->address = address;
+  dev->flags = flags;
+  dev->sample_length = (flags & MMA8453Q_FAST_READ) ? 4 : 7;
+  dev->read_sequence[0] = address;
+  dev->read_sequence[1] = MMA8453Q_STATUS;
+  dev->read_sequence[2] = I2C_RESTART;
+  dev->read_sequence[3] = address | 1;
+  for(i = 0; i < dev->sample_length; i++) dev->read_sequence[4 + i] = I2C_READ;
+  dev->read_sequence_length = 4 + dev->sample_length;
+
+  if(i2c_send_sequence(handle, who_am_i, 5, &id) < 0) return -1;
+  if(id != MMA8453Q_DEVICE_ID) return -1;
+  if(i2c_send_writes(handle, configure, sizeof(configure) / sizeof(configure[0])) < 0) return -1;
+  return 0;
+}
+
+/* Output registers hold left-justified 10-bit values, or just the MSB in fast read mode. */
+void mma8453q_decode(struct mma8453q *dev, uint8_t *data, struct mma8453q_sample *sample) {
+  sample->status = data[0];
+  if(dev->flags & MMA8453Q_FAST_READ) {
+    sample->x = (int8_t)data[1];
+    sample->y = (int8_t)data[2];
+    sample->z = (int8_t)data[3];
+  } else {
+    sample->x = (int16_t)((data[1] << 8) | data[2]) >> 6;
+    sample->y = (int16_t)((data[3] << 8) | data[4]) >> 6;
+    sample->z = (int16_t)((data[5] << 8) | data[6]) >> 6;
+  }
+}
+
+/* Reads a complete sample (status and all three axes) in a single transaction. */
+int mma8453q_read(struct mma8453q *dev, struct mma8453q_sample *sample) {
+  uint8_t data[7];
+  int result;
+
+  result = i2c_send_sequence(dev->handle, dev->read_sequence, dev->read_sequence_length, data);
+  if(result >= 0) mma8453q_decode(dev, data, sample);
+  return result;
+}
+
+static void sample_published(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length, uint64_t timestamp_ns,
+                             void *user) {
+  struct mma8453q *dev = user;
+  struct mma8453q_sample sample;
+
+  (void)task; (void)data_length;
+  mma8453q_decode(dev, data, &sample);
+  dev->on_sample(&sample, timestamp_ns, dev->user);
+}
+
+
+/*
+  Reads a sample whenever the data-ready interrupt fires. line is the GPIO line connected to INT1 (opened with
+  I2C_GPIO_FALLING), and the device must have been initialized with MMA8453Q_DATA_READY_INT.
+*/
+struct i2c_poll_task *mma8453q_attach(struct mma8453q *dev, struct i2c_poller *poller, int line,
+                                      mma8453q_sample_fn on_sample, void *user) {
+  dev->on_sample = on_sample;
+  dev->user = user;
+  return i2c_poll_add_triggered(poller, line, dev->handle, dev->read_sequence, dev->read_sequence_length,
+                                sample_published, dev);
+}
+
+int mma8453q_standby(struct mma8453q *dev) {
+  uint16_t standby[] = {dev->address, MMA8453Q_CTRL_REG1, 0};
+  return i2c_send_sequence(dev->handle, standby, 3, 0);
+}
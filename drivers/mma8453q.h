@@ -0,0 +1,86 @@
+/*
+  mma8453q.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef MMA8453Q_H
+#define MMA8453Q_H
+
+#include <stdint.h>
+#include "lsquaredc_poll.h"
+
+#define MMA8453Q_ADDRESS        0x38    /* 0x1c shifted left (SA0 low); 0x3a with SA0 high */
+
+/* Register map (the ones we use) */
+#define MMA8453Q_STATUS         0x00
+#define MMA8453Q_OUT_X_MSB      0x01
+#define MMA8453Q_INT_SOURCE     0x0c
+#define MMA8453Q_WHO_AM_I       0x0d
+#define MMA8453Q_XYZ_DATA_CFG   0x0e
+#define MMA8453Q_CTRL_REG1      0x2a
+
+#define MMA8453Q_DEVICE_ID      0x3a
+
+/* Output data rates, CTRL_REG1 DR field */
+#define MMA8453Q_RATE_800HZ     0
+#define MMA8453Q_RATE_400HZ     1
+#define MMA8453Q_RATE_200HZ     2
+#define MMA8453Q_RATE_100HZ     3
+#define MMA8453Q_RATE_50HZ      4
+#define MMA8453Q_RATE_12_5HZ    5
+#define MMA8453Q_RATE_6_25HZ    6
+#define MMA8453Q_RATE_1_56HZ    7
+
+/* Flags for mma8453q_init() */
+#define MMA8453Q_FAST_READ      1       /* 8-bit results, so that a sample is 4 bytes instead of 7 */
+#define MMA8453Q_DATA_READY_INT 2       /* data-ready interrupt on INT1, active low */
+
+struct mma8453q_sample {
+  uint8_t status;
+  int16_t x, y, z;                      /* in counts: 10-bit, or 8-bit in fast read mode */
+};
+
+typedef void (*mma8453q_sample_fn)(struct mma8453q_sample *sample, uint64_t timestamp_ns, void *user);
+
+struct mma8453q {
+  int handle;
+  uint8_t address;
+  int flags;
+  uint16_t read_sequence[11];           /* burst read of STATUS and all output registers */
+  uint32_t read_sequence_length;
+  uint32_t sample_length;
+  mma8453q_sample_fn on_sample;
+  void *user;
+};
+
+int mma8453q_init(struct mma8453q *dev, int handle, uint8_t address, uint8_t rate, uint8_t range, int flags);
+
+int mma8453q_read(struct mma8453q *dev, struct mma8453q_sample *sample);
+
+void mma8453q_decode(struct mma8453q *dev, uint8_t *data, struct mma8453q_sample *sample);
+
+struct i2c_poll_task *mma8453q_attach(struct mma8453q *dev, struct i2c_poller *poller, int line,
+                                      mma8453q_sample_fn on_sample, void *user);
+
+int mma8453q_standby(struct mma8453q *dev);
+
+#endif
@@ -0,0 +1,228 @@
+/*
+  pca9685.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include "lsquaredc.h"
+#include "pca9685.h"
+
+/*
+  Driver for the PCA9685 16-channel PWM controller (LEDs, servos), written for fast frame updates:
+
+  * Channel values are set in a shadow frame and sent with pca9685_update(), which only writes the channels that
+    changed. Neighbouring changed channels go out in one auto-increment burst (4 registers per channel), and all
+    bursts of a frame are segments of a single ioctl, separated by repeated starts.
+  * When every channel gets the same value, the frame is a single write to the ALL_LED registers.
+  * The outputs change on the STOP at the end of the ioctl (MODE2.OCH = 0), so all channels of a frame change in the
+    same PWM cycle.
+
+  On adapters that cannot take several messages in one transfer, the changed channels are written in one burst from
+  the first to the last of them, rewriting unchanged channels in between with the values they already have, and the
+  configuration written by pca9685_init() takes one transfer per register write.
+*/
+
+#define MODE1                   0x00
+#define MODE2                   0x01
+#define LED0_ON_L               0x06
+#define ALL_LED_ON_L            0xfa
+#define PRE_SCALE               0xfe
+
+#define MODE1_ALLCALL           0x01
+#define MODE1_SLEEP             0x10
+#define MODE1_AI                0x20    /* register auto-increment */
+#define MODE2_OUTDRV            0x04
+#define MODE2_INVRT             0x10
+
+#define OSCILLATOR_HZ           25000000
+#define MAX_SEQUENCE            (PCA9685_CHANNELS * (3 + 4))
+
+
+/*
+  Sets up the PWM frequency (24 to 1526 Hz) and output mode, and turns all channels off. address is the shifted write
+  address (PCA9685_ADDRESS). Returns 0 on success, or a negative number in case of an error.
+*/
+int pca9685_init(struct pca9685 *dev, int handle, uint8_t address, uint32_t frequency_hz, int flags) {
+  uint32_t prescale, i;
+  int transfers;
+  uint16_t configure[] = {address, MODE1, MODE1_SLEEP | MODE1_AI | MODE1_ALLCALL,   /* the prescaler needs sleep */
+                          I2C_RESTART, address, PRE_SCALE, 0,
+                          I2C_RESTART, address, MODE2, 0,
+                          I2C_RESTART, address, ALL_LED_ON_L, 0, 0, 0, PCA9685_FULL >> 8,
+                          I2C_RESTART, address, MODE1, MODE1_AI | MODE1_ALLCALL};
+
+  if(frequency_hz == 0) return -1;
+  prescale = (OSCILLATOR_HZ + 2048 * frequency_hz) / (4096 * frequency_hz) - 1;  /* rounded */
+  if(prescale < 3) prescale = 3;
+  if(prescale > 255) prescale = 255;
+  configure[6] = prescale;
+  configure[10] = ((flags & PCA9685_OPEN_DRAIN) ? 0 : MODE2_OUTDRV) | ((flags & PCA9685_INVERT) ? MODE2_INVRT : 0);
+
+  dev->handle = handle;
+  dev->address = address;
+  dev->flags = flags;
+  dev->frequency_hz = OSCILLATOR_HZ / (4096 * (prescale + 1));
+  dev->updates = dev->transfers = 0;
+  for(i = 0; i < PCA9685_CHANNELS; i++) {
+    dev->on[i] = dev->device_on[i] = 0;
+    dev->off[i] = dev->device_off[i] = PCA9685_FULL;
+  }
+
+  /* one transfer, or one per write on adapters that cannot take several messages */
+  if((transfers = i2c_send_writes(handle, configure, sizeof(configure) / sizeof(configure[0]))) < 0) return -1;
+  dev->transfers += transfers;
+  i2c_sleep_until(i2c_monotonic_ns() + 500000);  /* for the oscillator to start after leaving sleep */
+  return 0;
+}
+
+/* Sets the turn-on and turn-off counts (0-4095, or PCA9685_FULL) of a channel for the next update. */
+void pca9685_set(struct pca9685 *dev, uint32_t channel, uint16_t on, uint16_t off) {
+  if(channel >= PCA9685_CHANNELS) return;
+  dev->on[channel] = on;
+  dev->off[channel] = off;
+}
+
+/* Sets the duty cycle of a channel for the next update, from 0 (off) to 4096 (fully on). */
+void pca9685_set_duty(struct pca9685 *dev, uint32_t channel, uint32_t duty) {
+  uint16_t on = (dev->flags & PCA9685_STAGGER) ? (channel * 256) & 0xfff : 0;
+
+  if(duty == 0) {
+    pca9685_set(dev, channel, 0, PCA9685_FULL);
+  } else if(duty >= 4096) {
+    pca9685_set(dev, channel, PCA9685_FULL, 0);
+  } else {
+    pca9685_set(dev, channel, on, (on + duty) & 0xfff);
+  }
+}
+
+/* Sets the pulse length of a channel for the next update, e.g. 1000 to 2000 us for a servo at 50 Hz. */
+void pca9685_set_pulse_us(struct pca9685 *dev, uint32_t channel, uint32_t pulse_us) {
+  pca9685_set_duty(dev, channel, (uint32_t)((uint64_t)pulse_us * dev->frequency_hz * 4096 / 1000000));
+}
+
+static int changed(struct pca9685 *dev, uint32_t channel) {
+  return dev->on[channel] != dev->device_on[channel] || dev->off[channel] != dev->device_off[channel];
+}
+
+/* Appends a burst write of count channels from first to the sequence. */
+static uint32_t append_burst(struct pca9685 *dev, uint16_t *sequence, uint32_t length, uint32_t first,
+                             uint32_t count) {
+  uint32_t i;
+
+  if(length) sequence[length++] = I2C_RESTART;
+  sequence[length++] = dev->address;
+  sequence[length++] = LED0_ON_L + 4 * first;
+  for(i = first; i < first + count; i++) {
+    sequence[length++] = dev->on[i] & 0xff;
+    sequence[length++] = dev->on[i] >> 8;
+    sequence[length++] = dev->off[i] & 0xff;
+    sequence[length++] = dev->off[i] >> 8;
+  }
+  return length;
+}
+
+static int send(struct pca9685 *dev, uint16_t *sequence, uint32_t length, uint32_t first, uint32_t last) {
+  uint32_t i;
+
+  dev->transfers++;
+  if(i2c_send_sequence(dev->handle, sequence, length, 0) < 0) return -1;
+  for(i = first; i <= last; i++) {
+    dev->device_on[i] = dev->on[i];
+    dev->device_off[i] = dev->off[i];
+  }
+  return 0;
+}
+
+
+/*
+  Sends the channels that changed since the last update, normally in a single ioctl. Returns 0 on success, or -1 in
+  case of an error (the channels that were not written are tried again on the next update).
+*/
+int pca9685_update(struct pca9685 *dev) {
+  struct i2c_limits limits;
+  uint16_t sequence[MAX_SEQUENCE];
+  uint32_t runs[PCA9685_CHANNELS][2];
+  uint32_t run_count = 0, segments = 0, length = 0;
+  uint32_t per_transfer, max_channels, first, count, i;
+  int same = 1, any = 0;
+
+  for(i = 0; i < PCA9685_CHANNELS; i++) {
+    if(changed(dev, i)) any = 1;
+    if(dev->on[i] != dev->on[0] || dev->off[i] != dev->off[0]) same = 0;
+  }
+  if(!any) return 0;
+  dev->updates++;
+
+  if(same) {
+    length = append_burst(dev, sequence, 0, 0, 1);
+    sequence[1] = ALL_LED_ON_L;
+    return send(dev, sequence, length, 0, PCA9685_CHANNELS - 1);
+  }
+
+  if(i2c_get_limits(dev->handle, &limits) < 0) return -1;
+  per_transfer = (limits.flags & (I2C_LIMIT_WRITE_THEN_READ | I2C_LIMIT_NO_COMBINED)) ? 1 : limits.max_messages;
+  max_channels = limits.max_write_length ? (limits.max_write_length - 1) / 4 : PCA9685_CHANNELS;
+  if(max_channels == 0) return -1;
+
+  /* runs of changed channels */
+  for(i = 0; i < PCA9685_CHANNELS; i++) {
+    if(!changed(dev, i)) continue;
+    if(run_count && runs[run_count - 1][0] + runs[run_count - 1][1] == i) {
+      runs[run_count - 1][1]++;
+    } else {
+      runs[run_count][0] = i;
+      runs[run_count++][1] = 1;
+    }
+  }
+  if(run_count > per_transfer) {
+    /* rewriting the unchanged channels in between is harmless, and cheaper than more transfers */
+    runs[0][1] = runs[run_count - 1][0] + runs[run_count - 1][1] - runs[0][0];
+    run_count = 1;
+  }
+
+  first = runs[0][0];
+  for(i = 0; i < run_count; i++) {
+    while(runs[i][1]) {
+      count = runs[i][1] < max_channels ? runs[i][1] : max_channels;
+      if(segments == per_transfer) {
+        if(send(dev, sequence, length, first, runs[i][0] - 1) < 0) return -1;
+        length = segments = 0;
+        first = runs[i][0];
+      }
+      length = append_burst(dev, sequence, length, runs[i][0], count);
+      segments++;
+      runs[i][0] += count;
+      runs[i][1] -= count;
+    }
+  }
+  return send(dev, sequence, length, first, runs[run_count - 1][0] - 1);
+}
+
+/* Stops the oscillator and all outputs. The next update does not wake the device up: call pca9685_init() again. */
+int pca9685_sleep(struct pca9685 *dev) {
+  uint16_t sleep[] = {dev->address, MODE1, MODE1_SLEEP | MODE1_AI | MODE1_ALLCALL};
+
+  dev->transfers++;
+  return i2c_send_sequence(dev->handle, sleep, 3, 0);
+}
@@ -0,0 +1,66 @@
+/*
+  pca9685.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef PCA9685_H
+#define PCA9685_H
+
+#include <stdint.h>
+
+#define PCA9685_ADDRESS         0x80    /* 0x40 shifted left, A5..A0 low */
+#define PCA9685_ALL_CALL        0xe0    /* LED All Call address, enabled by default */
+
+#define PCA9685_CHANNELS        16
+#define PCA9685_FULL            0x1000  /* in an on or off count: always on, or always off (which wins) */
+
+/* Flags for pca9685_init() */
+#define PCA9685_OPEN_DRAIN      1       /* outputs are open-drain instead of totem pole */
+#define PCA9685_INVERT          2       /* invert the outputs (for LEDs driven directly, without a driver) */
+#define PCA9685_STAGGER         4       /* spread the turn-on times of channels set with pca9685_set_duty() */
+
+struct pca9685 {
+  int handle;
+  uint8_t address;
+  int flags;
+  uint32_t frequency_hz;                /* the actual PWM frequency, after rounding the prescaler */
+  uint16_t on[PCA9685_CHANNELS];        /* the next frame, counts from 0 to 4095 or PCA9685_FULL */
+  uint16_t off[PCA9685_CHANNELS];
+  uint16_t device_on[PCA9685_CHANNELS]; /* what the device has */
+  uint16_t device_off[PCA9685_CHANNELS];
+  uint32_t updates;
+  uint32_t transfers;
+};
+
+int pca9685_init(struct pca9685 *dev, int handle, uint8_t address, uint32_t frequency_hz, int flags);
+
+void pca9685_set(struct pca9685 *dev, uint32_t channel, uint16_t on, uint16_t off);
+
+void pca9685_set_duty(struct pca9685 *dev, uint32_t channel, uint32_t duty);
+
+void pca9685_set_pulse_us(struct pca9685 *dev, uint32_t channel, uint32_t pulse_us);
+
+int pca9685_update(struct pca9685 *dev);
+
+int pca9685_sleep(struct pca9685 *dev);
+
+#endif
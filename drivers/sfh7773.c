@@ -0,0 +1,76 @@
+/*
+  sfh7773.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include "lsquaredc.h"
+#include "sfh7773.h"
+
+/*
+  Reference driver for the SFH7773 ambient light/proximity sensor (the device used in example.c). Where example.c does
+  two separate init transactions and reads one register at a time, this driver configures the device in one ioctl and
+  reads the ambient light value, the status and all three proximity values in a single 6-byte burst: the register
+  address auto-increments on reads.
+*/
+
+#define SAMPLE_LENGTH 6
+
+
+/*
+  Checks the part ID and starts free-running ambient light and proximity measurements. Returns 0 on success, or a
+  negative number in case of an error.
+*/
+int sfh7773_init(struct sfh7773 *dev, int handle, uint8_t address) {
+  uint16_t part_id[] = {address, SFH7773_PART_ID, I2C_RESTART, address | 1, I2C_READ};
+  uint16_t configure[] = {address, SFH7773_ALS_CONTROL, SFH7773_STANDALONE,
+                          I2C_RESTART, address, SFH7773_PS_CONTROL, SFH7773_STANDALONE};
+  uint8_t id;
+  uint32_t i;
+
+  dev->handle = handle;
+  dev->address = address;
+  dev->read_sequence[0] = address;
+  dev->read_sequence[1] = SFH7773_ALS_DATA_0;
+  dev->read_sequence[2] = I2C_RESTART;
+  dev->read_sequence[3] = address | 1;
+  for(i = 0; i < SAMPLE_LENGTH; i++) dev->read_sequence[4 + i] = I2C_READ;
+
+  if(i2c_send_sequence(handle, part_id, 5, &id) < 0) return -1;
+  if((id & 0xf0) != 0x90) return -1;    /* the low nibble is the revision */
+  if(i2c_send_sequence(handle, configure, 7, 0) < 0) return -1;
+  return 0;
+}
+
+int sfh7773_read(struct sfh7773 *dev, struct sfh7773_sample *sample) {
+  uint8_t data[SAMPLE_LENGTH];
+  int result;
+
+  result = i2c_send_sequence(dev->handle, dev->read_sequence, 4 + SAMPLE_LENGTH, data);
+  if(result < 0) return result;
+  sample->ambient = (uint16_t)(data[0] | (data[1] << 8));  /* ALS_DATA_0 is the LSB */
+  sample->status = data[2];
+  sample->proximity[0] = data[3];
+  sample->proximity[1] = data[4];
+  sample->proximity[2] = data[5];
+  return result;
+}
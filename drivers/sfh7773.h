@@ -0,0 +1,56 @@
+/*
+  sfh7773.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef SFH7773_H
+#define SFH7773_H
+
+#include <stdint.h>
+
+#define SFH7773_ADDRESS         0x70    /* 0x38 shifted left */
+
+/* Register map (the ones we use) */
+#define SFH7773_ALS_CONTROL     0x80
+#define SFH7773_PS_CONTROL      0x81
+#define SFH7773_PART_ID         0x8a
+#define SFH7773_ALS_DATA_0      0x8c    /* ALS_DATA_0, ALS_DATA_1, ALS_PS_STATUS and PS_DATA_LED1..3 follow */
+
+#define SFH7773_STANDALONE      3       /* ALS_CONTROL/PS_CONTROL: free-running measurements */
+
+struct sfh7773_sample {
+  uint16_t ambient;
+  uint8_t status;
+  uint8_t proximity[3];                 /* one value per LED */
+};
+
+struct sfh7773 {
+  int handle;
+  uint8_t address;
+  uint16_t read_sequence[10];
+};
+
+int sfh7773_init(struct sfh7773 *dev, int handle, uint8_t address);
+
+int sfh7773_read(struct sfh7773 *dev, struct sfh7773_sample *sample);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+  example_drivers.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "lsquaredc.h"
+#include "mma8453q.h"
+#include "sfh7773.h"
+#include "ads1115.h"
+
+/*
+  Compares reading complete samples one register at a time (the way the README and example.c show it) with the burst
+  reads of the reference drivers in drivers/. For each approach it reports the achieved sample rate and the bus load,
+  estimated from the number of SCL clocks at the given bus frequency.
+
+  Usage: example_drivers [bus] [bus frequency in Hz] [seconds per measurement]
+*/
+
+struct measurement {
+  uint32_t samples;
+  uint32_t transactions;
+  uint64_t clocks;
+  uint64_t elapsed_ns;
+};
+
+static void report(const char *name, struct measurement *m, uint32_t bus_hz) {
+  double seconds = m->elapsed_ns / 1e9;
+  double wire = (double)m->clocks / bus_hz;
+
+  printf("  %-28s %8.1f samples/s  %5.2f transactions/sample  bus load %5.1f%%\n", name, m->samples / seconds,
+         (double)m->transactions / m->samples, 100.0 * wire / seconds);
+}
+
+/* The naive way: every register is a separate write/restart/read transaction. */
+static int read_registers_one_by_one(int handle, uint8_t address, uint8_t first, uint32_t count, uint8_t *data,
+                                     struct measurement *m) {
+  uint16_t sequence[] = {address, 0, I2C_RESTART, address | 1, I2C_READ};
+  uint32_t i;
+
+  for(i = 0; i < count; i++) {
+    sequence[1] = first + i;
+    if(i2c_send_sequence(handle, sequence, 5, data + i) < 0) return -1;
+    m->transactions++;
+    m->clocks += i2c_sequence_clocks(sequence, 5);
+  }
+  return 0;
+}
+
+/* The naive ADC scan: for every input, start a conversion, poll until it is done, then read the result. */
+static int scan_one_by_one(struct ads1115 *adc, int16_t *results, struct measurement *m) {
+  uint16_t start[] = {adc->address, 0x01, 0, 0};
+  uint16_t status[] = {adc->address, 0x01, I2C_RESTART, adc->address | 1, I2C_READ, I2C_READ};
+  uint16_t read[] = {adc->address, 0x00, I2C_RESTART, adc->address | 1, I2C_READ, I2C_READ};
+  uint16_t config;
+  uint8_t data[2];
+  uint32_t i;
+
+  for(i = 0; i < adc->input_count; i++) {
+    config = adc->config | (adc->inputs[i] << 12);
+    start[2] = config >> 8;
+    start[3] = config & 0xff;
+    if(i2c_send_sequence(adc->handle, start, 4, 0) < 0) return -1;
+    m->transactions++;
+    m->clocks += i2c_sequence_clocks(start, 4);
+    do {
+      if(i2c_send_sequence(adc->handle, status, 6, data) < 0) return -1;
+      m->transactions++;
+      m->clocks += i2c_sequence_clocks(status, 6);
+    } while(!(data[0] & 0x80));
+    if(i2c_send_sequence(adc->handle, read, 6, data) < 0) return -1;
+    m->transactions++;
+    m->clocks += i2c_sequence_clocks(read, 6);
+    results[i] = (int16_t)((data[0] << 8) | data[1]);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  uint8_t bus = (argc > 1) ? (uint8_t)atoi(argv[1]) : 1;
+  uint32_t bus_hz = (argc > 2) ? (uint32_t)atoi(argv[2]) : 100000;
+  uint64_t duration_ns = (uint64_t)((argc > 3) ? atoi(argv[3]) : 2) * 1000000000ULL;
+  struct measurement naive, burst;
+  struct mma8453q accelerometer;
+  struct mma8453q_sample acceleration;
+  struct sfh7773 light;
+  struct sfh7773_sample proximity;
+  struct ads1115 adc;
+  uint8_t inputs[] = {ADS1115_AIN0, ADS1115_AIN1, ADS1115_AIN2, ADS1115_AIN3};
+  int16_t voltages[4];
+  uint32_t transfers;
+  uint8_t data[8];
+  uint64_t start, clocks;
+  int handle;
+
+  if((handle = i2c_open(bus)) < 0) {
+    printf("Could not open bus %d\n", bus);
+    return 1;
+  }
+
+  if(mma8453q_init(&accelerometer, handle, MMA8453Q_ADDRESS, MMA8453Q_RATE_800HZ, 0, 0) == 0) {
+    printf("MMA8453Q:\n");
+    naive = (struct measurement){0, 0, 0, 0};
+    start = i2c_monotonic_ns();
+    while(i2c_monotonic_ns() - start < duration_ns) {
+      if(read_registers_one_by_one(handle, MMA8453Q_ADDRESS, MMA8453Q_STATUS, 7, data, &naive) < 0) break;
+      naive.samples++;
+    }
+    naive.elapsed_ns = i2c_monotonic_ns() - start;
+
+    burst = (struct measurement){0, 0, 0, 0};
+    start = i2c_monotonic_ns();
+    while(i2c_monotonic_ns() - start < duration_ns) {
+      if(mma8453q_read(&accelerometer, &acceleration) < 0) break;
+      burst.samples++;
+      burst.transactions++;
+      burst.clocks += i2c_sequence_clocks(accelerometer.read_sequence, accelerometer.read_sequence_length);
+    }
+    burst.elapsed_ns = i2c_monotonic_ns() - start;
+
+    if(naive.samples && burst.samples) {
+      report("register by register", &naive, bus_hz);
+      report("burst read", &burst, bus_hz);
+    }
+    mma8453q_standby(&accelerometer);
+  } else {
+    printf("MMA8453Q not found\n");
+  }
+
+  if(sfh7773_init(&light, handle, SFH7773_ADDRESS) == 0) {
+    printf("SFH7773:\n");
+    naive = (struct measurement){0, 0, 0, 0};
+    start = i2c_monotonic_ns();
+    while(i2c_monotonic_ns() - start < duration_ns) {
+      if(read_registers_one_by_one(handle, SFH7773_ADDRESS, SFH7773_ALS_DATA_0, 6, data, &naive) < 0) break;
+      naive.samples++;
+    }
+    naive.elapsed_ns = i2c_monotonic_ns() - start;
+
+    burst = (struct measurement){0, 0, 0, 0};
+    start = i2c_monotonic_ns();
+    while(i2c_monotonic_ns() - start < duration_ns) {
+      if(sfh7773_read(&light, &proximity) < 0) break;
+      burst.samples++;
+      burst.transactions++;
+      burst.clocks += i2c_sequence_clocks(light.read_sequence, 10);
+    }
+    burst.elapsed_ns = i2c_monotonic_ns() - start;
+
+    if(naive.samples && burst.samples) {
+      report("register by register", &naive, bus_hz);
+      report("burst read", &burst, bus_hz);
+    }
+  } else {
+    printf("SFH7773 not found\n");
+  }
+
+  if(ads1115_init(&adc, handle, ADS1115_ADDRESS, inputs, 4, ADS1115_4_096V, ADS1115_860SPS) == 0) {
+    printf("ADS1115 (4 inputs, samples are complete scans):\n");
+    naive = (struct measurement){0, 0, 0, 0};
+    start = i2c_monotonic_ns();
+    while(i2c_monotonic_ns() - start < duration_ns) {
+      if(scan_one_by_one(&adc, voltages, &naive) < 0) break;
+      naive.samples++;
+    }
+    naive.elapsed_ns = i2c_monotonic_ns() - start;
+
+    burst = (struct measurement){0, 0, 0, 0};
+    transfers = adc.transfers;
+    clocks = adc.clocks;
+    start = i2c_monotonic_ns();
+    while(i2c_monotonic_ns() - start < duration_ns) {
+      if(ads1115_scan(&adc, voltages) < 0) break;
+      burst.samples++;
+    }
+    burst.transactions = adc.transfers - transfers;
+    burst.clocks = adc.clocks - clocks;
+    burst.elapsed_ns = i2c_monotonic_ns() - start;
+
+    if(naive.samples && burst.samples) {
+      report("convert, poll, read", &naive, bus_hz);
+      report(adc.pipelined ? "pipelined scan" : "scan, status polled", &burst, bus_hz);
+      printf("  %u of %u conversions missed, wait %u us\n", adc.missed, adc.conversions + adc.missed, adc.wait_us);
+    }
+  } else {
+    printf("ADS1115 not found\n");
+  }
+
+  i2c_close(handle);
+  return 0;
+}
@@ -25,11 +25,16 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <time.h>
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include "lsquaredc.h"
@@ -44,6 +49,8 @@ static uint32_t check_i2c_functionality(handle) {
   return (uint32_t)(funcs & I2C_FUNC_I2C);
 }
 
+static void drop_state(int handle);
+
 
 /*
    Opens an I2C device. The supplied bus number corresponds to Linux I2C bus numbering: e.g. for "/dev/i2c-1" use bus
@@ -57,6 +64,8 @@ int i2c_open(uint8_t bus) {
   snprintf(device_name, DEVICE_NAME_LENGTH, "/dev/i2c-%d", bus);
   if((handle = open(device_name, O_RDWR)) < 0) return handle;
   if(!check_i2c_functionality(handle)) return -1;
+  drop_state(handle);           /* left behind by an earlier fd with this number that was closed with close() */
+  i2c_get_limits(handle, 0);    /* so that sequences are checked against them from the start */
   return handle;
 }
 
@@ -64,9 +73,10 @@ int i2c_open(uint8_t bus) {
 /*
    The Linux I2C ioctl interface annoyingly requires an *array* of struct i2c_msg pointers, instead of a pointer to a
    linked list. This means that we have to go through the sequence once just to count how many messages there will be,
-   before we allocate memory for message buffers.
+   before we allocate memory for message buffers. Exported, because everything that packs sequences into one ioctl has
+   to stay within I2C_RDRW_IOCTL_MAX_MSGS segments.
 */
-static uint32_t count_segments(uint16_t *sequence, uint32_t sequence_length) {
+uint32_t i2c_count_segments(uint16_t *sequence, uint32_t sequence_length) {
   uint32_t number_of_segments = 1; /* there is always at least one segment */
   uint32_t i;
 
@@ -82,39 +92,21 @@ static uint32_t count_segments(uint16_t *sequence, uint32_t sequence_length) {
 
 
 /*
-  Sends a command/data sequence that can include restarts, writes and reads. Every transmission begins with a START,
-  and ends with a STOP so you do not have to specify that.
-
-  sequence is the I2C operation sequence that should be performed. It can include any number of writes, restarts and
-  reads. Note that the sequence is composed of uint16_t, not uint8_t. This is because we have to support out-of-band
-  signalling of I2C_RESTART and I2C_READ operations, while still passing through 8-bit data.
-
-  sequence_length is the number of sequence elements (not bytes). Sequences of arbitrary length are supported, but
-  there is an upper limit on the number of segments (restarts): no more than 42. The minimum sequence length is
-  (rather obviously) 2.
-
-  received_data should point to a buffer that can hold as many bytes as there are I2C_READ operations in the
-  sequence. If there are no reads, 0 can be passed, as this parameter will not be used.
+  Converts a sequence into I2C messages. messages must have room for i2c_count_segments() messages and msg_buf for
+  sequence_length bytes. Read messages point into received_data; if read_offsets is not 0, the offset of every read
+  message within received_data is also stored there (write messages get 0), so that the messages can be pointed at
+  another buffer later.
 */
-int i2c_send_sequence(int handle, uint16_t *sequence, uint32_t sequence_length, uint8_t *received_data) {
-  struct i2c_rdwr_ioctl_data message_sequence;
-  uint32_t number_of_segments = count_segments(sequence, sequence_length);
-  struct i2c_msg *messages = malloc(number_of_segments * sizeof(struct i2c_msg));
+static void encode_sequence(uint16_t *sequence, uint32_t sequence_length, struct i2c_msg *messages, uint8_t *msg_buf,
+                            uint8_t *received_data, uint32_t *read_offsets) {
   struct i2c_msg *current_message = messages;
-  /* msg_buf needs to hold all *bytes written* in the entire sequence. Since it is difficult to estimate that number
-     without processing the sequence, we make an upper-bound guess: sequence_length. Yes, this is inefficient, but
-     optimizing this doesn't seem to be worth the effort. */
-  uint8_t *msg_buf = malloc(sequence_length); /* certainly no more than that */
   uint8_t *msg_cur_buf_ptr = msg_buf;
   uint8_t *msg_cur_buf_base;
   uint32_t msg_cur_buf_size;
+  uint32_t read_offset = 0;
   uint8_t address;
   uint8_t rw;
   uint32_t i;
-  int result = -1;
-
-  if(sequence_length < 2) goto i2c_send_sequence_cleanup;
-  if((number_of_segments > I2C_RDRW_IOCTL_MAX_MSGS)) goto i2c_send_sequence_cleanup;
 
   address = sequence[0];        /* the first byte is always an address */
   rw = address & 1;
@@ -136,10 +128,11 @@ int i2c_send_sequence(int handle, uint16_t *sequence, uint32_t sequence_length,
       current_message->flags = rw ? I2C_M_RD : 0;
       current_message->len = msg_cur_buf_size;
       /* buf needs to point to either the buffer that will receive data, or buffer that holds bytes to be written */
-      current_message->buf = rw ? received_data : msg_cur_buf_base;
+      current_message->buf = rw ? (received_data ? received_data + read_offset : 0) : msg_cur_buf_base;
+      if(read_offsets) read_offsets[current_message - messages] = rw ? read_offset : 0;
       current_message++;
 
-      if(rw == READING) received_data += msg_cur_buf_size;
+      if(rw == READING) read_offset += msg_cur_buf_size;
 
       /* do we have another transaction coming? */
       if(i < (sequence_length - 2)) { /* every I2C transaction is at least two bytes long */
@@ -151,6 +144,370 @@ int i2c_send_sequence(int handle, uint16_t *sequence, uint32_t sequence_length,
     }
     i++;
   }
+}
+
+
+/*
+  Per-handle state. Handles are file descriptors, so we simply index a table with them. Handles beyond the end of the
+  table work as before, they just cannot have any state. Entries are created under a global lock and read without one;
+  the state itself has its own lock. An fd closed with close() instead of i2c_close() leaves its state behind, so
+  i2c_open() drops whatever it finds for the new handle.
+*/
+#define MAX_HANDLES 1024
+
+/* A compiled sequence: the encoded messages and write bytes, plus what we need to recognize the sequence again. */
+struct plan {
+  uint16_t *source;             /* the caller's sequence pointer when the plan was last used */
+  uint16_t *sequence;           /* our copy, compared on every hit */
+  uint32_t sequence_length;
+  uint32_t hash;
+  uint32_t number_of_segments;
+  struct i2c_msg *messages;
+  uint32_t *read_offsets;
+  uint8_t *msg_buf;
+  uint64_t last_used;
+};
+
+struct handle_state {
+  pthread_mutex_t lock;
+  struct plan *plans;
+  uint32_t plan_capacity;
+  uint32_t plan_count;
+  uint64_t clock;               /* LRU clock, incremented on every lookup */
+  uint32_t hits;
+  uint32_t misses;
+  struct i2c_limits limits;
+  int limits_known;
+};
+
+static struct handle_state *handle_states[MAX_HANDLES];
+static pthread_mutex_t handle_states_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct handle_state *get_state(int handle, int create) {
+  struct handle_state *state;
+
+  if(handle < 0 || handle >= MAX_HANDLES) return 0;
+  state = __atomic_load_n(&handle_states[handle], __ATOMIC_ACQUIRE);
+  if(state || !create) return state;
+  pthread_mutex_lock(&handle_states_lock);
+  state = handle_states[handle];
+  if(!state && (state = calloc(1, sizeof(struct handle_state)))) {
+    pthread_mutex_init(&state->lock, 0);
+    __atomic_store_n(&handle_states[handle], state, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&handle_states_lock);
+  return state;
+}
+
+static void free_plan(struct plan *plan) {
+  free(plan->sequence);
+  free(plan->messages);
+  free(plan->read_offsets);
+  free(plan->msg_buf);
+  memset(plan, 0, sizeof(struct plan));
+}
+
+static void free_plans(struct handle_state *state) {
+  uint32_t i;
+
+  for(i = 0; i < state->plan_count; i++) free_plan(&state->plans[i]);
+  free(state->plans);
+  state->plans = 0;
+  state->plan_count = 0;
+  state->plan_capacity = 0;
+}
+
+static void drop_state(int handle) {
+  struct handle_state *state;
+
+  if(handle < 0 || handle >= MAX_HANDLES) return;
+  pthread_mutex_lock(&handle_states_lock);
+  state = handle_states[handle];
+  __atomic_store_n(&handle_states[handle], 0, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&handle_states_lock);
+  if(state) {
+    free_plans(state);
+    pthread_mutex_destroy(&state->lock);
+    free(state);
+  }
+}
+
+/*
+  Adapter limits. Some adapters cannot do arbitrarily long messages or arbitrary combinations of messages, and not all
+  of them say so: some fail, some silently transfer less. The kernel knows the limits of many adapters
+  (i2c_adapter_quirks) but does not export them, so we look the adapter name up in sysfs and match it against a table
+  of drivers we know about. i2c_probe_limits() (see lsquaredc_adapter.c) can measure the read limits of an adapter
+  using a device known to be safe to read, and i2c_set_limits() lets you say what you know.
+
+  Sequences that break the limits of their adapter fail with EMSGSIZE (too long) or EOPNOTSUPP (a combination the
+  adapter cannot do) without ever reaching the adapter.
+*/
+static const struct {
+  const char *name;             /* part of the adapter name */
+  struct i2c_limits limits;
+} known_adapters[] = {
+  { "bcm2835", { 0, 0, 0, I2C_LIMIT_READ_LAST, I2C_LIMITS_TABLE, "", 0, 0 } },
+  { "QUP", { 256, 0, 0, 0, I2C_LIMITS_TABLE, "", 0, 0 } },
+  { "CP2112", { 512, 61, 2, I2C_LIMIT_WRITE_THEN_READ, I2C_LIMITS_TABLE, "", 0, 0 } },
+};
+
+static void discover_limits(int handle, struct i2c_limits *limits) {
+  char path[64];
+  struct stat status;
+  FILE *file;
+  uint32_t i;
+  size_t length;
+
+  memset(limits, 0, sizeof(struct i2c_limits));
+  limits->max_messages = I2C_RDRW_IOCTL_MAX_MSGS;
+  limits->source = I2C_LIMITS_DEFAULT;
+
+  /* the minor number of an i2c-dev device is the adapter number */
+  if(fstat(handle, &status) < 0 || !S_ISCHR(status.st_mode)) return;
+  snprintf(path, sizeof(path), "/sys/class/i2c-dev/i2c-%u/name", minor(status.st_rdev));
+  if(!(file = fopen(path, "r"))) return;
+  if(!fgets(limits->adapter_name, sizeof(limits->adapter_name), file)) limits->adapter_name[0] = 0;
+  fclose(file);
+  length = strlen(limits->adapter_name);
+  if(length && limits->adapter_name[length - 1] == '\n') limits->adapter_name[length - 1] = 0;
+
+  for(i = 0; i < sizeof(known_adapters) / sizeof(known_adapters[0]); i++) {
+    if(!strstr(limits->adapter_name, known_adapters[i].name)) continue;
+    limits->max_read_length = known_adapters[i].limits.max_read_length;
+    limits->max_write_length = known_adapters[i].limits.max_write_length;
+    if(known_adapters[i].limits.max_messages) limits->max_messages = known_adapters[i].limits.max_messages;
+    limits->flags = known_adapters[i].limits.flags;
+    limits->source = I2C_LIMITS_TABLE;
+    break;
+  }
+}
+
+/* Returns 0 if the adapter can do the messages, otherwise -1 with errno set. */
+static int check_limits(const struct i2c_limits *limits, struct i2c_msg *messages, uint32_t count) {
+  uint32_t i;
+
+  if(limits->max_messages && count > limits->max_messages) goto too_long;
+  if(count > 1 && (limits->flags & I2C_LIMIT_NO_COMBINED)) goto unsupported;
+  if(count > 1 && (limits->flags & I2C_LIMIT_WRITE_THEN_READ) &&
+     (count > 2 || (messages[0].flags & I2C_M_RD) || !(messages[1].flags & I2C_M_RD))) goto unsupported;
+  for(i = 0; i < count; i++) {
+    if(messages[i].flags & I2C_M_RD) {
+      if((limits->flags & I2C_LIMIT_READ_LAST) && i < count - 1) goto unsupported;
+      if(limits->max_read_length && messages[i].len > limits->max_read_length) goto too_long;
+    } else {
+      if(limits->max_write_length && messages[i].len > limits->max_write_length) goto too_long;
+    }
+  }
+  return 0;
+
+ too_long:
+  errno = EMSGSIZE;
+  return -1;
+ unsupported:
+  errno = EOPNOTSUPP;
+  return -1;
+}
+
+
+
+/*
+  Whether a transaction of more_segments messages can be appended, behind a repeated start, to a transfer of segments
+  messages (has_read saying if any of them is a read) on an adapter with the given limits. limits may be 0 when they
+  are not known, which only enforces the ioctl message limit. Adapters that only do write-then-read transfers get no
+  packing at all, and neither do adapters that only allow a read as the last message, once there is a read.
+*/
+int i2c_can_pack(const struct i2c_limits *limits, uint32_t segments, int has_read, uint32_t more_segments) {
+  uint32_t max_messages = I2C_RDRW_IOCTL_MAX_MSGS;
+
+  if(limits) {
+    if(limits->flags & (I2C_LIMIT_NO_COMBINED | I2C_LIMIT_WRITE_THEN_READ)) return 0;
+    if((limits->flags & I2C_LIMIT_READ_LAST) && has_read) return 0;
+    if(limits->max_messages && limits->max_messages < max_messages) max_messages = limits->max_messages;
+  }
+  return segments + more_segments <= max_messages;
+}
+
+/*
+  Sends a sequence of writes separated by repeated starts (register writes, typically a device configuration) in as
+  few transfers as the adapter allows: all in one where combined transfers are possible, one write per transfer on
+  adapters without them. The sequence must not read, as a read cannot be separated from the register address write
+  before it. Returns the number of transfers it took, or -1 in case of an error (errno is EINVAL for a sequence with
+  reads).
+*/
+int i2c_send_writes(int handle, uint16_t *sequence, uint32_t sequence_length) {
+  struct i2c_limits limits;
+  uint32_t first = 0, segments = 0, i;
+  int transfers = 1;
+
+  if(i2c_count_reads(sequence, sequence_length)) {
+    errno = EINVAL;
+    return -1;
+  }
+  if(i2c_get_limits(handle, &limits) < 0) return -1;
+  for(i = 0; i < sequence_length; i++) {
+    if(sequence[i] != I2C_RESTART) continue;
+    /* a segment ends here: send what we have if the next one cannot join it */
+    segments++;
+    if(!i2c_can_pack(&limits, segments, 0, 1)) {
+      if(i2c_send_sequence(handle, sequence + first, i - first, 0) < 0) return -1;
+      first = i + 1;
+      segments = 0;
+      transfers++;
+    }
+  }
+  return i2c_send_sequence(handle, sequence + first, sequence_length - first, 0) < 0 ? -1 : transfers;
+}
+
+/* FNV-1a over the sequence elements: fast, and good enough to make false matches (which we memcmp anyway) rare. */
+static uint32_t hash_sequence(uint16_t *sequence, uint32_t sequence_length) {
+  uint32_t hash = 2166136261u;
+  uint32_t i;
+
+  for(i = 0; i < sequence_length; i++) {
+    hash = (hash ^ (sequence[i] & 0xff)) * 16777619u;
+    hash = (hash ^ (sequence[i] >> 8)) * 16777619u;
+  }
+  return hash;
+}
+
+
+/*
+  Looks the sequence up in the plan cache, compiling it into a new plan (evicting the least recently used one if the
+  cache is full) on a miss. Most callers use static sequence arrays, so we first try to match on the pointer and length
+  alone, and only hash the sequence if that fails. Returns 0 if the sequence cannot be compiled.
+*/
+static struct plan *find_plan(struct handle_state *state, uint16_t *sequence, uint32_t sequence_length) {
+  size_t sequence_bytes = sequence_length * sizeof(uint16_t);
+  struct plan *plan = 0;
+  uint32_t hash;
+  uint32_t i;
+
+  state->clock++;
+  for(i = 0; i < state->plan_count; i++) {
+    if(state->plans[i].source == sequence && state->plans[i].sequence_length == sequence_length &&
+       memcmp(state->plans[i].sequence, sequence, sequence_bytes) == 0) {
+      plan = &state->plans[i];
+      break;
+    }
+  }
+  if(!plan) {
+    hash = hash_sequence(sequence, sequence_length);
+    for(i = 0; i < state->plan_count; i++) {
+      if(state->plans[i].hash == hash && state->plans[i].sequence_length == sequence_length &&
+         memcmp(state->plans[i].sequence, sequence, sequence_bytes) == 0) {
+        plan = &state->plans[i];
+        plan->source = sequence;
+        break;
+      }
+    }
+  }
+  if(plan) {
+    state->hits++;
+    plan->last_used = state->clock;
+    return plan;
+  }
+
+  state->misses++;
+  if(sequence_length < 2) return 0;
+  if(state->plan_count < state->plan_capacity) {
+    plan = &state->plans[state->plan_count++];
+  } else {
+    plan = &state->plans[0];
+    for(i = 1; i < state->plan_count; i++) {
+      if(state->plans[i].last_used < plan->last_used) plan = &state->plans[i];
+    }
+    free_plan(plan);
+  }
+
+  plan->number_of_segments = i2c_count_segments(sequence, sequence_length);
+  plan->sequence = malloc(sequence_bytes);
+  plan->messages = malloc(plan->number_of_segments * sizeof(struct i2c_msg));
+  plan->read_offsets = malloc(plan->number_of_segments * sizeof(uint32_t));
+  plan->msg_buf = malloc(sequence_length);
+  /* a plan that is never valid stays in the cache as an empty slot: sequence_length 0 never matches */
+  if(plan->number_of_segments > I2C_RDRW_IOCTL_MAX_MSGS ||
+     !plan->sequence || !plan->messages || !plan->read_offsets || !plan->msg_buf) {
+    free_plan(plan);
+    return 0;
+  }
+  memcpy(plan->sequence, sequence, sequence_bytes);
+  plan->source = sequence;
+  plan->sequence_length = sequence_length;
+  plan->hash = hash_sequence(sequence, sequence_length);
+  plan->last_used = state->clock;
+  encode_sequence(sequence, sequence_length, plan->messages, plan->msg_buf, 0, plan->read_offsets);
+  if(state->limits_known && check_limits(&state->limits, plan->messages, plan->number_of_segments) < 0) {
+    free_plan(plan);
+    return 0;
+  }
+  return plan;
+}
+
+static int send_cached(int handle, struct handle_state *state, uint16_t *sequence, uint32_t sequence_length,
+                       uint8_t *received_data) {
+  struct i2c_rdwr_ioctl_data message_sequence;
+  struct plan *plan;
+  uint32_t i;
+  int result = -1;
+
+  pthread_mutex_lock(&state->lock);
+  plan = find_plan(state, sequence, sequence_length);
+  if(plan) {
+    for(i = 0; i < plan->number_of_segments; i++) {
+      if(plan->messages[i].flags & I2C_M_RD) plan->messages[i].buf = received_data + plan->read_offsets[i];
+    }
+    message_sequence.msgs = plan->messages;
+    message_sequence.nmsgs = plan->number_of_segments;
+    result = ioctl(handle, I2C_RDWR, (unsigned long)(&message_sequence));
+  }
+  pthread_mutex_unlock(&state->lock);
+  return result;
+}
+
+
+/*
+  Sends a command/data sequence that can include restarts, writes and reads. Every transmission begins with a START,
+  and ends with a STOP so you do not have to specify that.
+
+  sequence is the I2C operation sequence that should be performed. It can include any number of writes, restarts and
+  reads. Note that the sequence is composed of uint16_t, not uint8_t. This is because we have to support out-of-band
+  signalling of I2C_RESTART and I2C_READ operations, while still passing through 8-bit data.
+
+  sequence_length is the number of sequence elements (not bytes). Sequences of arbitrary length are supported, but
+  there is an upper limit on the number of segments (restarts): no more than 42. The minimum sequence length is
+  (rather obviously) 2. Sequences the adapter cannot do (see i2c_get_limits()) fail with errno set to EMSGSIZE or
+  EOPNOTSUPP.
+
+  received_data should point to a buffer that can hold as many bytes as there are I2C_READ operations in the
+  sequence. If there are no reads, 0 can be passed, as this parameter will not be used.
+*/
+int i2c_send_sequence(int handle, uint16_t *sequence, uint32_t sequence_length, uint8_t *received_data) {
+  struct i2c_rdwr_ioctl_data message_sequence;
+  struct handle_state *state = get_state(handle, 0);
+  uint32_t number_of_segments;
+  struct i2c_msg *messages;
+  /* msg_buf needs to hold all *bytes written* in the entire sequence. Since it is difficult to estimate that number
+     without processing the sequence, we make an upper-bound guess: sequence_length. Yes, this is inefficient, but
+     optimizing this doesn't seem to be worth the effort. */
+  uint8_t *msg_buf;
+  int result = -1;
+
+  if(state && state->plan_capacity) return send_cached(handle, state, sequence, sequence_length, received_data);
+
+  number_of_segments = i2c_count_segments(sequence, sequence_length);
+  messages = malloc(number_of_segments * sizeof(struct i2c_msg));
+  msg_buf = malloc(sequence_length); /* certainly no more than that */
+
+  if(sequence_length < 2) goto i2c_send_sequence_cleanup;
+  if((number_of_segments > I2C_RDRW_IOCTL_MAX_MSGS)) goto i2c_send_sequence_cleanup;
+
+  encode_sequence(sequence, sequence_length, messages, msg_buf, received_data, 0);
+  if(state) {
+    pthread_mutex_lock(&state->lock);
+    result = state->limits_known ? check_limits(&state->limits, messages, number_of_segments) : 0;
+    pthread_mutex_unlock(&state->lock);
+    if(result < 0) goto i2c_send_sequence_cleanup;
+  }
 
   message_sequence.msgs = messages;
   message_sequence.nmsgs = number_of_segments;
@@ -165,7 +522,135 @@ int i2c_send_sequence(int handle, uint16_t *sequence, uint32_t sequence_length,
 }
 
 
-/* This function is just a cosmetic wrapper, added for consistency. */
+/*
+  Enables the plan cache for a handle. Once enabled, i2c_send_sequence() remembers the compiled form (the i2c_msg
+  array and the write bytes) of up to entries different sequences, so that repeating a sequence skips the encoding and
+  the memory allocation: it only has to recognize the sequence, which for the usual static arrays is a pointer
+  comparison and a memcmp(). The least recently used plan is evicted when the cache is full. Passing 0 entries disables
+  the cache. While the cache is enabled, calls on the same handle are serialized.
+*/
+int i2c_plan_cache_enable(int handle, uint32_t entries) {
+  struct handle_state *state = get_state(handle, 1);
+  struct plan *plans = 0;
+
+  if(!state) return -1;
+  if(entries) {
+    plans = calloc(entries, sizeof(struct plan));
+    if(!plans) return -1;
+  }
+  pthread_mutex_lock(&state->lock);
+  free_plans(state);
+  state->plans = plans;
+  state->plan_capacity = entries;
+  state->hits = 0;
+  state->misses = 0;
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+/*
+  Returns the limits of the adapter behind a handle (see above), discovering them on first use. limits may be 0, to
+  just make sure the limits are known. Returns 0 on success.
+*/
+int i2c_get_limits(int handle, struct i2c_limits *limits) {
+  struct handle_state *state = get_state(handle, 1);
+
+  if(!state) return -1;
+  pthread_mutex_lock(&state->lock);
+  if(!state->limits_known) {
+    discover_limits(handle, &state->limits);
+    state->limits_known = 1;
+  }
+  if(limits) *limits = state->limits;
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+
+/*
+  Replaces the limits of the adapter behind a handle, for adapters that are not in the table or when you know better.
+  Cached plans are dropped, as they were checked against the old limits. Returns 0 on success.
+*/
+int i2c_set_limits(int handle, const struct i2c_limits *limits) {
+  struct handle_state *state = get_state(handle, 1);
+  uint32_t i;
+
+  if(!state) return -1;
+  pthread_mutex_lock(&state->lock);
+  state->limits = *limits;
+  if(state->limits.max_messages == 0 || state->limits.max_messages > I2C_RDRW_IOCTL_MAX_MSGS) {
+    state->limits.max_messages = I2C_RDRW_IOCTL_MAX_MSGS;
+  }
+  state->limits_known = 1;
+  for(i = 0; i < state->plan_count; i++) free_plan(&state->plans[i]);
+  state->plan_count = 0;
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+/* Reports plan cache hits and misses since the cache was enabled. The hit rate is hits / (hits + misses). */
+int i2c_plan_cache_stats(int handle, uint32_t *hits, uint32_t *misses) {
+  struct handle_state *state = get_state(handle, 0);
+
+  if(!state) return -1;
+  pthread_mutex_lock(&state->lock);
+  if(hits) *hits = state->hits;
+  if(misses) *misses = state->misses;
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+
+/* Returns the number of I2C_READ elements in a sequence, which is the size of the received_data buffer it needs. */
+uint32_t i2c_count_reads(uint16_t *sequence, uint32_t sequence_length) {
+  uint32_t reads = 0;
+  uint32_t i;
+
+  for(i = 1; i < sequence_length; i++) {
+    if(sequence[i] == I2C_READ) reads++;
+  }
+  return reads;
+}
+
+
+/*
+  Returns the number of SCL clock cycles that the sequence takes on the wire: 9 per byte (8 data bits and the ACK), and
+  one each for the START, every repeated start and the STOP. Divide by the bus frequency to get an estimate of the wire
+  time. Clock stretching and the gaps some adapters leave between bytes are not included, so treat it as a lower bound.
+*/
+uint32_t i2c_sequence_clocks(uint16_t *sequence, uint32_t sequence_length) {
+  uint32_t clocks = 2;          /* START and STOP */
+  uint32_t i;
+
+  for(i = 0; i < sequence_length; i++) {
+    clocks += (sequence[i] == I2C_RESTART) ? 1 : 9;
+  }
+  return clocks;
+}
+
+
+/* Apart from releasing the per-handle state, this function is just a cosmetic wrapper, added for consistency. */
 int i2c_close(int handle) {
+  drop_state(handle);
   return close(handle);
 }
+
+
+/* Returns CLOCK_MONOTONIC in nanoseconds. All the scheduling code in the library uses this single time base. */
+uint64_t i2c_monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/*
+  Sleeps until i2c_monotonic_ns() reaches ns. An absolute deadline does not drift when the sleep is interrupted by a
+  signal, so relative waits are written as i2c_sleep_until(i2c_monotonic_ns() + delay) too.
+*/
+void i2c_sleep_until(uint64_t ns) {
+  struct timespec until;
+
+  until.tv_sec = ns / 1000000000ULL;
+  until.tv_nsec = ns % 1000000000ULL;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 0) == EINTR);
+}
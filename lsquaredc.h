@@ -30,10 +30,55 @@
 #define I2C_RESTART     1<<8    /* repeated start */
 #define I2C_READ		2<<8    /* read a byte */
 
+/* Adapter limit flags, see struct i2c_limits. */
+#define I2C_LIMIT_WRITE_THEN_READ   1   /* combined transfers can only be one write followed by one read */
+#define I2C_LIMIT_NO_COMBINED       2   /* no repeated starts at all: one message per transfer */
+#define I2C_LIMIT_READ_LAST         4   /* only the last message of a transfer can be a read */
+
+/* Where the limits of an adapter came from. */
+#define I2C_LIMITS_DEFAULT  0
+#define I2C_LIMITS_TABLE    1           /* known adapter driver */
+#define I2C_LIMITS_PROBED   2
+#define I2C_LIMITS_USER     3
+
+/* What an adapter can do in a single transfer. A length of 0 means no limit (other than the 16-bit message length). */
+struct i2c_limits {
+  uint32_t max_read_length;             /* per message */
+  uint32_t max_write_length;
+  uint32_t max_messages;                /* per transfer */
+  uint32_t flags;
+  uint32_t source;
+  char adapter_name[48];
+  uint32_t read_chunk;                  /* preferred length of bulk reads and writes, 0 for as long as allowed */
+  uint32_t write_chunk;                 /* (see i2c_tune_step()) */
+};
+
 int i2c_open(uint8_t bus);
 
 int i2c_send_sequence(int handle, uint16_t *sequence, uint32_t sequence_length, uint8_t *received_data);
 
 int i2c_close(int handle);
 
+int i2c_plan_cache_enable(int handle, uint32_t entries);
+
+int i2c_plan_cache_stats(int handle, uint32_t *hits, uint32_t *misses);
+
+int i2c_get_limits(int handle, struct i2c_limits *limits);
+
+int i2c_set_limits(int handle, const struct i2c_limits *limits);
+
+int i2c_can_pack(const struct i2c_limits *limits, uint32_t segments, int has_read, uint32_t more_segments);
+
+int i2c_send_writes(int handle, uint16_t *sequence, uint32_t sequence_length);
+
+uint32_t i2c_count_reads(uint16_t *sequence, uint32_t sequence_length);
+
+uint32_t i2c_count_segments(uint16_t *sequence, uint32_t sequence_length);
+
+uint32_t i2c_sequence_clocks(uint16_t *sequence, uint32_t sequence_length);
+
+uint64_t i2c_monotonic_ns(void);
+
+void i2c_sleep_until(uint64_t ns);
+
 #endif
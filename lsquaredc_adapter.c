@@ -0,0 +1,380 @@
+/*
+  lsquaredc_adapter.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <linux/i2c-dev.h>
+#include "lsquaredc.h"
+#include "lsquaredc_adapter.h"
+
+/*
+  Adapter limits in practice: probing them, and block transfers that are split into the largest chunks the adapter can
+  do, so that callers do not have to guess a safe size. See the comment about limits in lsquaredc.c.
+*/
+
+#define PROBE_MAX_READ 4096         /* longer reads are not worth finding out about */
+#define MAX_MESSAGE_LENGTH 65535    /* struct i2c_msg has a 16-bit length */
+
+/* A read of length bytes from first_register, preceded by count - 1 register address writes. */
+static uint32_t probe_sequence(uint16_t *sequence, uint8_t address, uint8_t first_register, uint32_t count,
+                               uint32_t length) {
+  uint32_t i = 0, j;
+
+  for(j = 0; j < count; j++) {
+    if(j > 0) sequence[i++] = I2C_RESTART;
+    if(j < count - 1) {
+      sequence[i++] = address & 0xfe;
+      sequence[i++] = first_register;
+    } else {
+      sequence[i++] = address | 1;
+      for(; length; length--) sequence[i++] = I2C_READ;
+    }
+  }
+  return i;
+}
+
+/*
+  Some adapters fail long reads, others quietly do not fill the buffer. We catch the latter by looking at the last byte
+  with two fill patterns: a device cannot return both.
+*/
+static int read_works(int handle, uint16_t *sequence, uint8_t address, uint8_t first_register, uint32_t length,
+                      uint8_t *data) {
+  uint32_t sequence_length;
+
+  sequence_length = probe_sequence(sequence, address, first_register, 2, length);
+  data[length - 1] = 0x5a;
+  if(i2c_send_sequence(handle, sequence, sequence_length, data) < 0) return 0;
+  if(data[length - 1] != 0x5a) return 1;
+  data[length - 1] = 0xa5;
+  if(i2c_send_sequence(handle, sequence, sequence_length, data) < 0) return 0;
+  return data[length - 1] != 0xa5;
+}
+
+
+/*
+  Measures the limits of the adapter behind handle using a device at address (8-bit form, as in sequences) that is safe
+  to read from first_register onwards, with an auto-incrementing register address. Only reads and register address
+  writes are done: write length limits cannot be probed without writing to the device, so those stay as they were
+  (from the adapter table or i2c_set_limits()). The result replaces the limits of the handle. Returns 0 on success, or
+  -1 if even a plain register read fails.
+*/
+int i2c_probe_limits(int handle, uint8_t address, uint8_t first_register) {
+  struct i2c_limits original, limits;
+  uint16_t *sequence = malloc((2 * I2C_RDRW_IOCTL_MAX_MSGS + 4 + PROBE_MAX_READ) * sizeof(uint16_t));
+  uint8_t *data = malloc(PROBE_MAX_READ);
+  uint16_t single[2];
+  uint32_t good, bad, middle;
+  int result = -1;
+
+  if(!sequence || !data || i2c_get_limits(handle, &original) < 0) goto cleanup;
+
+  /* probe with no limits, or the library would refuse our experiments */
+  limits = original;
+  limits.max_read_length = 0;
+  limits.max_messages = I2C_RDRW_IOCTL_MAX_MSGS;
+  limits.flags = 0;
+  i2c_set_limits(handle, &limits);
+
+  if(!read_works(handle, sequence, address, first_register, 1, data)) {
+    /* no combined transfers at all? */
+    single[0] = address & 0xfe;
+    single[1] = first_register;
+    if(i2c_send_sequence(handle, single, 2, 0) < 0) goto restore;
+    single[0] = address | 1;
+    single[1] = I2C_READ;
+    if(i2c_send_sequence(handle, single, 2, data) < 0) goto restore;
+    limits.flags = I2C_LIMIT_NO_COMBINED;
+    limits.max_messages = 1;
+  } else {
+    /* a read followed by another read */
+    sequence[0] = address | 1;
+    sequence[1] = I2C_READ;
+    sequence[2] = I2C_RESTART;
+    sequence[3] = address | 1;
+    sequence[4] = I2C_READ;
+    if(i2c_send_sequence(handle, sequence, 5, data) < 0) limits.flags |= I2C_LIMIT_READ_LAST;
+
+    /* the number of messages per transfer, by bisection */
+    good = 2;
+    bad = I2C_RDRW_IOCTL_MAX_MSGS + 1;
+    while(bad - good > 1) {
+      middle = (good + bad) / 2;
+      if(i2c_send_sequence(handle, sequence, probe_sequence(sequence, address, first_register, middle, 1), data) < 0) {
+        bad = middle;
+      } else {
+        good = middle;
+      }
+    }
+    limits.max_messages = good;
+    if(good == 2 && (limits.flags & I2C_LIMIT_READ_LAST)) limits.flags = I2C_LIMIT_WRITE_THEN_READ;
+  }
+
+  /* the read length, doubling and then bisecting */
+  if(!(limits.flags & I2C_LIMIT_NO_COMBINED)) {
+    for(good = 1, bad = 0; good < PROBE_MAX_READ; good *= 2) {
+      if(!read_works(handle, sequence, address, first_register, good * 2, data)) {
+        bad = good * 2;
+        break;
+      }
+    }
+    while(bad && bad - good > 1) {
+      middle = (good + bad) / 2;
+      if(read_works(handle, sequence, address, first_register, middle, data)) {
+        good = middle;
+      } else {
+        bad = middle;
+      }
+    }
+    limits.max_read_length = bad ? good : original.max_read_length;
+  }
+  limits.source = I2C_LIMITS_PROBED;
+  original = limits;
+  result = 0;
+
+ restore:
+  i2c_set_limits(handle, &original);
+ cleanup:
+  free(sequence);
+  free(data);
+  return result;
+}
+
+static uint32_t read_chunk(const struct i2c_limits *limits) {
+  uint32_t chunk = limits->max_read_length ? limits->max_read_length : MAX_MESSAGE_LENGTH;
+
+  return (limits->read_chunk && limits->read_chunk < chunk) ? limits->read_chunk : chunk;
+}
+
+static uint32_t write_chunk(const struct i2c_limits *limits) {
+  /* the register address takes one byte of the message */
+  uint32_t chunk = (limits->max_write_length > 1 ? limits->max_write_length : MAX_MESSAGE_LENGTH) - 1;
+
+  return (limits->write_chunk && limits->write_chunk < chunk) ? limits->write_chunk : chunk;
+}
+
+/* One read of count bytes from register, in sequence (with room for 4 + count elements). */
+static int read_one(int handle, const struct i2c_limits *limits, uint16_t *sequence, uint8_t address, uint8_t reg,
+                    uint8_t *data, uint32_t count) {
+  uint32_t i;
+
+  sequence[0] = address & 0xfe;
+  sequence[1] = reg;
+  if(limits->flags & I2C_LIMIT_NO_COMBINED) {
+    if(i2c_send_sequence(handle, sequence, 2, 0) < 0) return -1;
+    sequence[0] = address | 1;
+    for(i = 0; i < count; i++) sequence[1 + i] = I2C_READ;
+    return i2c_send_sequence(handle, sequence, 1 + count, data);
+  }
+  sequence[2] = I2C_RESTART;
+  sequence[3] = address | 1;
+  for(i = 0; i < count; i++) sequence[4 + i] = I2C_READ;
+  return i2c_send_sequence(handle, sequence, 4 + count, data);
+}
+
+/* One write of count bytes to register, in sequence (with room for 2 + count elements). */
+static int write_one(int handle, uint16_t *sequence, uint8_t address, uint8_t reg, const uint8_t *data,
+                     uint32_t count) {
+  uint32_t i;
+
+  sequence[0] = address & 0xfe;
+  sequence[1] = reg;
+  for(i = 0; i < count; i++) sequence[2 + i] = data[i];
+  return i2c_send_sequence(handle, sequence, 2 + count, 0);
+}
+
+
+/*
+  Reads length bytes from consecutive registers of a device with an auto-incrementing (8-bit) register address, in
+  chunks as long as the adapter allows (or as tuned, see i2c_tune_step()). On adapters that cannot do combined
+  transfers, the register address is written in a transfer of its own. Returns the number of bytes read, or -1 in case
+  of an error.
+*/
+int i2c_read_block(int handle, uint8_t address, uint8_t first_register, uint8_t *data, uint32_t length) {
+  struct i2c_limits limits;
+  uint16_t *sequence;
+  uint32_t chunk, offset, count;
+  int result = 0;
+
+  if(i2c_get_limits(handle, &limits) < 0) return -1;
+  chunk = read_chunk(&limits);
+  if(chunk > length) chunk = length;
+  sequence = malloc((4 + chunk) * sizeof(uint16_t));
+  if(!sequence) return -1;
+
+  for(offset = 0; offset < length && result >= 0; offset += count) {
+    count = (length - offset < chunk) ? length - offset : chunk;
+    result = read_one(handle, &limits, sequence, address, (uint8_t)(first_register + offset), data + offset, count);
+  }
+  free(sequence);
+  return (result < 0) ? -1 : (int)length;
+}
+
+
+/*
+  Writes length bytes to consecutive registers of a device with an auto-incrementing (8-bit) register address, split
+  into the longest writes the adapter allows (or as tuned). Devices with write pages (EEPROMs) need their own splitting
+  on page boundaries. Returns the number of bytes written, or -1 in case of an error.
+*/
+int i2c_write_block(int handle, uint8_t address, uint8_t first_register, const uint8_t *data, uint32_t length) {
+  struct i2c_limits limits;
+  uint16_t *sequence;
+  uint32_t chunk, offset, count;
+  int result = 0;
+
+  if(i2c_get_limits(handle, &limits) < 0) return -1;
+  chunk = write_chunk(&limits);
+  if(chunk > length) chunk = length;
+  sequence = malloc((2 + chunk) * sizeof(uint16_t));
+  if(!sequence) return -1;
+
+  for(offset = 0; offset < length && result >= 0; offset += count) {
+    count = (length - offset < chunk) ? length - offset : chunk;
+    result = write_one(handle, sequence, address, (uint8_t)(first_register + offset), data + offset, count);
+  }
+  free(sequence);
+  return (result < 0) ? -1 : (int)length;
+}
+
+
+/*
+  Burst length tuning. Longer transfers amortize the per-transfer cost (the ioctl, the START and address byte), but
+  some adapters move data by PIO through a small FIFO and get no faster, or even slower, past a certain length, while
+  others do best with the longest transfer possible. So we measure: the tuner reads (and optionally writes) chunks of
+  4, 8, ... bytes from a device that is safe to read, keeps the fastest time seen for every length (the minimum is
+  robust against being preempted), and picks the shortest length that gets within 3% of the best throughput, shorter
+  transfers being kinder to other users of the bus. The result goes into the read_chunk and write_chunk limits of the
+  handle and is used by i2c_read_block() and i2c_write_block().
+
+  Tuning is done one transfer at a time, so that it can be spread over idle time: call i2c_tune_step() whenever the bus
+  has nothing better to do, until it returns 1. Lengths are measured round-robin, so that a change in bus load affects
+  all of them alike. Writes are only tuned with write_back set, which writes back the data just read, so the registers
+  must be plain RAM-like ones (no side effects on write, no read-only or self-clearing bits).
+*/
+
+#define DEFAULT_TUNE_ROUNDS 8
+#define TUNE_MAX_LENGTH 4096
+#define TUNE_TOLERANCE 97           /* percent of the best throughput that is good enough */
+
+/* Returns 0 if the tuner is ready to go, or -1 in case of an error. */
+int i2c_tune_init(struct i2c_burst_tuner *tuner, int handle, uint8_t address, uint8_t first_register, int write_back,
+                  uint32_t rounds) {
+  struct i2c_limits limits;
+  uint32_t longest, length;
+
+  memset(tuner, 0, sizeof(struct i2c_burst_tuner));
+  if(i2c_get_limits(handle, &limits) < 0) return -1;
+  tuner->handle = handle;
+  tuner->address = address;
+  tuner->first_register = first_register;
+  tuner->write_back = write_back;
+  tuner->rounds = rounds ? rounds : DEFAULT_TUNE_ROUNDS;
+
+  longest = (limits.max_read_length && limits.max_read_length < TUNE_MAX_LENGTH) ? limits.max_read_length
+                                                                                 : TUNE_MAX_LENGTH;
+  if(longest == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  /* adapters limited to reads shorter than 4 bytes get a single length */
+  for(length = (longest < 4) ? longest : 4; length <= longest && tuner->length_count < I2C_TUNE_LENGTHS; length *= 2) {
+    tuner->lengths[tuner->length_count++] = length;
+  }
+  if(tuner->length_count < I2C_TUNE_LENGTHS && tuner->lengths[tuner->length_count - 1] < longest) {
+    tuner->lengths[tuner->length_count++] = longest;
+  }
+
+  tuner->sequence = malloc((4 + longest) * sizeof(uint16_t));
+  tuner->data = malloc(longest);
+  if(!tuner->sequence || !tuner->data) {
+    i2c_tune_free(tuner);
+    return -1;
+  }
+  return 0;
+}
+
+void i2c_tune_free(struct i2c_burst_tuner *tuner) {
+  free(tuner->sequence);
+  free(tuner->data);
+  tuner->sequence = 0;
+  tuner->data = 0;
+}
+
+/* The shortest length within TUNE_TOLERANCE of the best throughput, or 0 (no preference) if that is the longest. */
+static uint32_t best_length(struct i2c_burst_tuner *tuner, uint64_t *ns, uint32_t current) {
+  double rate, best_rate = 0;
+  uint32_t i, last = 0;
+
+  for(i = 0; i < tuner->length_count; i++) {
+    if(!ns[i]) continue;
+    rate = (double)tuner->lengths[i] / ns[i];
+    if(rate > best_rate) best_rate = rate;
+    last = i;
+  }
+  if(best_rate == 0) return current;
+  for(i = 0; i < tuner->length_count; i++) {
+    if(ns[i] && (double)tuner->lengths[i] / ns[i] * 100 >= best_rate * TUNE_TOLERANCE) break;
+  }
+  return (i == last) ? 0 : tuner->lengths[i];
+}
+
+
+/*
+  Does one step of tuning: a read of one of the lengths (and a write, if tuning writes). Returns 0 if there is more to
+  do, 1 when tuning is done and the chosen lengths have been applied to the handle, or -1 in case of an error.
+*/
+int i2c_tune_step(struct i2c_burst_tuner *tuner) {
+  struct i2c_limits limits;
+  uint32_t i = tuner->step % tuner->length_count;
+  uint32_t length = tuner->lengths[i];
+  uint64_t start_ns, elapsed_ns;
+
+  if(tuner->step >= tuner->rounds * tuner->length_count) return 1;
+  if(i2c_get_limits(tuner->handle, &limits) < 0) return -1;
+
+  start_ns = i2c_monotonic_ns();
+  if(read_one(tuner->handle, &limits, tuner->sequence, tuner->address, tuner->first_register, tuner->data,
+              length) < 0) {
+    return -1;
+  }
+  elapsed_ns = i2c_monotonic_ns() - start_ns;
+  if(!tuner->read_ns[i] || elapsed_ns < tuner->read_ns[i]) tuner->read_ns[i] = elapsed_ns;
+
+  /* only what fits in a write, and in the register space of the device */
+  if(tuner->write_back && length <= write_chunk(&limits) && tuner->first_register + length <= 0x100) {
+    start_ns = i2c_monotonic_ns();
+    if(write_one(tuner->handle, tuner->sequence, tuner->address, tuner->first_register, tuner->data, length) < 0) {
+      return -1;
+    }
+    elapsed_ns = i2c_monotonic_ns() - start_ns;
+    if(!tuner->write_ns[i] || elapsed_ns < tuner->write_ns[i]) tuner->write_ns[i] = elapsed_ns;
+  }
+
+  if(++tuner->step < tuner->rounds * tuner->length_count) return 0;
+  limits.read_chunk = best_length(tuner, tuner->read_ns, limits.read_chunk);
+  if(tuner->write_back) limits.write_chunk = best_length(tuner, tuner->write_ns, limits.write_chunk);
+  if(i2c_set_limits(tuner->handle, &limits) < 0) return -1;
+  return 1;
+}
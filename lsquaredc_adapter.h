@@ -0,0 +1,61 @@
+/*
+  lsquaredc_adapter.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_ADAPTER_H
+#define LSQUAREDC_ADAPTER_H
+
+#include <stdint.h>
+
+#define I2C_TUNE_LENGTHS 11             /* 4 to 4096 bytes */
+
+/* Measures bulk transfer throughput for a range of chunk lengths, one transfer at a time, see lsquaredc_adapter.c. */
+struct i2c_burst_tuner {
+  int handle;
+  uint8_t address;
+  uint8_t first_register;
+  int write_back;                       /* also tune writes, by writing back what was read */
+  uint32_t rounds;                      /* transfers per length */
+  uint32_t length_count;
+  uint32_t lengths[I2C_TUNE_LENGTHS];
+  uint64_t read_ns[I2C_TUNE_LENGTHS];   /* fastest transfer seen */
+  uint64_t write_ns[I2C_TUNE_LENGTHS];  /* 0 if the length was not measured */
+  uint32_t step;
+  uint16_t *sequence;
+  uint8_t *data;
+};
+
+int i2c_probe_limits(int handle, uint8_t address, uint8_t first_register);
+
+int i2c_read_block(int handle, uint8_t address, uint8_t first_register, uint8_t *data, uint32_t length);
+
+int i2c_write_block(int handle, uint8_t address, uint8_t first_register, const uint8_t *data, uint32_t length);
+
+int i2c_tune_init(struct i2c_burst_tuner *tuner, int handle, uint8_t address, uint8_t first_register, int write_back,
+                  uint32_t rounds);
+
+int i2c_tune_step(struct i2c_burst_tuner *tuner);
+
+void i2c_tune_free(struct i2c_burst_tuner *tuner);
+
+#endif
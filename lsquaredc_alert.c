@@ -0,0 +1,128 @@
+/*
+  lsquaredc_alert.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "lsquaredc.h"
+#include "lsquaredc_gpio.h"
+#include "lsquaredc_poll.h"
+#include "lsquaredc_alert.h"
+
+/*
+  SMBus alerts. Devices sharing an SMBALERT# line pull it low when they want attention. Instead of reading the status
+  register of every device on the bus to find out who it was, we read one byte from the Alert Response Address: the
+  alerting device with the lowest address wins arbitration, answers with its own address and releases its alert. We
+  repeat until nobody answers (the read is NACKed), so servicing costs one transaction per alerting device, regardless of
+  how many devices share the line.
+*/
+
+#define MAX_ALERTS_PER_SERVICE 32   /* guards against a device that re-asserts its alert immediately */
+
+static uint16_t ara_read[] = {I2C_ALERT_RESPONSE_ADDRESS | 1, I2C_READ};
+
+/* line is the SMBALERT# GPIO line from i2c_gpio_open_line(), or -1 if it is not connected to a GPIO. */
+struct i2c_alert *i2c_alert_create(int handle, int line) {
+  struct i2c_alert *alert = calloc(1, sizeof(struct i2c_alert));
+
+  if(!alert) return 0;
+  alert->handle = handle;
+  alert->line = line;
+  return alert;
+}
+
+/* Registers a handler for the device with the given (shifted) address. A 0 handler removes it. */
+int i2c_alert_set_handler(struct i2c_alert *alert, uint8_t address, i2c_alert_handler_fn handler, void *user) {
+  alert->handlers[address >> 1] = handler;
+  alert->users[address >> 1] = user;
+  return 0;
+}
+
+/* Registers a handler for alerts from devices that have no handler of their own. A 0 handler removes it. */
+void i2c_alert_set_unclaimed(struct i2c_alert *alert, i2c_alert_handler_fn handler, void *user) {
+  alert->unclaimed = handler;
+  alert->unclaimed_user = user;
+}
+
+static void dispatch(struct i2c_alert *alert, uint8_t response) {
+  uint8_t index = response >> 1;    /* bit 0 of the response is not part of the address */
+
+  alert->alerts++;
+  if(alert->handlers[index]) {
+    alert->handlers[index](alert->handle, (uint8_t)(index << 1), alert->users[index]);
+  } else {
+    alert->unhandled++;
+    if(alert->unclaimed) alert->unclaimed(alert->handle, (uint8_t)(index << 1), alert->unclaimed_user);
+  }
+}
+
+/* SMBALERT# is active low. Without a GPIO line we cannot tell, so we assume it is asserted. */
+static int line_asserted(struct i2c_alert *alert) {
+  return (alert->line < 0) || (i2c_gpio_get_value(alert->line) == 0);
+}
+
+
+/*
+  Identifies all devices with a pending alert via the Alert Response Address and calls their handlers. Returns the
+  number of devices serviced.
+*/
+int i2c_alert_service(struct i2c_alert *alert) {
+  uint8_t response;
+  int serviced = 0;
+
+  while(serviced < MAX_ALERTS_PER_SERVICE && line_asserted(alert)) {
+    if(i2c_send_sequence(alert->handle, ara_read, 2, &response) < 0) break; /* NACK: nobody is alerting */
+    dispatch(alert, response);
+    serviced++;
+  }
+  return serviced;
+}
+
+/* For systems where SMBALERT# is only available as a level: checks the line and services alerts if it is asserted. */
+int i2c_alert_poll(struct i2c_alert *alert) {
+  if(alert->line >= 0 && i2c_gpio_get_value(alert->line) != 0) return 0;
+  return i2c_alert_service(alert);
+}
+
+static void ara_published(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length, uint64_t timestamp_ns,
+                          void *user) {
+  struct i2c_alert *alert = user;
+
+  (void)task; (void)data_length; (void)timestamp_ns;
+  dispatch(alert, data[0]);
+  /* more devices may be holding the line low, and there will be no new falling edge for them */
+  i2c_alert_service(alert);
+}
+
+
+/*
+  Services alerts from a poller: a falling edge on the SMBALERT# line triggers the ARA read, so alerts are handled in the
+  same loop as all other polling. Requires the line to have been opened with I2C_GPIO_FALLING.
+*/
+struct i2c_poll_task *i2c_alert_attach(struct i2c_alert *alert, struct i2c_poller *poller) {
+  return i2c_poll_add_triggered(poller, alert->line, alert->handle, ara_read, 2, ara_published, alert);
+}
+
+void i2c_alert_destroy(struct i2c_alert *alert) {
+  free(alert);
+}
@@ -0,0 +1,61 @@
+/*
+  lsquaredc_alert.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_ALERT_H
+#define LSQUAREDC_ALERT_H
+
+#include <stdint.h>
+#include "lsquaredc_poll.h"
+
+#define I2C_ALERT_RESPONSE_ADDRESS  0x18    /* 0x0c shifted left, as all addresses in lsquaredc */
+
+/* address is the (shifted) write address of the device that raised the alert, e.g. 0x38 for a device at 0x1c. */
+typedef void (*i2c_alert_handler_fn)(int handle, uint8_t address, void *user);
+
+struct i2c_alert {
+  int handle;
+  int line;                             /* SMBALERT# GPIO line, or -1 */
+  i2c_alert_handler_fn handlers[128];
+  void *users[128];
+  i2c_alert_handler_fn unclaimed;       /* called for addresses without a handler */
+  void *unclaimed_user;
+  uint32_t alerts;                      /* devices identified via the ARA */
+  uint32_t unhandled;                   /* of those, how many had no handler */
+};
+
+struct i2c_alert *i2c_alert_create(int handle, int line);
+
+int i2c_alert_set_handler(struct i2c_alert *alert, uint8_t address, i2c_alert_handler_fn handler, void *user);
+
+void i2c_alert_set_unclaimed(struct i2c_alert *alert, i2c_alert_handler_fn handler, void *user);
+
+int i2c_alert_service(struct i2c_alert *alert);
+
+int i2c_alert_poll(struct i2c_alert *alert);
+
+struct i2c_poll_task *i2c_alert_attach(struct i2c_alert *alert, struct i2c_poller *poller);
+
+void i2c_alert_destroy(struct i2c_alert *alert);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+  lsquaredc_buspirate.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "lsquaredc.h"
+#include "lsquaredc_buspirate.h"
+
+/*
+  Conversion between sequences and their Bus Pirate text form, for the command-line tools. The sequence
+
+    {0x38, 0x16, I2C_RESTART, 0x39, I2C_READ, I2C_READ, I2C_READ}
+
+  is written as "[0x38 0x16 [0x39 r:3]": the first '[' is the START, every following '[' a repeated start, ']' is the
+  STOP, 'r' reads a byte and 'r:N' reads N bytes. Numbers can be hex (0x..) or decimal. Everything from '#' to the end
+  of the line is a comment.
+*/
+
+
+/*
+  Parses one transaction (from '[' to ']') and advances text past it. Returns the sequence length, 0 if there are no
+  more transactions in the text, or -1 in case of a syntax error or if the sequence would not fit in max_length
+  elements.
+*/
+int i2c_parse_sequence(const char **text, uint16_t *sequence, uint32_t max_length) {
+  const char *p = *text;
+  uint32_t length = 0;
+  unsigned long value;
+  unsigned long count;
+  char *end;
+  int started = 0;
+
+  while(*p) {
+    if(isspace((unsigned char)*p) || *p == ',') {
+      p++;
+    } else if(*p == '#') {
+      while(*p && *p != '\n') p++;
+    } else if(*p == '[') {
+      if(started) {
+        if(length >= max_length) return -1;
+        sequence[length++] = I2C_RESTART;
+      }
+      started = 1;
+      p++;
+    } else if(*p == ']') {
+      if(!started) return -1;
+      *text = p + 1;
+      return (length >= 2) ? (int)length : -1;
+    } else if(!started) {
+      return -1;
+    } else if(*p == 'r' || *p == 'R') {
+      count = 1;
+      p++;
+      if(*p == ':') {
+        count = strtoul(p + 1, &end, 0);
+        if(end == p + 1 || count == 0) return -1;
+        p = end;
+      }
+      while(count--) {
+        if(length >= max_length) return -1;
+        sequence[length++] = I2C_READ;
+      }
+    } else {
+      value = strtoul(p, &end, 0);
+      if(end == p || value > 0xff) return -1;
+      if(length >= max_length) return -1;
+      sequence[length++] = (uint16_t)value;
+      p = end;
+    }
+  }
+  *text = p;
+  return started ? -1 : 0;      /* an unterminated transaction is an error */
+}
+
+
+/*
+  Formats a sequence in Bus Pirate notation, collapsing runs of reads into "r:N". Returns the number of characters
+  written (not counting the terminating 0), or -1 if the buffer is too small.
+*/
+int i2c_format_sequence(uint16_t *sequence, uint32_t sequence_length, char *buffer, size_t size) {
+  size_t used = 0;
+  uint32_t reads;
+  uint32_t i = 0;
+  int n;
+
+  n = snprintf(buffer, size, "[");
+  while(i < sequence_length) {
+    used += n;
+    if(used >= size) return -1;
+    if(sequence[i] == I2C_RESTART) {
+      n = snprintf(buffer + used, size - used, " [");
+      i++;
+    } else if(sequence[i] == I2C_READ) {
+      for(reads = 0; i < sequence_length && sequence[i] == I2C_READ; i++) reads++;
+      n = (reads == 1) ? snprintf(buffer + used, size - used, " r") :
+        snprintf(buffer + used, size - used, " r:%u", reads);
+    } else {
+      n = snprintf(buffer + used, size - used, (i == 0 || sequence[i - 1] == I2C_RESTART) ? "0x%02x" : " 0x%02x",
+                   sequence[i]);
+      i++;
+    }
+  }
+  used += n;
+  if(used >= size) return -1;
+  n = snprintf(buffer + used, size - used, "]");
+  used += n;
+  return (used < size) ? (int)used : -1;
+}
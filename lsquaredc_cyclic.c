@@ -0,0 +1,105 @@
+/*
+  lsquaredc_cyclic.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include "lsquaredc.h"
+#include "lsquaredc_cyclic.h"
+
+/*
+  Cyclic executive: runs a static schedule computed offline by tools/cyclic.c. Time is divided into minor frames of
+  fixed length. At the start of every frame we perform the transfers listed for it and hand the received data of every
+  job to the deliver callback, then sleep until the next frame. There are no scheduling decisions at run time: which
+  transfers happen when, and that they fit in their frames, was decided (and checked) when the tables were generated.
+
+  A frame that does not finish before the next one should start is counted as an overrun. We do not skip frames to
+  catch up, the schedule simply continues late, so an overrun means the cost model used to generate the schedule was
+  wrong.
+*/
+
+void i2c_cyclic_init(struct i2c_cyclic_executive *executive, const struct i2c_cyclic_schedule *schedule,
+                     const int *handles, uint8_t *data, i2c_cyclic_deliver_fn deliver, void *user) {
+  executive->schedule = schedule;
+  executive->handles = handles;
+  executive->data = data;
+  executive->deliver = deliver;
+  executive->user = user;
+  executive->start_ns = 0;
+  executive->frames = 0;
+  executive->overruns = 0;
+  executive->errors = 0;
+  executive->stop = 0;
+}
+
+
+/* Waits for the start of the next minor frame and executes it. Returns 0, or -1 if any transfer in the frame failed. */
+int i2c_cyclic_run_frame(struct i2c_cyclic_executive *executive) {
+  const struct i2c_cyclic_schedule *schedule = executive->schedule;
+  const struct i2c_cyclic_frame *frame = &schedule->frames[executive->frames % schedule->frame_count];
+  const struct i2c_cyclic_transfer *transfer;
+  const struct i2c_cyclic_job *job = &schedule->jobs[frame->first_job];
+  const struct i2c_cyclic_job *last_job = job + frame->job_count;
+  uint64_t frame_ns = (uint64_t)schedule->minor_frame_us * 1000;
+  uint64_t start_ns;
+  uint64_t now;
+  uint32_t t;
+  int failed;
+  int result = 0;
+
+  if(executive->frames == 0) executive->start_ns = i2c_monotonic_ns();
+  start_ns = executive->start_ns + executive->frames * frame_ns;
+  i2c_sleep_until(start_ns);
+
+  for(t = frame->first_transfer; t < frame->first_transfer + frame->transfer_count; t++) {
+    transfer = &schedule->transfers[t];
+    failed = i2c_send_sequence(executive->handles[transfer->bus], (uint16_t *)transfer->sequence,
+                               transfer->sequence_length, executive->data + transfer->data_offset) < 0;
+    now = i2c_monotonic_ns();
+    if(failed) {
+      executive->errors++;
+      result = -1;
+    }
+    for(; job < last_job && job->transfer == t; job++) {
+      if(!failed && executive->deliver) {
+        executive->deliver(job->task, executive->data + job->data_offset, job->data_length, now, executive->user);
+      }
+    }
+  }
+
+  executive->frames++;
+  if(i2c_monotonic_ns() > start_ns + frame_ns) executive->overruns++;
+  return result;
+}
+
+/* Runs the schedule until i2c_cyclic_stop() is called. Failed transfers are counted in errors, but do not stop it. */
+int i2c_cyclic_run(struct i2c_cyclic_executive *executive) {
+  if(executive->schedule->frame_count == 0) return -1;
+  while(!executive->stop) i2c_cyclic_run_frame(executive);
+  return 0;
+}
+
+void i2c_cyclic_stop(struct i2c_cyclic_executive *executive) {
+  executive->stop = 1;
+}
@@ -0,0 +1,91 @@
+/*
+  lsquaredc_cyclic.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_CYCLIC_H
+#define LSQUAREDC_CYCLIC_H
+
+#include <stdint.h>
+
+/* The tables below are normally generated by tools/cyclic.c. */
+
+/* One ioctl: the (possibly packed) sequence of one or more jobs on one bus. */
+struct i2c_cyclic_transfer {
+  uint32_t bus;                         /* index into the handles array */
+  const uint16_t *sequence;
+  uint32_t sequence_length;
+  uint32_t data_offset;                 /* where the received data goes */
+};
+
+/* One execution of a task. Jobs of a frame are listed in the order of their transfers. */
+struct i2c_cyclic_job {
+  uint32_t task;
+  uint32_t transfer;
+  uint32_t data_offset;
+  uint32_t data_length;
+};
+
+struct i2c_cyclic_frame {
+  uint32_t first_transfer;
+  uint32_t transfer_count;
+  uint32_t first_job;
+  uint32_t job_count;
+};
+
+struct i2c_cyclic_schedule {
+  uint32_t minor_frame_us;
+  uint32_t frame_count;                 /* minor frames per major frame */
+  uint32_t task_count;
+  uint32_t data_length;                 /* size of the data buffer */
+  const struct i2c_cyclic_frame *frames;
+  const struct i2c_cyclic_transfer *transfers;
+  const struct i2c_cyclic_job *jobs;
+  const char *const *task_names;
+};
+
+typedef void (*i2c_cyclic_deliver_fn)(uint32_t task, uint8_t *data, uint32_t data_length, uint64_t timestamp_ns,
+                                      void *user);
+
+struct i2c_cyclic_executive {
+  const struct i2c_cyclic_schedule *schedule;
+  const int *handles;
+  uint8_t *data;
+  i2c_cyclic_deliver_fn deliver;
+  void *user;
+  uint64_t start_ns;
+  uint64_t frames;                      /* minor frames executed */
+  uint32_t overruns;                    /* frames that did not finish in time */
+  uint32_t errors;                      /* failed transfers */
+  volatile int stop;
+};
+
+void i2c_cyclic_init(struct i2c_cyclic_executive *executive, const struct i2c_cyclic_schedule *schedule,
+                     const int *handles, uint8_t *data, i2c_cyclic_deliver_fn deliver, void *user);
+
+int i2c_cyclic_run_frame(struct i2c_cyclic_executive *executive);
+
+int i2c_cyclic_run(struct i2c_cyclic_executive *executive);
+
+void i2c_cyclic_stop(struct i2c_cyclic_executive *executive);
+
+#endif
@@ -0,0 +1,273 @@
+/*
+  lsquaredc_dsp.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lsquaredc_poll.h"
+#include "lsquaredc_dsp.h"
+
+/*
+  Post-processing of polled samples. Instead of every consumer converting, calibrating and filtering each sample as it
+  arrives, a stream collects the samples of a poller task into blocks stored by channel (all values of channel 0, then
+  all values of channel 1, ...) and runs the stages over a whole block at a time:
+
+    calibration   a polynomial of up to third degree per channel, evaluated for the whole block at once
+    filtering     an FIR filter (i2c_dsp_lowpass() designs a low-pass one), computed only for the samples we keep
+    decimation    one output per decimation input samples
+
+  The consumer gets one call per block with the calibrated, filtered and decimated values as floats. The stages are
+  plain loops over contiguous arrays with no dependencies between samples (see "Building" in README.md about
+  vectorization). On x86-64 with GCC, the kernels are additionally built for AVX2 and the version is picked at run time.
+
+  The filter starts with a history of zeros, so the first tap_count - 1 input samples are a startup transient. The delay
+  of a symmetric (linear phase) filter is (tap_count - 1) / 2 input samples; output timestamps are those of the newest
+  input sample that went into each output.
+*/
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define KERNEL
+#endif
+
+/* Whether the field can be read from data_length bytes of received data (0 if not known yet). */
+static int field_fits(const struct i2c_poll_field *field, uint32_t data_length) {
+  if(field->width < 1 || field->width > 2) return 0;
+  return data_length == 0 || field->offset + field->width <= data_length;
+}
+
+/* Horner's scheme, one coefficient at a time for the whole block. */
+KERNEL static void calibrate(float *restrict values, float *restrict scratch, uint32_t count,
+                             const float *coefficients, uint32_t degree) {
+  uint32_t i, k;
+
+  for(i = 0; i < count; i++) scratch[i] = coefficients[degree];
+  for(k = degree; k-- > 0;) {
+    for(i = 0; i < count; i++) scratch[i] = scratch[i] * values[i] + coefficients[k];
+  }
+  for(i = 0; i < count; i++) values[i] = scratch[i];
+}
+
+/* out[j] = sum of taps[t] * in[j * step + t], one tap at a time for all outputs. */
+KERNEL static void fir(float *restrict out, const float *restrict in, uint32_t count, uint32_t step,
+                       const float *restrict taps, uint32_t tap_count) {
+  uint32_t j, t;
+  float tap;
+
+  for(j = 0; j < count; j++) out[j] = 0;
+  for(t = 0; t < tap_count; t++) {
+    tap = taps[t];
+    for(j = 0; j < count; j++) out[j] += tap * in[(size_t)j * step + t];
+  }
+}
+
+
+/*
+  Sets up a stream of channel_count channels that processes block_length (at most I2C_DSP_MAX_BLOCK) input samples at
+  a time. Channel c initially reads a signed big-endian 16-bit value at offset 2 * c and has no calibration; there is
+  no filter and no decimation. Returns 0 on success, or -1 in case of an error.
+*/
+int i2c_dsp_init(struct i2c_dsp_stream *stream, uint32_t channel_count, uint32_t block_length) {
+  struct i2c_poll_field field = {0, 2, I2C_FIELD_BIG_ENDIAN | I2C_FIELD_SIGNED, 0};
+  float identity[2] = {0, 1};
+  uint32_t c;
+
+  if(channel_count == 0 || channel_count > I2C_DSP_MAX_CHANNELS || block_length == 0 ||
+     block_length > I2C_DSP_MAX_BLOCK) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(stream, 0, sizeof(struct i2c_dsp_stream));
+  stream->channel_count = channel_count;
+  stream->block_length = block_length;
+  stream->stride = I2C_DSP_MAX_TAPS - 1 + block_length;
+  stream->input = calloc((size_t)channel_count * stream->stride, sizeof(float));
+  stream->output = calloc((size_t)channel_count * block_length, sizeof(float));
+  stream->scratch = calloc(block_length, sizeof(float));
+  if(!stream->input || !stream->output || !stream->scratch) {
+    i2c_dsp_free(stream);
+    return -1;
+  }
+  for(c = 0; c < channel_count; c++) {
+    field.offset = 2 * c;
+    i2c_dsp_set_channel(stream, c, &field, identity, 1);
+    stream->outputs[c] = stream->output + (size_t)c * block_length;
+  }
+  stream->taps[0] = 1;
+  stream->tap_count = 1;
+  stream->decimation = 1;
+  return 0;
+}
+
+/*
+  Sets where the raw value of a channel is and its calibration polynomial, coefficients[0] + coefficients[1] * raw +
+  ... up to the given degree (at most I2C_DSP_MAX_DEGREE). Returns 0 on success, or -1 if the arguments are invalid
+  (including a field that does not fit in the data of the task the stream is attached to).
+*/
+int i2c_dsp_set_channel(struct i2c_dsp_stream *stream, uint32_t channel, const struct i2c_poll_field *field,
+                        const float *coefficients, uint32_t degree) {
+  if(channel >= stream->channel_count || degree > I2C_DSP_MAX_DEGREE || !field_fits(field, stream->data_length)) {
+    errno = EINVAL;
+    return -1;
+  }
+  stream->channels[channel].field = *field;
+  memset(stream->channels[channel].coefficients, 0, sizeof(stream->channels[channel].coefficients));
+  memcpy(stream->channels[channel].coefficients, coefficients, (degree + 1) * sizeof(float));
+  stream->channels[channel].degree = degree;
+  return 0;
+}
+
+
+/*
+  Sets the FIR filter (the same for all channels) and the decimation factor. Samples already collected are processed
+  with the old settings first, and the filter history starts over. Returns 0 on success, or -1 if the arguments are
+  invalid.
+*/
+int i2c_dsp_set_filter(struct i2c_dsp_stream *stream, const float *taps, uint32_t tap_count, uint32_t decimation) {
+  uint32_t t;
+
+  if(tap_count == 0 || tap_count > I2C_DSP_MAX_TAPS || decimation == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  i2c_dsp_flush(stream);
+  for(t = 0; t < tap_count; t++) stream->taps[t] = taps[tap_count - 1 - t];
+  stream->tap_count = tap_count;
+  stream->decimation = decimation;
+  stream->phase = 0;
+  memset(stream->input, 0, (size_t)stream->channel_count * stream->stride * sizeof(float));
+  return 0;
+}
+
+/*
+  Designs a linear phase low-pass filter (a Hamming-windowed sinc with unity gain at DC). cutoff is a fraction of the
+  input sample rate, below 0.5; before decimating by M, use at most 0.5 / M. Returns 0, or -1 if the arguments are
+  invalid.
+*/
+int i2c_dsp_lowpass(float *taps, uint32_t tap_count, double cutoff) {
+  double middle = (tap_count - 1) / 2.0, sum = 0, x, value;
+  uint32_t t;
+
+  if(tap_count == 0 || cutoff <= 0 || cutoff >= 0.5) {
+    errno = EINVAL;
+    return -1;
+  }
+  for(t = 0; t < tap_count; t++) {
+    x = t - middle;
+    value = (x == 0) ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+    if(tap_count > 1) value *= 0.54 - 0.46 * cos(2 * M_PI * t / (tap_count - 1));
+    taps[t] = value;
+    sum += value;
+  }
+  for(t = 0; t < tap_count; t++) taps[t] /= sum;
+  return 0;
+}
+
+/* Runs the stages over the collected samples and hands the output to the consumer. */
+static void run(struct i2c_dsp_stream *stream) {
+  uint32_t history = stream->tap_count - 1, count = 0, c, j;
+  uint32_t samples = stream->filled, step = stream->decimation;
+  struct i2c_dsp_channel *channel;
+  float *input;
+
+  if(stream->phase < samples) count = (samples - 1 - stream->phase) / step + 1;
+  for(c = 0; c < stream->channel_count; c++) {
+    channel = &stream->channels[c];
+    input = stream->input + (size_t)c * stream->stride;
+    calibrate(input + history, stream->scratch, samples, channel->coefficients, channel->degree);
+    fir(stream->outputs[c], input + stream->phase, count, step, stream->taps, stream->tap_count);
+    memmove(input, input + samples, history * sizeof(float));
+  }
+  for(j = 0; j < count; j++) stream->output_timestamps[j] = stream->timestamps[stream->phase + j * step];
+  stream->phase = stream->phase + count * step - samples;
+  stream->filled = 0;
+  stream->blocks++;
+  stream->samples_out += count;
+  if(count && stream->output_fn) {
+    stream->output_fn(stream, stream->outputs, stream->output_timestamps, count, stream->user);
+  }
+}
+
+
+/*
+  Adds a sample (the received data of a polled sequence, which must be long enough for the fields of all channels).
+  The stages run when a block is full.
+*/
+void i2c_dsp_push(struct i2c_dsp_stream *stream, const uint8_t *data, uint64_t timestamp_ns) {
+  uint32_t position = stream->tap_count - 1 + stream->filled;
+  uint32_t c;
+
+  for(c = 0; c < stream->channel_count; c++) {
+    stream->input[(size_t)c * stream->stride + position] = i2c_poll_field_value(&stream->channels[c].field, data);
+  }
+  stream->timestamps[stream->filled++] = timestamp_ns;
+  stream->samples_in++;
+  if(stream->filled == stream->block_length) run(stream);
+}
+
+/* Processes the samples collected so far without waiting for a full block. */
+void i2c_dsp_flush(struct i2c_dsp_stream *stream) {
+  if(stream->filled) run(stream);
+}
+
+static void sample_published(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length, uint64_t timestamp_ns,
+                             void *user) {
+  (void)task; (void)data_length;
+  i2c_dsp_push(user, data, timestamp_ns);
+}
+
+
+/*
+  Feeds every sample of a poller task into the stream (the task publishes every sample from now on, changed or not)
+  and delivers the output blocks to output_fn. Returns 0 on success, or -1 if the field of a channel does not fit in
+  the data of the task.
+*/
+int i2c_dsp_attach(struct i2c_dsp_stream *stream, struct i2c_poll_task *task, i2c_dsp_output_fn output_fn,
+                   void *user) {
+  uint32_t c;
+
+  for(c = 0; c < stream->channel_count; c++) {
+    if(!field_fits(&stream->channels[c].field, task->data_length)) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  stream->data_length = task->data_length;
+  stream->output_fn = output_fn;
+  stream->user = user;
+  task->publish = sample_published;
+  task->user = stream;
+  task->publish_always = 1;
+  return 0;
+}
+
+void i2c_dsp_free(struct i2c_dsp_stream *stream) {
+  free(stream->input);
+  free(stream->output);
+  free(stream->scratch);
+  stream->input = stream->output = stream->scratch = 0;
+}
@@ -0,0 +1,91 @@
+/*
+  lsquaredc_dsp.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_DSP_H
+#define LSQUAREDC_DSP_H
+
+#include <stdint.h>
+#include "lsquaredc_poll.h"
+
+#define I2C_DSP_MAX_CHANNELS    16
+#define I2C_DSP_MAX_DEGREE      3       /* of calibration polynomials */
+#define I2C_DSP_MAX_TAPS        64
+#define I2C_DSP_MAX_BLOCK       256     /* input samples processed at a time */
+
+struct i2c_dsp_stream;
+
+/* Receives count output samples: channels[c][i] is channel c of sample i. */
+typedef void (*i2c_dsp_output_fn)(struct i2c_dsp_stream *stream, float **channels, const uint64_t *timestamps,
+                                  uint32_t count, void *user);
+
+struct i2c_dsp_channel {
+  struct i2c_poll_field field;          /* where the raw value is in the polled data */
+  float coefficients[I2C_DSP_MAX_DEGREE + 1]; /* calibrated = c0 + c1 * raw + c2 * raw^2 + c3 * raw^3 */
+  uint32_t degree;
+};
+
+/* Calibration, low-pass filtering and decimation of the samples of one polled stream, see lsquaredc_dsp.c. */
+struct i2c_dsp_stream {
+  uint32_t channel_count;
+  struct i2c_dsp_channel channels[I2C_DSP_MAX_CHANNELS];
+  float taps[I2C_DSP_MAX_TAPS];         /* in reverse order */
+  uint32_t tap_count;
+  uint32_t decimation;                  /* one output sample per this many input samples */
+  uint32_t block_length;
+  uint32_t data_length;                 /* of the samples of the task the stream is attached to, 0 before that */
+  uint32_t filled;                      /* input samples in the current block */
+  uint32_t phase;                       /* input sample of the current block that gives the next output */
+  uint32_t stride;                      /* floats per channel in input */
+  float *input;                         /* per channel: tap_count - 1 samples of history, then the block */
+  float *output;                        /* per channel: block_length samples */
+  float *scratch;
+  float *outputs[I2C_DSP_MAX_CHANNELS];
+  uint64_t timestamps[I2C_DSP_MAX_BLOCK];
+  uint64_t output_timestamps[I2C_DSP_MAX_BLOCK];
+  i2c_dsp_output_fn output_fn;
+  void *user;
+  uint64_t samples_in;
+  uint64_t samples_out;
+  uint64_t blocks;
+};
+
+int i2c_dsp_init(struct i2c_dsp_stream *stream, uint32_t channel_count, uint32_t block_length);
+
+int i2c_dsp_set_channel(struct i2c_dsp_stream *stream, uint32_t channel, const struct i2c_poll_field *field,
+                        const float *coefficients, uint32_t degree);
+
+int i2c_dsp_set_filter(struct i2c_dsp_stream *stream, const float *taps, uint32_t tap_count, uint32_t decimation);
+
+int i2c_dsp_lowpass(float *taps, uint32_t tap_count, double cutoff);
+
+void i2c_dsp_push(struct i2c_dsp_stream *stream, const uint8_t *data, uint64_t timestamp_ns);
+
+void i2c_dsp_flush(struct i2c_dsp_stream *stream);
+
+int i2c_dsp_attach(struct i2c_dsp_stream *stream, struct i2c_poll_task *task, i2c_dsp_output_fn output_fn,
+                   void *user);
+
+void i2c_dsp_free(struct i2c_dsp_stream *stream);
+
+#endif
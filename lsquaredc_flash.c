@@ -0,0 +1,280 @@
+/*
+  lsquaredc_flash.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "lsquaredc.h"
+#include "lsquaredc_flash.h"
+
+/*
+  Firmware flashing through I2C bootloaders. The image is written page by page, and every page goes out in as few
+  writes as the adapter allows. The data is not copied into a sequence: the command and flash address go in one
+  message, and the data follows straight from the image in a second message flagged I2C_M_NOSTART, so that the two
+  form a single write on the bus. Adapters that cannot do that get a single message, at the cost of one memcpy().
+
+  Pages that need not be written are skipped: pages that are all 0xff when the flash is known to be erased, pages that
+  are the same in the image known to be on the device (flash->previous), and, if the bootloader can calculate CRCs
+  and flash->check_pages is set, pages whose CRC on the device matches the image.
+
+  After every write we wait for the bootloader to finish programming. How long that takes is learned with an
+  i2c_predictor (see lsquaredc_predict.c): the status is first read when most pages would be done, and only then
+  polled. The histogram of the predictor spans protocol.page_time_us, so that page times of tens of milliseconds get
+  the same resolution as conversions of a few hundred microseconds. Without a status command, the bootloader is assumed to not acknowledge its address while busy, and is polled
+  with one-byte reads.
+
+  Verification asks the bootloader for the CRC-32 of the whole image if it can calculate CRCs, and only otherwise reads
+  everything back.
+*/
+
+#define MAX_HEADER 9                /* command, address (4 bytes), length (4 bytes) */
+#define MAX_MESSAGE_LENGTH 65535
+#define TIMEOUT_NS 5000000000ULL    /* page erase and program, on slow flash */
+#define DEFAULT_PAGE_TIME_US 40000
+
+/* CRC-32 (IEEE 802.3, as in zlib), half a byte at a time. */
+static const uint32_t crc_nibbles[16] = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+/* Continues a CRC-32 (start with 0) over length bytes of data. */
+uint32_t i2c_crc32(uint32_t crc, const uint8_t *data, uint32_t length) {
+  uint32_t i;
+
+  crc = ~crc;
+  for(i = 0; i < length; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ crc_nibbles[crc & 0x0f];
+    crc = (crc >> 4) ^ crc_nibbles[crc & 0x0f];
+  }
+  return ~crc;
+}
+
+static uint32_t header(struct i2c_flash *flash, uint8_t *buffer, uint8_t command, uint32_t address) {
+  uint32_t i, bytes = flash->protocol.address_bytes;
+
+  buffer[0] = command;
+  for(i = 0; i < bytes; i++) buffer[1 + i] = address >> (8 * (bytes - 1 - i));
+  return 1 + bytes;
+}
+
+static int rdwr(struct i2c_flash *flash, struct i2c_msg *messages, uint32_t count) {
+  struct i2c_rdwr_ioctl_data message_sequence;
+
+  message_sequence.msgs = messages;
+  message_sequence.nmsgs = count;
+  flash->stats.transfers++;
+  return ioctl(flash->handle, I2C_RDWR, (unsigned long)(&message_sequence)) < 0 ? -1 : 0;
+}
+
+static void set_message(struct i2c_msg *message, uint8_t address, uint16_t flags, uint32_t length, uint8_t *buffer) {
+  message->addr = address >> 1;
+  message->flags = flags;
+  message->len = length;
+  message->buf = buffer;
+}
+
+/* A command, then a read of length bytes into data, in one transfer if the adapter can do that. */
+static int command_read(struct i2c_flash *flash, uint8_t *command, uint32_t command_length, uint8_t *data,
+                        uint32_t length, int combined) {
+  struct i2c_msg messages[2];
+
+  set_message(&messages[0], flash->address, 0, command_length, command);
+  set_message(&messages[1], flash->address, I2C_M_RD, length, data);
+  if(combined) return rdwr(flash, messages, 2);
+  if(rdwr(flash, messages, 1) < 0) return -1;
+  return rdwr(flash, messages + 1, 1);
+}
+
+static int combined_reads(struct i2c_flash *flash) {
+  struct i2c_limits limits;
+
+  return i2c_get_limits(flash->handle, &limits) == 0 && !(limits.flags & I2C_LIMIT_NO_COMBINED);
+}
+
+static int device_crc(struct i2c_flash *flash, uint32_t address, uint32_t length, uint32_t *crc) {
+  uint8_t command[MAX_HEADER], result[4];
+  uint32_t i = header(flash, command, flash->protocol.crc_command, address);
+
+  command[i++] = length >> 24;
+  command[i++] = length >> 16;
+  command[i++] = length >> 8;
+  command[i++] = length;
+  if(command_read(flash, command, i, result, 4, combined_reads(flash)) < 0) return -1;
+  *crc = ((uint32_t)result[0] << 24) | ((uint32_t)result[1] << 16) | ((uint32_t)result[2] << 8) | result[3];
+  return 0;
+}
+
+/* Returns 1 if the bootloader is done programming, 0 if it is still busy (see i2c_predict_wait()). */
+static int ready(void *user) {
+  struct i2c_flash *flash = user;
+  uint8_t status;
+  struct i2c_msg message;
+
+  flash->stats.status_reads++;
+  if(flash->protocol.status_command == 0) {
+    set_message(&message, flash->address, I2C_M_RD, 1, &status);
+    return rdwr(flash, &message, 1) == 0;
+  }
+  if(command_read(flash, &flash->protocol.status_command, 1, &status, 1, combined_reads(flash)) < 0) return 0;
+  return !(status & flash->protocol.busy_mask);
+}
+
+/* Returns 0 on success. Checks whether the adapter can write without a START, to send data straight from images. */
+int i2c_flash_init(struct i2c_flash *flash, int handle, uint8_t address, const struct i2c_flash_protocol *protocol) {
+  unsigned long functions;
+  struct i2c_limits limits;
+  uint32_t bucket_us;
+
+  memset(flash, 0, sizeof(struct i2c_flash));
+  if(!protocol->page_size || protocol->address_bytes > 4) return -1;
+  flash->handle = handle;
+  flash->address = address & 0xfe;
+  flash->protocol = *protocol;
+  if(!flash->protocol.page_time_us) flash->protocol.page_time_us = DEFAULT_PAGE_TIME_US;
+  bucket_us = (flash->protocol.page_time_us + I2C_PREDICT_BUCKETS - 1) / I2C_PREDICT_BUCKETS;
+  if(!flash->protocol.poll_us) flash->protocol.poll_us = bucket_us;
+  if(i2c_get_limits(handle, &limits) < 0) return -1;
+  flash->nostart = ioctl(handle, I2C_FUNCS, &functions) == 0 && (functions & I2C_FUNC_NOSTART) &&
+    limits.max_messages >= 2 && !(limits.flags & (I2C_LIMIT_WRITE_THEN_READ | I2C_LIMIT_NO_COMBINED));
+  i2c_predict_init(&flash->predictor, bucket_us, 95, flash->protocol.poll_us);
+  return 0;
+}
+
+static int blank(const uint8_t *data, uint32_t length) {
+  return data[0] == 0xff && memcmp(data, data + 1, length - 1) == 0;
+}
+
+/* Whether the page at offset is already on the device, as far as we can tell. */
+static int unchanged(struct i2c_flash *flash, uint32_t address, const uint8_t *data, uint32_t length,
+                     uint32_t offset) {
+  uint32_t crc;
+
+  if(flash->previous && memcmp(flash->previous + offset, data, length) == 0) return 1;
+  if(!flash->check_pages || !flash->protocol.crc_command) return 0;
+  return device_crc(flash, address, length, &crc) == 0 && crc == i2c_crc32(0, data, length);
+}
+
+
+/*
+  Programs length bytes of image at flash_address, skipping what need not be written. The flash must have been erased
+  if the bootloader needs that. Returns 0 on success, or -1 in case of an error (errno is ETIMEDOUT if the bootloader
+  stayed busy).
+*/
+int i2c_flash_write(struct i2c_flash *flash, uint32_t flash_address, const uint8_t *image, uint32_t length) {
+  struct i2c_limits limits;
+  struct i2c_msg messages[2];
+  uint8_t *buffer;
+  uint32_t header_length = 1 + flash->protocol.address_bytes;
+  uint32_t offset, page_length, chunk, count, position, address;
+  uint64_t start_ns;
+  int result = 0;
+
+  if(i2c_get_limits(flash->handle, &limits) < 0) return -1;
+  chunk = (limits.max_write_length ? limits.max_write_length : MAX_MESSAGE_LENGTH) - header_length;
+  if(limits.write_chunk && limits.write_chunk < chunk) chunk = limits.write_chunk;
+  if(chunk > flash->protocol.page_size) chunk = flash->protocol.page_size;
+  buffer = malloc(header_length + (flash->nostart ? 0 : chunk));
+  if(!buffer) return -1;
+
+  for(offset = 0; offset < length && result == 0; offset += page_length) {
+    address = flash_address + offset;
+    page_length = flash->protocol.page_size - address % flash->protocol.page_size;
+    if(page_length > length - offset) page_length = length - offset;
+    flash->stats.pages++;
+    if(flash->erased && blank(image + offset, page_length)) {
+      flash->stats.pages_blank++;
+      continue;
+    }
+    if(unchanged(flash, address, image + offset, page_length, offset)) {
+      flash->stats.pages_unchanged++;
+      continue;
+    }
+
+    for(position = 0; position < page_length && result == 0; position += count) {
+      count = (page_length - position < chunk) ? page_length - position : chunk;
+      header(flash, buffer, flash->protocol.write_command, address + position);
+      if(flash->nostart) {
+        set_message(&messages[0], flash->address, 0, header_length, buffer);
+        set_message(&messages[1], flash->address, I2C_M_NOSTART, count, (uint8_t *)image + offset + position);
+        result = rdwr(flash, messages, 2);
+      } else {
+        memcpy(buffer + header_length, image + offset + position, count);
+        set_message(&messages[0], flash->address, 0, header_length + count, buffer);
+        result = rdwr(flash, messages, 1);
+      }
+      if(result == 0) {
+        start_ns = i2c_monotonic_ns();
+        flash->stats.bytes_written += count;
+        result = i2c_predict_wait(&flash->predictor, start_ns, TIMEOUT_NS, ready, flash);
+      }
+    }
+    if(result == 0) flash->stats.pages_written++;
+  }
+  free(buffer);
+  return result;
+}
+
+
+/*
+  Checks that length bytes at flash_address match image: with a single CRC command if the bootloader has one, otherwise
+  by reading everything back. Returns 0 if they match, 1 if they do not, or -1 in case of an error.
+*/
+int i2c_flash_verify(struct i2c_flash *flash, uint32_t flash_address, const uint8_t *image, uint32_t length) {
+  struct i2c_limits limits;
+  uint8_t command[MAX_HEADER];
+  uint8_t *buffer;
+  uint32_t offset, chunk, count, crc;
+  int combined, result = 0;
+
+  if(flash->protocol.crc_command) {
+    if(device_crc(flash, flash_address, length, &crc) < 0) return -1;
+    return crc != i2c_crc32(0, image, length);
+  }
+
+  if(i2c_get_limits(flash->handle, &limits) < 0) return -1;
+  chunk = limits.max_read_length ? limits.max_read_length : MAX_MESSAGE_LENGTH;
+  if(limits.read_chunk && limits.read_chunk < chunk) chunk = limits.read_chunk;
+  if(chunk > length) chunk = length;
+  combined = !(limits.flags & I2C_LIMIT_NO_COMBINED);
+  if(!(buffer = malloc(chunk ? chunk : 1))) return -1;
+
+  for(offset = 0; offset < length && result == 0; offset += count) {
+    count = (length - offset < chunk) ? length - offset : chunk;
+    if(command_read(flash, command, header(flash, command, flash->protocol.read_command, flash_address + offset),
+                    buffer, count, combined) < 0) {
+      result = -1;
+    } else if(memcmp(buffer, image + offset, count) != 0) {
+      result = 1;
+    }
+  }
+  free(buffer);
+  return result;
+}
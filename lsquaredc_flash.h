@@ -0,0 +1,77 @@
+/*
+  lsquaredc_flash.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_FLASH_H
+#define LSQUAREDC_FLASH_H
+
+#include <stdint.h>
+#include "lsquaredc_predict.h"
+
+/*
+  The commands of an I2C bootloader. Flash addresses follow the command, big-endian, in address_bytes bytes. See
+  lsquaredc_flash.c.
+*/
+struct i2c_flash_protocol {
+  uint32_t page_size;                   /* programming unit: writes never cross a page boundary */
+  uint32_t address_bytes;               /* 0 to 4 */
+  uint8_t write_command;                /* [write_command, address, data...] programs data at address */
+  uint8_t read_command;                 /* [read_command, address] + read: reads flash from address */
+  uint8_t status_command;               /* [status_command] + read of one byte: busy while (status & busy_mask) */
+  uint8_t busy_mask;
+  uint8_t crc_command;                  /* [crc_command, address, length (4 bytes)] + read of a 4-byte CRC-32, 0 if none */
+  uint32_t page_time_us;                /* longest expected page program time, 0 for 40 ms */
+  uint32_t poll_us;                     /* status poll interval while programming, 0 for page_time_us / 64 */
+};
+
+struct i2c_flash_stats {
+  uint32_t pages;
+  uint32_t pages_written;
+  uint32_t pages_blank;                 /* skipped: all 0xff on erased flash */
+  uint32_t pages_unchanged;             /* skipped: already on the device */
+  uint32_t transfers;
+  uint32_t status_reads;
+  uint64_t bytes_written;
+};
+
+struct i2c_flash {
+  int handle;
+  uint8_t address;                      /* 8-bit form, as in sequences */
+  struct i2c_flash_protocol protocol;
+  int erased;                           /* the flash is erased, so blank pages need not be written */
+  const uint8_t *previous;              /* the image known to be on the device (same flash address), or 0 */
+  int check_pages;                      /* ask the device for the CRC of every page and skip the ones that match */
+  int nostart;                          /* the adapter can continue a write without a START (I2C_FUNC_NOSTART) */
+  struct i2c_predictor predictor;       /* learns how long programming takes */
+  struct i2c_flash_stats stats;
+};
+
+uint32_t i2c_crc32(uint32_t crc, const uint8_t *data, uint32_t length);
+
+int i2c_flash_init(struct i2c_flash *flash, int handle, uint8_t address, const struct i2c_flash_protocol *protocol);
+
+int i2c_flash_write(struct i2c_flash *flash, uint32_t flash_address, const uint8_t *image, uint32_t length);
+
+int i2c_flash_verify(struct i2c_flash *flash, uint32_t flash_address, const uint8_t *image, uint32_t length);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+  lsquaredc_gpio.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include "lsquaredc_gpio.h"
+
+#define CHIP_NAME_LENGTH 20     /* example: "/dev/gpiochip12" + the terminating 0 */
+#define EVENT_BATCH 16
+
+/*
+  Device interrupt lines (data ready, FIFO watermark, SMBALERT#) are usually connected to SoC GPIOs. These are thin
+  wrappers around the Linux GPIO character device (v2 uAPI), which gives us a file descriptor that becomes readable
+  when an edge arrives, and a kernel timestamp for every edge. The timestamps use CLOCK_MONOTONIC, the same clock as
+  i2c_monotonic_ns().
+*/
+
+
+/*
+  Requests a single line as an input with edge detection. chip is the number of the GPIO chip (e.g. 0 for
+  "/dev/gpiochip0"), offset is the line offset on that chip and flags is a combination of I2C_GPIO_RISING,
+  I2C_GPIO_FALLING and I2C_GPIO_PULL_UP. Returns a non-blocking line file descriptor, or a negative number in case of
+  an error.
+*/
+int i2c_gpio_open_line(uint8_t chip, uint32_t offset, int flags) {
+  char chip_name[CHIP_NAME_LENGTH];
+  struct gpio_v2_line_request request;
+  int chip_fd;
+  int result;
+
+  snprintf(chip_name, CHIP_NAME_LENGTH, "/dev/gpiochip%d", chip);
+  if((chip_fd = open(chip_name, O_RDWR | O_CLOEXEC)) < 0) return chip_fd;
+
+  memset(&request, 0, sizeof(request));
+  request.offsets[0] = offset;
+  request.num_lines = 1;
+  strncpy(request.consumer, "lsquaredc", GPIO_MAX_NAME_SIZE - 1);
+  request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+  if(flags & I2C_GPIO_RISING) request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+  if(flags & I2C_GPIO_FALLING) request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+  if(flags & I2C_GPIO_PULL_UP) request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+
+  result = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+  close(chip_fd);               /* the line fd stays valid on its own */
+  if(result < 0) return result;
+  fcntl(request.fd, F_SETFL, O_NONBLOCK);
+  return request.fd;
+}
+
+
+/*
+  Reads all pending edge events from a line without blocking (use poll() on the line to wait). Returns the number of
+  events read and stores the kernel timestamp of the most recent one, or returns -1 if there were no events. Several
+  queued events mean that we were late, and a single read of the device will usually pick up all the data anyway.
+*/
+int i2c_gpio_read_events(int line, uint64_t *timestamp_ns) {
+  struct gpio_v2_line_event events[EVENT_BATCH];
+  ssize_t bytes;
+  int count = 0;
+  int n;
+
+  do {
+    bytes = read(line, events, sizeof(events));
+    if(bytes < (ssize_t)sizeof(struct gpio_v2_line_event)) break;
+    n = bytes / sizeof(struct gpio_v2_line_event);
+    if(timestamp_ns) *timestamp_ns = events[n - 1].timestamp_ns;
+    count += n;
+  } while(n == EVENT_BATCH);    /* a full batch means there may be more */
+
+  return count ? count : -1;
+}
+
+/* Returns the current level of the line (0 or 1), or a negative number in case of an error. */
+int i2c_gpio_get_value(int line) {
+  struct gpio_v2_line_values values;
+
+  values.mask = 1;
+  values.bits = 0;
+  if(ioctl(line, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) return -1;
+  return (int)(values.bits & 1);
+}
+
+int i2c_gpio_close_line(int line) {
+  return close(line);
+}
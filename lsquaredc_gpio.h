@@ -0,0 +1,42 @@
+/*
+  lsquaredc_gpio.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_GPIO_H
+#define LSQUAREDC_GPIO_H
+
+#include <stdint.h>
+
+#define I2C_GPIO_RISING     1
+#define I2C_GPIO_FALLING    2
+#define I2C_GPIO_PULL_UP    4   /* for open-drain interrupt lines without an external pull-up */
+
+int i2c_gpio_open_line(uint8_t chip, uint32_t offset, int flags);
+
+int i2c_gpio_read_events(int line, uint64_t *timestamp_ns);
+
+int i2c_gpio_get_value(int line);
+
+int i2c_gpio_close_line(int line);
+
+#endif
@@ -0,0 +1,547 @@
+/*
+  lsquaredc_log.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lsquaredc_ring.h"
+#include "lsquaredc_log.h"
+
+/*
+  Acquisition logging. Writing every sample with fprintf() right after the transfer puts the storage in the bus
+  thread's way, and text is several times larger than the samples. The logger sits behind an acquisition ring
+  (lsquaredc_ring.c): bus threads only ever do i2c_ring_read(), which never blocks. A consumer thread calls
+  i2c_log_drain(), which takes the records out of the ring and collects them into blocks. A writer thread owned by the
+  logger writes the encoded blocks to the file, so the consumer never waits for the storage either, unless all
+  I2C_LOG_BUFFERS buffers are waiting to be written (and then the ring absorbs the delay).
+
+  A block holds up to I2C_LOG_BLOCK_RECORDS records of the same length, stored by column: the timestamps, then the
+  first value of every record, the second value of every record, and so on. A value is a byte or a big-endian 16-bit
+  word (value_bytes), since that is how most devices return their registers. Consecutive samples of a sensor are
+  close to each other, so each column is stored as its first value followed by the differences between neighbouring
+  records, zigzag-encoded (small negative and positive differences both become small numbers), and bit-packed with
+  the number of bits the largest difference of the column needs. Timestamps are packed the same way, after
+  subtracting the smallest difference of the block, so a steady sampling period costs next to nothing.
+
+  Several sensors often share a ring, with records of different lengths interleaved. Records of up to
+  I2C_LOG_OPEN_BLOCKS different lengths are collected into separate blocks at the same time, so interleaving does not
+  cut the blocks short. A record of yet another length closes the fullest open block (counted in evictions). The
+  records of a block are in time order, but blocks of different lengths are not in time order with each other.
+
+  The file is a struct i2c_log_header followed by blocks:
+
+    struct i2c_log_block, struct i2c_log_column[columns], packed timestamps, packed column 0, packed column 1, ...
+
+  where every packed stream is records - 1 values, padded to a multiple of 8 bytes. Blocks are collected in buffers of
+  I2C_LOG_BUFFER_SIZE bytes, and each buffer is padded with a padding block to a multiple of I2C_LOG_ALIGNMENT before
+  it is written, so that every write is large and aligned (which is what SD cards and other flash storage want).
+*/
+
+static uint32_t bits_needed(uint64_t value) {
+  return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+static uint32_t packed_bytes(uint32_t count, uint32_t width) {
+  return (uint32_t)(((uint64_t)count * width + 63) / 64 * 8);
+}
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* Packs count values of width bits into 64-bit words, lowest bits first. Returns the number of bytes written. */
+static uint32_t pack(uint8_t *out, const uint64_t *values, uint32_t count, uint32_t width) {
+  uint64_t *words = (uint64_t *)out;
+  uint64_t word = 0;
+  uint32_t bits = 0, written = 0, i;
+
+  if(width == 0) return 0;
+  for(i = 0; i < count; i++) {
+    word |= values[i] << bits;
+    bits += width;
+    if(bits >= 64) {
+      words[written++] = word;
+      bits -= 64;
+      word = bits ? values[i] >> (width - bits) : 0;
+    }
+  }
+  if(bits) words[written++] = word;
+  return written * 8;
+}
+
+static void unpack(const uint8_t *in, uint64_t *values, uint32_t count, uint32_t width) {
+  const uint64_t *words = (const uint64_t *)in;
+  uint64_t mask = (width == 64) ? ~0ULL : (1ULL << width) - 1;
+  uint64_t bit = 0;
+  uint32_t offset, i;
+
+  for(i = 0; i < count; i++, bit += width) {
+    if(width == 0) {
+      values[i] = 0;
+      continue;
+    }
+    offset = bit & 63;
+    values[i] = words[bit >> 6] >> offset;
+    if(offset + width > 64) values[i] |= words[(bit >> 6) + 1] << (64 - offset);
+    values[i] &= mask;
+  }
+}
+
+static void *writer_thread(void *argument) {
+  struct i2c_logger *logger = argument;
+  uint32_t index, done;
+  ssize_t written;
+  int error;
+
+  pthread_mutex_lock(&logger->lock);
+  for(;;) {
+    while(!logger->queued && !logger->stopping) pthread_cond_wait(&logger->cond, &logger->lock);
+    if(!logger->queued) break;
+    index = logger->writing;
+    error = logger->error;
+    pthread_mutex_unlock(&logger->lock);
+
+    /* after an error, buffers are still taken (and dropped), so that the encoder does not wait forever */
+    for(done = 0; !error && done < logger->used[index]; done += written) {
+      written = write(logger->fd, logger->buffers[index] + done, logger->used[index] - done);
+      if(written < 0 && errno == EINTR) {
+        written = 0;
+      } else if(written <= 0) {
+        error = written < 0 ? errno : EIO;
+      }
+    }
+
+    pthread_mutex_lock(&logger->lock);
+    if(error && !logger->error) logger->error = error;
+    logger->writes++;
+    logger->writing = (logger->writing + 1) % I2C_LOG_BUFFERS;
+    logger->queued--;
+    pthread_cond_broadcast(&logger->cond);
+  }
+  pthread_mutex_unlock(&logger->lock);
+  return 0;
+}
+
+/* Pads the buffer being filled to the alignment, queues it for the writer thread and moves on to the next one. */
+static int hand_off(struct i2c_logger *logger) {
+  uint8_t *buffer = logger->buffers[logger->filling];
+  uint32_t used = logger->used[logger->filling];
+  uint32_t aligned = (used + I2C_LOG_ALIGNMENT - 1) & ~(uint32_t)(I2C_LOG_ALIGNMENT - 1);
+  uint32_t padding[2] = {I2C_LOG_PADDING_MAGIC, aligned - used};
+  int error;
+
+  if(used == 0) return 0;
+  if(aligned > used) {
+    memcpy(buffer + used, padding, sizeof(padding));
+    memset(buffer + used + sizeof(padding), 0, aligned - used - sizeof(padding));
+  }
+  logger->used[logger->filling] = aligned;
+
+  pthread_mutex_lock(&logger->lock);
+  logger->queued++;
+  pthread_cond_broadcast(&logger->cond);
+  logger->filling = (logger->filling + 1) % I2C_LOG_BUFFERS;
+  if(logger->queued == I2C_LOG_BUFFERS) logger->stalls++;
+  while(logger->queued == I2C_LOG_BUFFERS) pthread_cond_wait(&logger->cond, &logger->lock);
+  error = logger->error;
+  pthread_mutex_unlock(&logger->lock);
+
+  logger->used[logger->filling] = 0;
+  if(error) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+/* Encodes the records collected in an open block as a block into the current buffer. */
+static int encode_block(struct i2c_logger *logger, struct i2c_log_open_block *collected) {
+  uint32_t records = collected->records;
+  uint32_t columns = (collected->record_length + logger->value_bytes - 1) / logger->value_bytes;
+  uint64_t *timestamps = collected->timestamps;
+  uint64_t *deltas;
+  uint32_t *values;
+  struct i2c_log_block block;
+  struct i2c_log_column column[I2C_LOG_MAX_COLUMNS];
+  uint64_t min_delta = UINT64_MAX, max_delta = 0;
+  uint32_t bytes, c, i;
+  uint8_t *out;
+
+  if(records == 0) return 0;
+
+  for(i = 1; i < records; i++) {
+    logger->scratch[i - 1] = timestamps[i] - timestamps[i - 1];
+    if(logger->scratch[i - 1] < min_delta) min_delta = logger->scratch[i - 1];
+  }
+  if(records == 1) min_delta = 0;
+  for(i = 0; i + 1 < records; i++) {
+    logger->scratch[i] -= min_delta;
+    if(logger->scratch[i] > max_delta) max_delta = logger->scratch[i];
+  }
+  memset(&block, 0, sizeof(block));
+  block.magic = I2C_LOG_BLOCK_MAGIC;
+  block.records = records;
+  block.record_length = collected->record_length;
+  block.columns = columns;
+  block.timestamp_width = bits_needed(max_delta);
+  block.first_timestamp_ns = timestamps[0];
+  block.min_delta_ns = min_delta;
+  bytes = sizeof(block) + columns * sizeof(struct i2c_log_column) + packed_bytes(records - 1, block.timestamp_width);
+
+  for(c = 0; c < columns; c++) {
+    values = collected->values + (size_t)c * I2C_LOG_BLOCK_RECORDS;
+    deltas = logger->scratch + (size_t)(c + 1) * I2C_LOG_BLOCK_RECORDS;
+    max_delta = 0;
+    for(i = 1; i < records; i++) {
+      deltas[i - 1] = zigzag((int64_t)values[i] - (int64_t)values[i - 1]);
+      if(deltas[i - 1] > max_delta) max_delta = deltas[i - 1];
+    }
+    memset(&column[c], 0, sizeof(struct i2c_log_column));
+    column[c].first = values[0];
+    column[c].width = bits_needed(max_delta);
+    bytes += packed_bytes(records - 1, column[c].width);
+  }
+  block.bytes = bytes;
+
+  if(logger->used[logger->filling] + bytes > I2C_LOG_BUFFER_SIZE && hand_off(logger) < 0) return -1;
+  out = logger->buffers[logger->filling] + logger->used[logger->filling];
+  memcpy(out, &block, sizeof(block));
+  out += sizeof(block);
+  memcpy(out, column, columns * sizeof(struct i2c_log_column));
+  out += columns * sizeof(struct i2c_log_column);
+  out += pack(out, logger->scratch, records - 1, block.timestamp_width);
+  for(c = 0; c < columns; c++) {
+    out += pack(out, logger->scratch + (size_t)(c + 1) * I2C_LOG_BLOCK_RECORDS, records - 1, column[c].width);
+  }
+  logger->used[logger->filling] += bytes;
+  logger->encoded_bytes += bytes;
+  collected->records = 0;
+  return 0;
+}
+
+/*
+  Returns the open block that collects records of length bytes: the one already collecting them, an empty one, or,
+  when all are in use, the fullest one, after encoding it. Returns 0 in case of an error.
+*/
+static struct i2c_log_open_block *open_block(struct i2c_logger *logger, uint32_t length) {
+  uint32_t columns = (length + logger->value_bytes - 1) / logger->value_bytes;
+  struct i2c_log_open_block *collected = 0, *candidate;
+  uint32_t *values;
+  uint32_t i;
+
+  for(i = 0; i < I2C_LOG_OPEN_BLOCKS; i++) {
+    candidate = &logger->open[i];
+    if(candidate->timestamps && candidate->record_length == length) return candidate;
+    if(candidate->records) continue;
+    /* an empty slot, preferably one that already has room for the values */
+    if(!collected || (candidate->columns >= columns && collected->columns < columns)) collected = candidate;
+  }
+  if(!collected) {
+    collected = &logger->open[0];
+    for(i = 1; i < I2C_LOG_OPEN_BLOCKS; i++) {
+      if(logger->open[i].records > collected->records) collected = &logger->open[i];
+    }
+    logger->evictions++;
+    if(encode_block(logger, collected) < 0) return 0;
+  }
+
+  if(!collected->timestamps && !(collected->timestamps = malloc(I2C_LOG_BLOCK_RECORDS * sizeof(uint64_t)))) return 0;
+  if(collected->columns < columns) {
+    if(!(values = realloc(collected->values, (size_t)columns * I2C_LOG_BLOCK_RECORDS * sizeof(uint32_t)))) return 0;
+    collected->values = values;
+    collected->columns = columns;
+  }
+  collected->record_length = length;
+  return collected;
+}
+
+
+/*
+  Creates (or truncates) the log file at path and starts the writer thread. Records will be taken from ring, and split
+  into values of value_bytes bytes (1, or 2 for big-endian words). Returns 0 on success, or -1 in case of an error.
+*/
+int i2c_log_open(struct i2c_logger *logger, const char *path, struct i2c_ring *ring, uint32_t value_bytes) {
+  struct i2c_log_header header;
+  uint32_t i;
+
+  if(value_bytes != 1 && value_bytes != 2) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(logger, 0, sizeof(struct i2c_logger));
+  logger->ring = ring;
+  logger->value_bytes = value_bytes;
+  logger->scratch = malloc((size_t)(I2C_LOG_MAX_COLUMNS + 1) * I2C_LOG_BLOCK_RECORDS * sizeof(uint64_t));
+  for(i = 0; i < I2C_LOG_BUFFERS; i++) {
+    if(posix_memalign((void **)&logger->buffers[i], I2C_LOG_ALIGNMENT, I2C_LOG_BUFFER_SIZE)) logger->buffers[i] = 0;
+  }
+  for(i = 0; i < I2C_LOG_BUFFERS && logger->buffers[i]; i++);
+  if(!logger->scratch || i < I2C_LOG_BUFFERS) goto fail;
+
+  if((logger->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) goto fail;
+  pthread_mutex_init(&logger->lock, 0);
+  pthread_cond_init(&logger->cond, 0);
+  if(pthread_create(&logger->writer, 0, writer_thread, logger)) {
+    close(logger->fd);
+    goto fail;
+  }
+
+  memset(&header, 0, sizeof(header));
+  header.magic = I2C_LOG_MAGIC;
+  header.version = I2C_LOG_VERSION;
+  header.value_bytes = value_bytes;
+  memcpy(logger->buffers[0], &header, sizeof(header));
+  logger->used[0] = sizeof(header);
+  return 0;
+
+ fail:
+  free(logger->scratch);
+  for(i = 0; i < I2C_LOG_BUFFERS; i++) free(logger->buffers[i]);
+  return -1;
+}
+
+
+/*
+  Takes all records that are in the ring now. Full blocks are encoded and handed to the writer thread; the rest wait
+  for more records, or for i2c_log_flush(). Records longer than I2C_LOG_MAX_COLUMNS values are dropped (and counted).
+  Returns the number of records taken, or -1 in case of an error (including an error of an earlier write).
+*/
+int i2c_log_drain(struct i2c_logger *logger) {
+  struct i2c_log_open_block *collected;
+  uint32_t columns, length, c, taken = 0;
+  uint64_t timestamp_ns;
+  uint32_t *values;
+  uint8_t *data;
+
+  while((data = i2c_ring_peek(logger->ring, &length, &timestamp_ns))) {
+    if(length > I2C_LOG_MAX_COLUMNS * logger->value_bytes) {
+      logger->dropped++;
+      i2c_ring_release(logger->ring);
+      continue;
+    }
+    if(!(collected = open_block(logger, length))) return -1;
+    collected->timestamps[collected->records] = timestamp_ns;
+    columns = (length + logger->value_bytes - 1) / logger->value_bytes;
+    values = collected->values + collected->records;
+    if(logger->value_bytes == 2) {
+      for(c = 0; c < length / 2; c++) values[(size_t)c * I2C_LOG_BLOCK_RECORDS] = (data[2 * c] << 8) | data[2 * c + 1];
+      if(length & 1) values[(size_t)c * I2C_LOG_BLOCK_RECORDS] = data[2 * c] << 8;
+    } else {
+      for(c = 0; c < columns; c++) values[(size_t)c * I2C_LOG_BLOCK_RECORDS] = data[c];
+    }
+    i2c_ring_release(logger->ring);
+    collected->records++;
+    logger->logged++;
+    logger->raw_bytes += length + sizeof(uint64_t);
+    taken++;
+    if(collected->records == I2C_LOG_BLOCK_RECORDS && encode_block(logger, collected) < 0) return -1;
+  }
+  return logger->error ? -1 : (int)taken;
+}
+
+/* Encodes the records collected so far (in every open block) and hands everything over to the writer thread. */
+int i2c_log_flush(struct i2c_logger *logger) {
+  uint32_t i;
+
+  for(i = 0; i < I2C_LOG_OPEN_BLOCKS; i++) {
+    if(encode_block(logger, &logger->open[i]) < 0) return -1;
+  }
+  return hand_off(logger);
+}
+
+
+/*
+  Takes what is left in the ring, writes everything out, stops the writer thread and closes the file. Returns 0 on
+  success, or -1 if anything could not be written.
+*/
+int i2c_log_close(struct i2c_logger *logger) {
+  int result = 0;
+  uint32_t i;
+
+  if(i2c_log_drain(logger) < 0 || i2c_log_flush(logger) < 0) result = -1;
+  pthread_mutex_lock(&logger->lock);
+  logger->stopping = 1;
+  pthread_cond_broadcast(&logger->cond);
+  pthread_mutex_unlock(&logger->lock);
+  pthread_join(logger->writer, 0);
+  if(logger->error) {
+    errno = logger->error;
+    result = -1;
+  }
+  if(close(logger->fd) < 0) result = -1;
+  pthread_mutex_destroy(&logger->lock);
+  pthread_cond_destroy(&logger->cond);
+  for(i = 0; i < I2C_LOG_OPEN_BLOCKS; i++) {
+    free(logger->open[i].timestamps);
+    free(logger->open[i].values);
+  }
+  free(logger->scratch);
+  for(i = 0; i < I2C_LOG_BUFFERS; i++) free(logger->buffers[i]);
+  return result;
+}
+
+/* Reads exactly length bytes. Returns length, 0 at the end of the file, or -1 (a partial read is an error too). */
+static int read_fully(int fd, uint8_t *data, uint32_t length) {
+  uint32_t done = 0;
+  ssize_t got;
+
+  while(done < length) {
+    got = read(fd, data + done, length - done);
+    if(got < 0 && errno == EINTR) continue;
+    if(got < 0) return -1;
+    if(got == 0) {
+      if(done == 0) return 0;
+      errno = EIO;
+      return -1;
+    }
+    done += got;
+  }
+  return length;
+}
+
+
+/* Opens a log file for reading. Returns 0 on success, or -1 if it cannot be read or is not a log file. */
+int i2c_log_reader_open(struct i2c_log_reader *reader, const char *path) {
+  struct i2c_log_header header;
+
+  memset(reader, 0, sizeof(struct i2c_log_reader));
+  if((reader->fd = open(path, O_RDONLY)) < 0) return -1;
+  if(read_fully(reader->fd, (uint8_t *)&header, sizeof(header)) != sizeof(header) || header.magic != I2C_LOG_MAGIC ||
+     header.version != I2C_LOG_VERSION || (header.value_bytes != 1 && header.value_bytes != 2)) {
+    close(reader->fd);
+    errno = EINVAL;
+    return -1;
+  }
+  reader->value_bytes = header.value_bytes;
+  reader->block_capacity = 65536;
+  reader->block = malloc(reader->block_capacity);
+  reader->data = malloc((size_t)I2C_LOG_BLOCK_RECORDS * I2C_LOG_MAX_COLUMNS * 2);
+  reader->scratch = malloc(I2C_LOG_BLOCK_RECORDS * sizeof(uint64_t));
+  if(!reader->block || !reader->data || !reader->scratch) {
+    i2c_log_reader_close(reader);
+    return -1;
+  }
+  return 0;
+}
+
+static int decode_block(struct i2c_log_reader *reader) {
+  struct i2c_log_block *block = (struct i2c_log_block *)reader->block;
+  struct i2c_log_column *column = (struct i2c_log_column *)(reader->block + sizeof(struct i2c_log_block));
+  uint32_t records = block->records, length = block->record_length, columns = block->columns;
+  uint32_t bytes = sizeof(struct i2c_log_block) + columns * sizeof(struct i2c_log_column);
+  uint8_t *in, *out;
+  uint32_t value, c, i;
+
+  if(records == 0 || records > I2C_LOG_BLOCK_RECORDS || columns > I2C_LOG_MAX_COLUMNS ||
+     columns != (length + reader->value_bytes - 1) / reader->value_bytes || bytes > block->bytes) goto invalid;
+  bytes += packed_bytes(records - 1, block->timestamp_width);
+  for(c = 0; c < columns && bytes <= block->bytes; c++) bytes += packed_bytes(records - 1, column[c].width);
+  if(bytes > block->bytes || block->timestamp_width > 64) goto invalid;
+
+  in = reader->block + sizeof(struct i2c_log_block) + columns * sizeof(struct i2c_log_column);
+  unpack(in, reader->scratch, records - 1, block->timestamp_width);
+  in += packed_bytes(records - 1, block->timestamp_width);
+  reader->timestamps[0] = block->first_timestamp_ns;
+  for(i = 1; i < records; i++) {
+    reader->timestamps[i] = reader->timestamps[i - 1] + block->min_delta_ns + reader->scratch[i - 1];
+  }
+
+  for(c = 0; c < columns; c++) {
+    if(column[c].width > 64) goto invalid;
+    unpack(in, reader->scratch, records - 1, column[c].width);
+    in += packed_bytes(records - 1, column[c].width);
+    value = column[c].first;
+    for(i = 0; i < records; i++) {
+      if(i) value += (uint32_t)unzigzag(reader->scratch[i - 1]);
+      out = reader->data + (size_t)i * length + c * reader->value_bytes;
+      if(reader->value_bytes == 1) {
+        out[0] = value;
+      } else {
+        out[0] = value >> 8;
+        if(c * 2 + 1 < length) out[1] = value & 0xff;
+      }
+    }
+  }
+  reader->records = records;
+  reader->record_length = length;
+  return records;
+
+ invalid:
+  errno = EINVAL;
+  return -1;
+}
+
+
+/*
+  Decodes the next block into reader->timestamps and reader->data (records of record_length bytes, exactly as they were
+  read from the bus). Returns the number of records, 0 at the end of the file, or -1 in case of an error or a damaged
+  (for example truncated) file.
+*/
+int i2c_log_reader_next(struct i2c_log_reader *reader) {
+  uint32_t header[2];
+  int result;
+
+  for(;;) {
+    result = read_fully(reader->fd, (uint8_t *)header, sizeof(header));
+    if(result <= 0) return result;
+    if(header[1] < sizeof(header) || header[1] % 8) {
+      errno = EINVAL;
+      return -1;
+    }
+    if(header[1] > reader->block_capacity) {
+      free(reader->block);
+      reader->block_capacity = header[1];
+      if(!(reader->block = malloc(reader->block_capacity))) return -1;
+    }
+    memcpy(reader->block, header, sizeof(header));
+    if(header[1] > sizeof(header) && read_fully(reader->fd, reader->block + sizeof(header),
+                                                 header[1] - sizeof(header)) != (int)(header[1] - sizeof(header))) {
+      errno = EIO;
+      return -1;
+    }
+    if(header[0] == I2C_LOG_PADDING_MAGIC) continue;
+    if(header[0] != I2C_LOG_BLOCK_MAGIC || header[1] < sizeof(struct i2c_log_block)) {
+      errno = EINVAL;
+      return -1;
+    }
+    return decode_block(reader);
+  }
+}
+
+void i2c_log_reader_close(struct i2c_log_reader *reader) {
+  close(reader->fd);
+  free(reader->block);
+  free(reader->data);
+  free(reader->scratch);
+  reader->block = reader->data = 0;
+  reader->scratch = 0;
+}
@@ -0,0 +1,130 @@
+/*
+  lsquaredc_log.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_LOG_H
+#define LSQUAREDC_LOG_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "lsquaredc_ring.h"
+
+#define I2C_LOG_MAGIC           0x4c43324c  /* "L2CL", file header */
+#define I2C_LOG_BLOCK_MAGIC     0x4b43324c  /* "L2CK", block of records */
+#define I2C_LOG_PADDING_MAGIC   0x5043324c  /* "L2CP", skipped by readers */
+#define I2C_LOG_VERSION         1
+#define I2C_LOG_BLOCK_RECORDS   1024        /* records per block at most */
+#define I2C_LOG_MAX_COLUMNS     64          /* values per record */
+#define I2C_LOG_BUFFER_SIZE     262144      /* written to the file in one go */
+#define I2C_LOG_BUFFERS         4
+#define I2C_LOG_OPEN_BLOCKS     16          /* record lengths collected at the same time */
+#define I2C_LOG_ALIGNMENT       4096        /* every write starts and ends at a multiple of this */
+
+/* The file format, see lsquaredc_log.c. All fields are in host byte order. */
+struct i2c_log_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t value_bytes;                 /* 1 or 2 (big-endian words) */
+  uint32_t reserved;
+};
+
+struct i2c_log_block {
+  uint32_t magic;
+  uint32_t bytes;                       /* of the whole block, header included, a multiple of 8 */
+  uint32_t records;
+  uint16_t record_length;               /* bytes */
+  uint8_t columns;
+  uint8_t timestamp_width;              /* bits per packed timestamp delta */
+  uint64_t first_timestamp_ns;
+  uint64_t min_delta_ns;                /* subtracted from every timestamp delta before packing */
+};
+
+struct i2c_log_column {
+  uint32_t first;                       /* value in the first record */
+  uint8_t width;                        /* bits per packed zigzag delta */
+  uint8_t reserved[3];
+};
+
+/* Records of one length being collected into a block. */
+struct i2c_log_open_block {
+  uint32_t records;
+  uint32_t record_length;
+  uint32_t columns;                     /* values has room for */
+  uint64_t *timestamps;                 /* I2C_LOG_BLOCK_RECORDS, allocated when the slot is first used */
+  uint32_t *values;                     /* columns of I2C_LOG_BLOCK_RECORDS */
+};
+
+/* Takes records from an acquisition ring and writes them to a file in compressed columnar blocks. */
+struct i2c_logger {
+  int fd;
+  struct i2c_ring *ring;
+  uint32_t value_bytes;
+  struct i2c_log_open_block open[I2C_LOG_OPEN_BLOCKS];
+  uint64_t *scratch;
+  uint8_t *buffers[I2C_LOG_BUFFERS];
+  uint32_t used[I2C_LOG_BUFFERS];
+  uint32_t filling;                     /* buffer the encoder is filling */
+  uint32_t writing;                     /* next buffer for the writer thread */
+  uint32_t queued;                      /* buffers handed to the writer thread and not written yet */
+  int stopping;
+  int error;                            /* errno of a failed write */
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint64_t logged;                      /* records */
+  uint64_t dropped;                     /* records too long to log */
+  uint64_t raw_bytes;                   /* record data and timestamps */
+  uint64_t encoded_bytes;
+  uint64_t writes;
+  uint64_t stalls;                      /* times the encoder waited for the writer thread */
+  uint64_t evictions;                   /* blocks closed early to make room for another record length */
+};
+
+/* Reads a file written by a logger, one block at a time. */
+struct i2c_log_reader {
+  int fd;
+  uint32_t value_bytes;
+  uint8_t *block;
+  uint32_t block_capacity;
+  uint32_t records;                     /* in the current block */
+  uint32_t record_length;
+  uint64_t timestamps[I2C_LOG_BLOCK_RECORDS];
+  uint8_t *data;                        /* records * record_length bytes, the records as they were read */
+  uint64_t *scratch;
+};
+
+int i2c_log_open(struct i2c_logger *logger, const char *path, struct i2c_ring *ring, uint32_t value_bytes);
+
+int i2c_log_drain(struct i2c_logger *logger);
+
+int i2c_log_flush(struct i2c_logger *logger);
+
+int i2c_log_close(struct i2c_logger *logger);
+
+int i2c_log_reader_open(struct i2c_log_reader *reader, const char *path);
+
+int i2c_log_reader_next(struct i2c_log_reader *reader);
+
+void i2c_log_reader_close(struct i2c_log_reader *reader);
+
+#endif
@@ -0,0 +1,622 @@
+/*
+  lsquaredc_loop.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include "lsquaredc.h"
+#include "lsquaredc_wheel.h"
+#include "lsquaredc_loop.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/*
+  Event loop for the engines that wait on several things at once: timers, GPIO line events, and notifications from
+  other threads (eventfds, see i2c_loop_add_notifier()). With epoll, every event costs a system call to wait, another to
+  read the event, and another to re-arm the timerfd when the earliest deadline changes. With io_uring, the loop keeps a
+  read queued on every fd, so the kernel delivers the event data itself, and a single io_uring_enter() per iteration
+  submits the reads for the next events and waits for completions with the time until the earliest timer as its
+  timeout. Timers are on a timer wheel (lsquaredc_wheel.c) and cost no system calls at all.
+
+  io_uring needs Linux 5.11 (for the wait timeout, IORING_FEAT_EXT_ARG). On older kernels, or when the environment
+  variable LSQUAREDC_LOOP is "epoll", I2C_LOOP_ANY falls back to epoll. Callbacks are run on the thread that runs the
+  loop, and may add, arm and remove sources (including their own).
+*/
+
+#define SOURCE_FD           0
+#define SOURCE_TIMER        1
+#define SOURCE_NOTIFIER     2
+
+#define TICK_NS             100000ULL
+#define URING_ENTRIES       256
+#define EPOLL_EVENTS        64
+#define POLL_REQUEST        1           /* low bit of the user_data of a poll request */
+
+#if defined(IORING_FEAT_EXT_ARG)
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#endif
+
+static int uring_enter(struct i2c_loop *loop, uint32_t submit, uint32_t wait, uint32_t flags, void *argument,
+                       size_t argument_size) {
+  loop->syscalls++;
+  return syscall(__NR_io_uring_enter, loop->fd, submit, wait, flags, argument, argument_size);
+}
+
+static int uring_setup(struct i2c_loop *loop) {
+  struct io_uring_params params;
+  uint8_t *sq, *cq;
+
+  memset(&params, 0, sizeof(params));
+  if((loop->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params)) < 0) return -1;
+  if(!(params.features & IORING_FEAT_EXT_ARG)) {
+    close(loop->fd);
+    errno = ENOSYS;
+    return -1;
+  }
+  loop->sq_entries = params.sq_entries;
+  loop->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  loop->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if(params.features & IORING_FEAT_SINGLE_MMAP) {
+    if(loop->cq_ring_size > loop->sq_ring_size) loop->sq_ring_size = loop->cq_ring_size;
+    loop->cq_ring_size = 0;
+  }
+  loop->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  loop->sq_ring = mmap(0, loop->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, loop->fd,
+                       IORING_OFF_SQ_RING);
+  loop->cq_ring = loop->cq_ring_size ? mmap(0, loop->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            loop->fd, IORING_OFF_CQ_RING) : loop->sq_ring;
+  loop->sqes = mmap(0, loop->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, loop->fd, IORING_OFF_SQES);
+  if(loop->sq_ring == MAP_FAILED || loop->cq_ring == MAP_FAILED || loop->sqes == MAP_FAILED) {
+    if(loop->sq_ring != MAP_FAILED) munmap(loop->sq_ring, loop->sq_ring_size);
+    if(loop->cq_ring_size && loop->cq_ring != MAP_FAILED) munmap(loop->cq_ring, loop->cq_ring_size);
+    if(loop->sqes != MAP_FAILED) munmap(loop->sqes, loop->sqes_size);
+    close(loop->fd);
+    return -1;
+  }
+  sq = loop->sq_ring;
+  cq = loop->cq_ring;
+  loop->sq_head = (uint32_t *)(sq + params.sq_off.head);
+  loop->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+  loop->sq_mask = (uint32_t *)(sq + params.sq_off.ring_mask);
+  loop->sq_array = (uint32_t *)(sq + params.sq_off.array);
+  loop->cq_head = (uint32_t *)(cq + params.cq_off.head);
+  loop->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+  loop->cq_mask = (uint32_t *)(cq + params.cq_off.ring_mask);
+  loop->cqes = cq + params.cq_off.cqes;
+  return 0;
+}
+
+/*
+  A cleared submission queue entry. It goes to the kernel with the next io_uring_enter(). If the queue is full, what is
+  in it is submitted first. Returns 0 if that fails (the kernel takes no new requests while its completion queue is
+  full, which can only happen with more sources than it has room for).
+*/
+static struct io_uring_sqe *uring_request(struct i2c_loop *loop, int opcode, int fd, uint64_t user_data) {
+  struct io_uring_sqe *sqe;
+  uint32_t tail, index;
+  int submitted;
+
+  while(loop->queued == loop->sq_entries) {
+    submitted = uring_enter(loop, loop->queued, 0, 0, 0, 0);
+    if(submitted < 0 && errno == EINTR) continue;
+    if(submitted <= 0) {
+      if(submitted == 0) errno = EBUSY;
+      return 0;
+    }
+    loop->queued = *loop->sq_tail - __atomic_load_n(loop->sq_head, __ATOMIC_ACQUIRE);
+  }
+  tail = *loop->sq_tail;
+  index = tail & *loop->sq_mask;
+  sqe = (struct io_uring_sqe *)loop->sqes + index;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = user_data;
+  loop->sq_array[index] = index;
+  __atomic_store_n(loop->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  loop->queued++;
+  return sqe;
+}
+
+static int uring_read(struct i2c_loop *loop, struct i2c_loop_source *source) {
+  struct io_uring_sqe *sqe = uring_request(loop, IORING_OP_READ, source->fd, (uintptr_t)source);
+
+  if(!sqe) return -1;
+  sqe->addr = (uintptr_t)source->buffer;
+  sqe->len = source->read_size;
+  sqe->off = (uint64_t)-1;
+  source->in_flight = 1;
+  source->polling = 0;
+  loop->outstanding++;
+  return 0;
+}
+
+static int uring_poll(struct i2c_loop *loop, struct i2c_loop_source *source) {
+  struct io_uring_sqe *sqe = uring_request(loop, IORING_OP_POLL_ADD, source->fd, (uintptr_t)source | POLL_REQUEST);
+
+  if(!sqe) return -1;
+  sqe->poll32_events = POLLIN;
+  source->in_flight = 1;
+  source->polling = 1;
+  loop->outstanding++;
+  return 0;
+}
+
+/* Cancels the request in flight, which the kernel finds by its user_data. */
+static int uring_cancel(struct i2c_loop *loop, struct i2c_loop_source *source) {
+  struct io_uring_sqe *sqe = uring_request(loop, IORING_OP_ASYNC_CANCEL, -1, 0);
+
+  if(!sqe) return -1;
+  sqe->addr = (uintptr_t)source | (source->polling ? POLL_REQUEST : 0);
+  return 0;
+}
+
+#else
+
+static int uring_setup(struct i2c_loop *loop) {
+  (void)loop;
+  errno = ENOSYS;
+  return -1;
+}
+
+static int uring_read(struct i2c_loop *loop, struct i2c_loop_source *source) {
+  (void)loop; (void)source;
+  errno = ENOSYS;
+  return -1;
+}
+
+static int uring_cancel(struct i2c_loop *loop, struct i2c_loop_source *source) {
+  (void)loop; (void)source;
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
+
+static void free_source(struct i2c_loop_source *source) {
+  if(source->type == SOURCE_NOTIFIER) close(source->fd);
+  free(source);
+}
+
+
+/*
+  Creates an event loop with the given backend: I2C_LOOP_URING, I2C_LOOP_EPOLL or I2C_LOOP_ANY. Returns the loop, or 0
+  in case of an error (errno is ENOSYS if io_uring was asked for and the kernel does not have what we need).
+*/
+struct i2c_loop *i2c_loop_create(int backend) {
+  struct i2c_loop *loop;
+  struct epoll_event event;
+  const char *forced = getenv("LSQUAREDC_LOOP");
+
+  if(!(loop = calloc(1, sizeof(struct i2c_loop)))) return 0;
+  loop->timer_fd = -1;
+  loop->timer_fd_ns = UINT64_MAX;
+  i2c_wheel_init(&loop->wheel, i2c_monotonic_ns(), TICK_NS);
+  if(backend == I2C_LOOP_ANY && !(forced && strcmp(forced, "epoll") == 0) && uring_setup(loop) == 0) {
+    loop->backend = I2C_LOOP_URING;
+    return loop;
+  }
+  if(backend == I2C_LOOP_URING) {
+    if(uring_setup(loop) == 0) {
+      loop->backend = I2C_LOOP_URING;
+      return loop;
+    }
+    free(loop);
+    return 0;
+  }
+
+  loop->backend = I2C_LOOP_EPOLL;
+  loop->fd = epoll_create1(EPOLL_CLOEXEC);
+  loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = 0;
+  if(loop->fd < 0 || loop->timer_fd < 0 || epoll_ctl(loop->fd, EPOLL_CTL_ADD, loop->timer_fd, &event) < 0) {
+    if(loop->fd >= 0) close(loop->fd);
+    if(loop->timer_fd >= 0) close(loop->timer_fd);
+    free(loop);
+    return 0;
+  }
+  return loop;
+}
+
+static struct i2c_loop_source *new_source(struct i2c_loop *loop, int type, int fd, i2c_loop_fn fn, void *user) {
+  struct i2c_loop_source *source = calloc(1, sizeof(struct i2c_loop_source));
+
+  if(!source) return 0;
+  source->type = type;
+  source->fd = fd;
+  source->fn = fn;
+  source->user = user;
+  source->next = loop->sources;
+  loop->sources = source;
+  return source;
+}
+
+static int watch(struct i2c_loop *loop, struct i2c_loop_source *source) {
+  struct epoll_event event;
+
+  if(loop->backend == I2C_LOOP_URING) return uring_read(loop, source);
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = source;
+  loop->syscalls++;
+  return epoll_ctl(loop->fd, EPOLL_CTL_ADD, source->fd, &event);
+}
+
+
+/*
+  Watches fd (a GPIO line event fd, an eventfd, a pipe...). Whenever it becomes readable, up to read_size bytes are
+  read and passed to fn. A call with no data means the fd reported an error or the end of file, and is no longer
+  watched. Returns the source, or 0 in case of an error.
+*/
+struct i2c_loop_source *i2c_loop_add_fd(struct i2c_loop *loop, int fd, uint32_t read_size, i2c_loop_fn fn,
+                                        void *user) {
+  struct i2c_loop_source *source;
+
+  if(read_size == 0 || read_size > I2C_LOOP_READ_SIZE) {
+    errno = EINVAL;
+    return 0;
+  }
+  if(!(source = new_source(loop, SOURCE_FD, fd, fn, user))) return 0;
+  source->read_size = read_size;
+  if(watch(loop, source) < 0) {
+    i2c_loop_remove(loop, source);
+    return 0;
+  }
+  return source;
+}
+
+/*
+  Arms (or re-arms) a timer to fire at expires_ns, and then every period_ns if that is not 0. An expires_ns of
+  UINT64_MAX disarms it.
+*/
+void i2c_loop_arm_timer(struct i2c_loop *loop, struct i2c_loop_source *source, uint64_t expires_ns,
+                        uint64_t period_ns) {
+  i2c_wheel_cancel(&loop->wheel, &source->timer);
+  source->expires_ns = expires_ns;
+  source->period_ns = period_ns;
+  if(expires_ns != UINT64_MAX) i2c_wheel_add(&loop->wheel, &source->timer, expires_ns);
+}
+
+/* Creates a timer that fires at expires_ns (i2c_monotonic_ns() time), and then every period_ns if that is not 0. */
+struct i2c_loop_source *i2c_loop_add_timer(struct i2c_loop *loop, uint64_t expires_ns, uint64_t period_ns,
+                                           i2c_loop_fn fn, void *user) {
+  struct i2c_loop_source *source = new_source(loop, SOURCE_TIMER, -1, fn, user);
+
+  if(source) i2c_loop_arm_timer(loop, source, expires_ns, period_ns);
+  return source;
+}
+
+
+/*
+  Creates a source that other threads can wake the loop with, through i2c_loop_notify(). fn gets the number of
+  notifications since the last call, as a uint64_t.
+*/
+struct i2c_loop_source *i2c_loop_add_notifier(struct i2c_loop *loop, i2c_loop_fn fn, void *user) {
+  /* io_uring reads a blocking eventfd without blocking us, and a non-blocking one would need a poll first */
+  int fd = eventfd(0, EFD_CLOEXEC | (loop->backend == I2C_LOOP_EPOLL ? EFD_NONBLOCK : 0));
+  struct i2c_loop_source *source;
+
+  if(fd < 0) return 0;
+  if(!(source = new_source(loop, SOURCE_NOTIFIER, fd, fn, user))) {
+    close(fd);
+    return 0;
+  }
+  source->read_size = sizeof(uint64_t);
+  if(watch(loop, source) < 0) {
+    i2c_loop_remove(loop, source);
+    return 0;
+  }
+  return source;
+}
+
+/* Wakes the loop up and makes it run the notifier's callback. Can be called from any thread. */
+int i2c_loop_notify(struct i2c_loop_source *source) {
+  uint64_t one = 1;
+  return (write(source->fd, &one, sizeof(one)) == sizeof(one)) ? 0 : -1;
+}
+
+
+/*
+  Stops watching a source and frees it. Safe from within callbacks, including the source's own. An fd given to
+  i2c_loop_add_fd() is not closed.
+*/
+void i2c_loop_remove(struct i2c_loop *loop, struct i2c_loop_source *source) {
+  struct i2c_loop_source **link;
+
+  for(link = &loop->sources; *link; link = &(*link)->next) {
+    if(*link == source) {
+      *link = source->next;
+      break;
+    }
+  }
+  if(source->type == SOURCE_TIMER) i2c_wheel_cancel(&loop->wheel, &source->timer);
+  if(source->type != SOURCE_TIMER && loop->backend == I2C_LOOP_EPOLL) {
+    loop->syscalls++;
+    epoll_ctl(loop->fd, EPOLL_CTL_DEL, source->fd, 0);
+  }
+  source->removed = 1;
+  if(source->in_flight) {
+    /*
+      freed when the request completes (cancelled, or with a result we throw away), or after the callback. If the
+      cancellation cannot be queued, that is when the fd next has data.
+    */
+    if(loop->backend == I2C_LOOP_URING) uring_cancel(loop, source);
+    return;
+  }
+  source->next = loop->removed;
+  loop->removed = source;
+}
+
+/*
+  Runs the callback of an fd source with the result of a read, and watches it again unless it is gone. If the next read
+  cannot be queued, the source gets an error call and is removed, like for a failed read.
+*/
+static int dispatch(struct i2c_loop *loop, struct i2c_loop_source *source, int result) {
+  source->in_flight = 1;                /* so that removing it from the callback defers the free */
+  if(result > 0) {
+    source->fn(source, source->buffer, result, source->user);
+  } else {
+    source->fn(source, 0, 0, source->user);
+  }
+  loop->events++;
+  source->in_flight = 0;
+  if(source->removed) {
+    free_source(source);
+    return 1;
+  }
+  if(result <= 0) {
+    i2c_loop_remove(loop, source);
+  } else if(loop->backend == I2C_LOOP_URING && uring_read(loop, source) < 0) {
+    return 1 + dispatch(loop, source, -errno);
+  }
+  return 1;
+}
+
+static int run_timers(struct i2c_loop *loop) {
+  struct i2c_timer *timer = i2c_wheel_advance(&loop->wheel, i2c_monotonic_ns());
+  struct i2c_loop_source *fire = 0, **tail = &fire, *source;
+  uint64_t now;
+  int executed = 0;
+
+  /* callbacks may re-arm timers, which relinks them: take the list apart first */
+  for(; timer; timer = timer->next) {
+    source = (struct i2c_loop_source *)((char *)timer - offsetof(struct i2c_loop_source, timer));
+    *tail = source;
+    tail = &source->fire_next;
+  }
+  *tail = 0;
+
+  for(source = fire; source; source = source->fire_next) {
+    if(source->removed) continue;
+    source->fn(source, 0, 0, source->user);
+    loop->events++;
+    executed++;
+    if(source->removed || source->timer.pprev || !source->period_ns) continue;
+    now = i2c_monotonic_ns();
+    source->expires_ns += source->period_ns;
+    /* if we fell behind, skip the missed periods rather than firing in a burst */
+    if(source->expires_ns < now) source->expires_ns += (now - source->expires_ns) / source->period_ns * source->period_ns;
+    i2c_wheel_add(&loop->wheel, &source->timer, source->expires_ns);
+  }
+  return executed;
+}
+
+static void free_removed(struct i2c_loop *loop) {
+  struct i2c_loop_source *source;
+
+  while((source = loop->removed)) {
+    loop->removed = source->next;
+    free_source(source);
+  }
+}
+
+#if defined(IORING_FEAT_EXT_ARG)
+
+/* Handles the completions that are there. */
+static int reap(struct i2c_loop *loop) {
+  struct i2c_loop_source *source;
+  struct io_uring_cqe cqe;
+  uint32_t head, tail;
+  int executed = 0;
+
+  head = *loop->cq_head;
+  tail = __atomic_load_n(loop->cq_tail, __ATOMIC_ACQUIRE);
+  while(head != tail) {
+    cqe = ((struct io_uring_cqe *)loop->cqes)[head & *loop->cq_mask];
+    __atomic_store_n(loop->cq_head, ++head, __ATOMIC_RELEASE);
+    source = (struct i2c_loop_source *)(uintptr_t)(cqe.user_data & ~(uint64_t)POLL_REQUEST);
+    if(!source) continue;               /* a cancellation */
+    source->in_flight = 0;
+    loop->outstanding--;
+    if(source->removed) {
+      free_source(source);
+    } else if(cqe.user_data & POLL_REQUEST || cqe.res == -EAGAIN || cqe.res == -EINTR) {
+      /* the fd was non-blocking: wait for it to become readable, then read */
+      if(((cqe.user_data & POLL_REQUEST) ? uring_read(loop, source) : uring_poll(loop, source)) < 0) {
+        executed += dispatch(loop, source, -errno);
+      }
+    } else {
+      executed += dispatch(loop, source, cqe.res);
+    }
+  }
+  return executed;
+}
+
+static int run_uring(struct i2c_loop *loop, uint64_t next_ns) {
+  struct io_uring_getevents_arg argument;
+  struct __kernel_timespec timeout;
+  uint64_t now;
+
+  memset(&argument, 0, sizeof(argument));
+  if(next_ns != UINT64_MAX) {
+    now = i2c_monotonic_ns();
+    next_ns = (next_ns > now) ? next_ns - now : 0;
+    timeout.tv_sec = next_ns / 1000000000ULL;
+    timeout.tv_nsec = next_ns % 1000000000ULL;
+    argument.ts = (uintptr_t)&timeout;
+  }
+  if(uring_enter(loop, loop->queued, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument,
+                 sizeof(argument)) < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) return -1;
+  loop->queued = *loop->sq_tail - __atomic_load_n(loop->sq_head, __ATOMIC_ACQUIRE);
+  return reap(loop);
+}
+
+/* Cancels all reads and polls and waits for them to complete. */
+static void drain_uring(struct i2c_loop *loop) {
+  struct i2c_loop_source *source;
+
+  while(loop->sources) {
+    source = loop->sources;
+    i2c_loop_remove(loop, source);
+  }
+  while(loop->outstanding) {
+    if(uring_enter(loop, loop->queued, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0 && errno != EINTR) break;
+    loop->queued = *loop->sq_tail - __atomic_load_n(loop->sq_head, __ATOMIC_ACQUIRE);
+    reap(loop);
+  }
+}
+
+#else
+
+static int run_uring(struct i2c_loop *loop, uint64_t next_ns) {
+  (void)loop; (void)next_ns;
+  errno = ENOSYS;
+  return -1;
+}
+
+static void drain_uring(struct i2c_loop *loop) {
+  (void)loop;
+}
+
+#endif
+
+static int run_epoll(struct i2c_loop *loop, uint64_t next_ns) {
+  struct epoll_event events[EPOLL_EVENTS];
+  struct itimerspec when;
+  struct i2c_loop_source *source;
+  uint64_t expirations;
+  ssize_t got;
+  int count, i;
+  int executed = 0;
+
+  if(next_ns != loop->timer_fd_ns) {
+    memset(&when, 0, sizeof(when));
+    if(next_ns != UINT64_MAX) {
+      /* 0 would disarm the timer */
+      when.it_value.tv_sec = next_ns / 1000000000ULL;
+      when.it_value.tv_nsec = next_ns % 1000000000ULL + (next_ns == 0);
+    }
+    loop->syscalls++;
+    if(timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &when, 0) < 0) return -1;
+    loop->timer_fd_ns = next_ns;
+  }
+
+  loop->syscalls++;
+  if((count = epoll_wait(loop->fd, events, EPOLL_EVENTS, -1)) < 0) return (errno == EINTR) ? 0 : -1;
+  for(i = 0; i < count; i++) {
+    source = events[i].data.ptr;
+    if(!source) {
+      loop->syscalls++;
+      if(read(loop->timer_fd, &expirations, sizeof(expirations)) > 0) loop->timer_fd_ns = UINT64_MAX;
+      continue;
+    }
+    if(source->removed) continue;       /* by an earlier callback of this batch */
+    loop->syscalls++;
+    got = read(source->fd, source->buffer, source->read_size);
+    if(got < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+    executed += dispatch(loop, source, (int)got);
+  }
+  return executed;
+}
+
+
+/*
+  Waits until the earliest timer is due or an fd source or notifier has something, and runs the callbacks of
+  everything that is ready. Returns the number of callbacks run, or -1 in case of an error.
+*/
+int i2c_loop_run_once(struct i2c_loop *loop) {
+  uint64_t next_ns = i2c_wheel_next_ns(&loop->wheel);
+  int executed;
+
+  loop->iterations++;
+  if(loop->backend == I2C_LOOP_URING) {
+    executed = run_uring(loop, next_ns);
+  } else {
+    executed = run_epoll(loop, next_ns);
+  }
+  if(executed >= 0) executed += run_timers(loop);
+  free_removed(loop);
+  return executed;
+}
+
+/* Runs the loop until i2c_loop_stop() is called (from a callback or a signal handler). */
+int i2c_loop_run(struct i2c_loop *loop) {
+  while(!loop->stop) {
+    if(i2c_loop_run_once(loop) < 0) return -1;
+  }
+  return 0;
+}
+
+void i2c_loop_stop(struct i2c_loop *loop) {
+  loop->stop = 1;
+}
+
+/* Frees the loop and all its sources. The fds given to i2c_loop_add_fd() are not closed. */
+void i2c_loop_destroy(struct i2c_loop *loop) {
+  struct i2c_loop_source *source;
+
+  /* the kernel must be done with the read buffers before they are freed */
+  if(loop->backend == I2C_LOOP_URING) drain_uring(loop);
+  close(loop->fd);
+  if(loop->timer_fd >= 0) close(loop->timer_fd);
+  if(loop->backend == I2C_LOOP_URING) {
+    munmap(loop->sq_ring, loop->sq_ring_size);
+    if(loop->cq_ring_size) munmap(loop->cq_ring, loop->cq_ring_size);
+    munmap(loop->sqes, loop->sqes_size);
+  }
+  while((source = loop->sources)) {
+    loop->sources = source->next;
+    free_source(source);
+  }
+  free_removed(loop);
+  free(loop);
+}
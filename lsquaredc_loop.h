@@ -0,0 +1,116 @@
+/*
+  lsquaredc_loop.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_LOOP_H
+#define LSQUAREDC_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lsquaredc_wheel.h"
+
+#define I2C_LOOP_ANY        0           /* io_uring if the kernel has it, epoll otherwise */
+#define I2C_LOOP_URING      1
+#define I2C_LOOP_EPOLL      2
+
+#define I2C_LOOP_READ_SIZE  64          /* largest read per event (a GPIO v2 line event is 48 bytes) */
+
+struct i2c_loop_source;
+
+/* Called with the data read from an fd source, the 8-byte count of a notifier, or nothing for a timer. */
+typedef void (*i2c_loop_fn)(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user);
+
+struct i2c_loop_source {
+  int fd;                               /* -1 for timers */
+  int type;
+  uint32_t read_size;
+  uint8_t buffer[I2C_LOOP_READ_SIZE];
+  int in_flight;                        /* io_uring: a read or poll is queued for this source */
+  int polling;                          /* io_uring: and it is a poll, not a read */
+  int removed;                          /* io_uring: freed when the cancelled request completes */
+  struct i2c_timer timer;
+  uint64_t expires_ns;
+  uint64_t period_ns;                   /* of a repeating timer, 0 for a one-shot one */
+  struct i2c_loop_source *fire_next;    /* expired timers being run */
+  i2c_loop_fn fn;
+  void *user;
+  struct i2c_loop_source *next;
+};
+
+struct i2c_loop {
+  int backend;
+  int fd;                               /* io_uring or epoll instance */
+  int timer_fd;                         /* epoll: wakes us up for the earliest timer */
+  uint64_t timer_fd_ns;                 /* epoll: what timer_fd is armed for, UINT64_MAX if disarmed */
+  void *sq_ring;                        /* io_uring mappings */
+  void *cq_ring;
+  void *sqes;
+  size_t sq_ring_size;
+  size_t cq_ring_size;
+  size_t sqes_size;
+  uint32_t *sq_head;
+  uint32_t *sq_tail;
+  uint32_t *sq_mask;
+  uint32_t *sq_array;
+  uint32_t *cq_head;
+  uint32_t *cq_tail;
+  uint32_t *cq_mask;
+  void *cqes;
+  uint32_t sq_entries;
+  uint32_t queued;                      /* prepared requests not submitted yet */
+  uint32_t outstanding;                 /* reads and polls the kernel has not completed */
+  struct i2c_wheel wheel;
+  struct i2c_loop_source *sources;
+  struct i2c_loop_source *removed;      /* freed at the end of the iteration */
+  int stop;
+  uint64_t iterations;
+  uint64_t syscalls;                    /* made by the loop itself (notifications excluded) */
+  uint64_t events;                      /* callbacks run */
+};
+
+struct i2c_loop *i2c_loop_create(int backend);
+
+struct i2c_loop_source *i2c_loop_add_fd(struct i2c_loop *loop, int fd, uint32_t read_size, i2c_loop_fn fn,
+                                        void *user);
+
+struct i2c_loop_source *i2c_loop_add_timer(struct i2c_loop *loop, uint64_t expires_ns, uint64_t period_ns,
+                                           i2c_loop_fn fn, void *user);
+
+void i2c_loop_arm_timer(struct i2c_loop *loop, struct i2c_loop_source *source, uint64_t expires_ns,
+                        uint64_t period_ns);
+
+struct i2c_loop_source *i2c_loop_add_notifier(struct i2c_loop *loop, i2c_loop_fn fn, void *user);
+
+int i2c_loop_notify(struct i2c_loop_source *source);
+
+void i2c_loop_remove(struct i2c_loop *loop, struct i2c_loop_source *source);
+
+int i2c_loop_run_once(struct i2c_loop *loop);
+
+int i2c_loop_run(struct i2c_loop *loop);
+
+void i2c_loop_stop(struct i2c_loop *loop);
+
+void i2c_loop_destroy(struct i2c_loop *loop);
+
+#endif
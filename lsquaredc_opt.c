@@ -0,0 +1,208 @@
+/*
+  lsquaredc_opt.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "lsquaredc.h"
+#include "lsquaredc_opt.h"
+
+/*
+  Rewrites a list of sequences (typically a device init table) into an equivalent, shorter list. Three things are done,
+  in this order:
+
+  1. Consecutive single-register writes to the same device, where each one writes the register following the last
+     register written by the previous one, are merged into one burst write. Only for devices with
+     I2C_HINT_AUTO_INCREMENT, as this relies on the register address auto-incrementing.
+  2. A register read that is an exact repeat of the sequence just before it is dropped, and its data is taken from the
+     first read. Only for devices with I2C_HINT_STABLE_READS: many status registers are cleared by reading them.
+  3. Consecutive sequences are packed into one ioctl by joining them with repeated starts, as long as the adapter can
+     do the result (see i2c_can_pack()) and every device involved is marked I2C_HINT_PACKABLE.
+
+  Every optimization has to be asked for per device, as each one breaks some devices.
+
+  The received data of the optimized list is laid out as if the sequences were executed in order into one buffer (which
+  is what i2c_send_sequences() does). read_map tells the caller where the data of every *input* sequence ends up.
+*/
+
+static uint8_t hint(const uint8_t *hints, uint16_t address) {
+  return hints ? hints[(address >> 1) & 0x7f] : 0;
+}
+
+/* A single-segment write of at least a register address and one data byte. */
+static int is_register_write(uint16_t *sequence, uint32_t sequence_length) {
+  return sequence_length >= 3 && !(sequence[0] & 1) && i2c_count_segments(sequence, sequence_length) == 1;
+}
+
+/* Reads that are only preceded by register address writes, so repeating the sequence has no effect on the device. */
+static int is_register_read(uint16_t *sequence, uint32_t sequence_length) {
+  uint32_t segment_start = 0;
+  uint32_t i;
+
+  if(i2c_count_reads(sequence, sequence_length) == 0) return 0;
+  for(i = 1; i <= sequence_length; i++) {
+    if(i == sequence_length || sequence[i] == I2C_RESTART) {
+      if(!(sequence[segment_start] & 1) && (i - segment_start) != 2) return 0;
+      segment_start = i + 1;
+    }
+  }
+  return 1;
+}
+
+/* Whether the devices of all segments of a sequence have the hint. */
+static int all_hinted(uint16_t *sequence, uint32_t sequence_length, const uint8_t *hints, uint8_t flag) {
+  uint32_t i;
+
+  if(!(hint(hints, sequence[0]) & flag)) return 0;
+  for(i = 1; i + 1 < sequence_length; i++) {
+    if(sequence[i] == I2C_RESTART && !(hint(hints, sequence[i + 1]) & flag)) return 0;
+  }
+  return 1;
+}
+
+static int append(struct i2c_sequence *item, uint16_t *elements, uint32_t count) {
+  uint16_t *grown = realloc(item->sequence, (item->sequence_length + count) * sizeof(uint16_t));
+
+  if(!grown) return -1;
+  memcpy(grown + item->sequence_length, elements, count * sizeof(uint16_t));
+  item->sequence = grown;
+  item->sequence_length += count;
+  return 0;
+}
+
+
+/*
+  Optimizes in_count input sequences. hints is an array of 128 I2C_HINT_* flag bytes indexed by the 7-bit device
+  address, or 0 for no hints (then the list is only copied). On success, *out is a newly allocated list (free it with
+  i2c_optimize_free()) and 0 is returned. If read_map is not 0, it must have room for in_count offsets; without it,
+  repeated reads are not collapsed, as there would be no way to find their data. limits are those of the adapter the
+  list will be sent on (see i2c_get_limits()), or 0 if they are not known.
+*/
+int i2c_optimize(struct i2c_sequence *in, uint32_t in_count, const uint8_t *hints, const struct i2c_limits *limits,
+                 struct i2c_sequence **out, uint32_t *out_count, uint32_t *read_map) {
+  struct i2c_sequence *merged = calloc(in_count ? in_count : 1, sizeof(struct i2c_sequence));
+  struct i2c_sequence *packed = 0;
+  uint32_t merged_count = 0;
+  uint32_t packed_count = 0;
+  uint32_t read_offset = 0;
+  uint32_t last_register = 0;   /* register following the last one written by the last merged item */
+  int last_is_write = 0;
+  int packable;
+  int group_packable = 0;
+  int group_reads = 0;
+  int cur_reads;
+  uint32_t segments = 0;
+  uint32_t cur_segments;
+  uint32_t i;
+  uint16_t restart = I2C_RESTART;
+  struct i2c_sequence *cur;
+
+  if(!merged) return -1;
+
+  /* passes 1 and 2 */
+  for(i = 0; i < in_count; i++) {
+    cur = &in[i];
+    if(cur->sequence_length < 2) goto i2c_optimize_error;
+
+    if(last_is_write && is_register_write(cur->sequence, cur->sequence_length) &&
+       merged[merged_count - 1].sequence[0] == cur->sequence[0] && cur->sequence[1] == last_register &&
+       (hint(hints, cur->sequence[0]) & I2C_HINT_AUTO_INCREMENT) &&
+       last_register + cur->sequence_length - 2 <= 0x100) {
+      if(append(&merged[merged_count - 1], cur->sequence + 2, cur->sequence_length - 2) < 0) goto i2c_optimize_error;
+      last_register += cur->sequence_length - 2;
+      if(read_map) read_map[i] = read_offset;
+      continue;
+    }
+
+    if(i > 0 && read_map && is_register_read(cur->sequence, cur->sequence_length) &&
+       all_hinted(cur->sequence, cur->sequence_length, hints, I2C_HINT_STABLE_READS) &&
+       in[i - 1].sequence_length == cur->sequence_length &&
+       memcmp(in[i - 1].sequence, cur->sequence, cur->sequence_length * sizeof(uint16_t)) == 0) {
+      read_map[i] = read_map[i - 1];
+      continue;
+    }
+
+    if(append(&merged[merged_count], cur->sequence, cur->sequence_length) < 0) goto i2c_optimize_error;
+    merged_count++;
+    last_is_write = is_register_write(cur->sequence, cur->sequence_length);
+    last_register = cur->sequence[1] + cur->sequence_length - 2;
+    if(read_map) read_map[i] = read_offset;
+    read_offset += i2c_count_reads(cur->sequence, cur->sequence_length);
+  }
+
+  /* pass 3 */
+  packed = calloc(merged_count ? merged_count : 1, sizeof(struct i2c_sequence));
+  if(!packed) goto i2c_optimize_error;
+  for(i = 0; i < merged_count; i++) {
+    cur = &merged[i];
+    packable = all_hinted(cur->sequence, cur->sequence_length, hints, I2C_HINT_PACKABLE);
+    cur_segments = i2c_count_segments(cur->sequence, cur->sequence_length);
+    cur_reads = i2c_count_reads(cur->sequence, cur->sequence_length) > 0;
+    if(packed_count > 0 && group_packable && packable && i2c_can_pack(limits, segments, group_reads, cur_segments)) {
+      if(append(&packed[packed_count - 1], &restart, 1) < 0 ||
+         append(&packed[packed_count - 1], cur->sequence, cur->sequence_length) < 0) goto i2c_optimize_error;
+      segments += cur_segments;
+      group_reads |= cur_reads;
+    } else {
+      packed[packed_count++] = *cur;
+      cur->sequence = 0;        /* ownership moved */
+      segments = cur_segments;
+      group_packable = packable;
+      group_reads = cur_reads;
+    }
+  }
+
+  i2c_optimize_free(merged, merged_count);
+  *out = packed;
+  *out_count = packed_count;
+  return 0;
+
+ i2c_optimize_error:
+  i2c_optimize_free(merged, in_count);
+  i2c_optimize_free(packed, packed_count);
+  return -1;
+}
+
+void i2c_optimize_free(struct i2c_sequence *sequences, uint32_t count) {
+  uint32_t i;
+
+  if(!sequences) return;
+  for(i = 0; i < count; i++) free(sequences[i].sequence);
+  free(sequences);
+}
+
+
+/*
+  Sends a list of sequences in order, with the data of all reads going one after another into received_data. Returns
+  the number of sequences sent successfully; stops at the first error.
+*/
+int i2c_send_sequences(int handle, struct i2c_sequence *sequences, uint32_t count, uint8_t *received_data) {
+  uint32_t i;
+
+  for(i = 0; i < count; i++) {
+    if(i2c_send_sequence(handle, sequences[i].sequence, sequences[i].sequence_length, received_data) < 0) break;
+    if(received_data) received_data += i2c_count_reads(sequences[i].sequence, sequences[i].sequence_length);
+  }
+  return (int)i;
+}
@@ -0,0 +1,50 @@
+/*
+  lsquaredc_opt.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_OPT_H
+#define LSQUAREDC_OPT_H
+
+#include <stdint.h>
+
+/* Per-device capability hints, indexed by the 7-bit address (the shifted address >> 1). A device with no hints gets
+   none of the optimizations. */
+#define I2C_HINT_AUTO_INCREMENT 1   /* consecutive register writes may be merged into one burst */
+#define I2C_HINT_PACKABLE       2   /* no STOP needed after a transaction (unlike e.g. EEPROM page writes) */
+#define I2C_HINT_STABLE_READS   4   /* reads have no side effects and an immediate repeat returns the same data */
+
+struct i2c_sequence {
+  uint16_t *sequence;
+  uint32_t sequence_length;
+};
+
+struct i2c_limits;
+
+int i2c_optimize(struct i2c_sequence *in, uint32_t in_count, const uint8_t *hints, const struct i2c_limits *limits,
+                 struct i2c_sequence **out, uint32_t *out_count, uint32_t *read_map);
+
+void i2c_optimize_free(struct i2c_sequence *sequences, uint32_t count);
+
+int i2c_send_sequences(int handle, struct i2c_sequence *sequences, uint32_t count, uint8_t *received_data);
+
+#endif
@@ -0,0 +1,514 @@
+/*
+  lsquaredc_poll.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <linux/gpio.h>
+#include <linux/i2c-dev.h>
+#include "lsquaredc.h"
+#include "lsquaredc_gpio.h"
+#include "lsquaredc_loop.h"
+#include "lsquaredc_poll.h"
+
+/*
+  A simple polling engine: every task is an I2C sequence that gets executed periodically. The received data is compared
+  with what was published last time and the publish callback is only called when something actually changed. Most
+  registers we poll rarely change, so this removes most of the downstream traffic.
+
+  The poll interval of every task adapts between min_interval_us and max_interval_us: a task whose data changed is
+  polled twice as often, a task whose data stayed the same is slowly backed off. Setting both to the same value gives a
+  fixed rate.
+
+  Periodic tasks are kept in a hierarchical timer wheel (see lsquaredc_wheel.c), so that scheduling stays cheap with
+  thousands of tasks: arming a task and expiring it are both O(1), and an idle poller sleeps until the next expiry
+  without looking at any tasks. The price is that deadlines are rounded up to the tick of the wheel.
+
+  To save wakeups (which matters on battery powered systems), a task can be given slack: permission to run somewhat
+  later than scheduled. The wheel uses it to put tasks whose windows overlap on the same tick, and then they all run in
+  a single wakeup. Tasks on the same bus that are marked packable also share a single ioctl, the transactions being
+  separated by repeated starts rather than STOP conditions, as far as the adapter allows (see i2c_get_limits()).
+
+  The poller waits in an event loop (lsquaredc_loop.c): the trigger lines of triggered tasks are fd sources of the
+  loop, and a timer of the loop wakes it up for the earliest periodic task. With io_uring, the edge events are read by
+  the kernel as part of the wait.
+*/
+
+#define DEFAULT_TICK_US 100
+#define TASK_OF(t) ((struct i2c_poll_task *)((char *)(t) - offsetof(struct i2c_poll_task, timer)))
+
+/* Run the periodic tasks that are due, and the triggered task of a line with edge events (see below). */
+static void wake_up(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user);
+static void edge_arrived(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user);
+
+/* Lines the wheels of the poller and its loop up, so that the wakeup lands on the tick of the earliest task. */
+static void init_wheels(struct i2c_poller *poller, uint64_t tick_ns) {
+  uint64_t now = i2c_monotonic_ns();
+
+  i2c_loop_arm_timer(poller->loop, poller->wakeup, UINT64_MAX, 0);
+  i2c_wheel_init(&poller->wheel, now, tick_ns);
+  i2c_wheel_init(&poller->loop->wheel, now, tick_ns);
+}
+
+struct i2c_poller *i2c_poll_create(void) {
+  struct i2c_poller *poller = calloc(1, sizeof(struct i2c_poller));
+
+  if(!poller) return 0;
+  if(!(poller->loop = i2c_loop_create(I2C_LOOP_ANY)) ||
+     !(poller->wakeup = i2c_loop_add_timer(poller->loop, UINT64_MAX, 0, wake_up, poller))) {
+    if(poller->loop) i2c_loop_destroy(poller->loop);
+    free(poller);
+    return 0;
+  }
+  init_wheels(poller, DEFAULT_TICK_US * 1000ULL);
+  return poller;
+}
+
+
+/*
+  Sets the scheduling granularity (100us by default). A coarser tick means fewer wakeups at the expense of timing
+  precision. Can only be changed while there are no periodic tasks. Returns 0 on success.
+*/
+int i2c_poll_set_tick(struct i2c_poller *poller, uint32_t tick_us) {
+  if(tick_us == 0 || poller->wheel.count) return -1;
+  init_wheels(poller, tick_us * 1000ULL);
+  return 0;
+}
+
+
+static struct i2c_poll_task *new_task(struct i2c_poller *poller, int handle, uint16_t *sequence,
+                                      uint32_t sequence_length, i2c_poll_publish_fn publish, void *user) {
+  struct i2c_poll_task *task;
+  uint32_t data_length;
+
+  if(sequence_length < 2) return 0;
+  data_length = i2c_count_reads(sequence, sequence_length);
+  if(data_length == 0) return 0;  /* nothing to compare or publish */
+
+  task = calloc(1, sizeof(struct i2c_poll_task));
+  if(!task) return 0;
+  task->current = malloc(data_length);
+  task->previous = malloc(data_length);
+  if(!task->current || !task->previous) {
+    free(task->current);
+    free(task->previous);
+    free(task);
+    return 0;
+  }
+  task->handle = handle;
+  task->sequence = sequence;
+  task->sequence_length = sequence_length;
+  task->data_length = data_length;
+  task->segments = i2c_count_segments(sequence, sequence_length);
+  task->trigger = -1;
+  task->poller = poller;
+  task->publish = publish;
+  task->user = user;
+
+  task->next = poller->tasks;
+  poller->tasks = task;
+  return task;
+}
+
+
+/*
+  Adds a sequence to be polled. The sequence is not copied, so it must stay valid for as long as the task exists. Returns
+  the task, or 0 in case of an error. The task is first polled immediately.
+*/
+struct i2c_poll_task *i2c_poll_add(struct i2c_poller *poller, int handle, uint16_t *sequence, uint32_t sequence_length,
+                                   uint32_t min_interval_us, uint32_t max_interval_us,
+                                   i2c_poll_publish_fn publish, void *user) {
+  struct i2c_poll_task *task;
+
+  if(min_interval_us == 0 || max_interval_us < min_interval_us) return 0;
+  task = new_task(poller, handle, sequence, sequence_length, publish, user);
+  if(!task) return 0;
+  task->min_interval_us = min_interval_us;
+  task->max_interval_us = max_interval_us;
+  task->interval_us = min_interval_us;
+  task->next_ns = i2c_monotonic_ns();
+  i2c_wheel_add(&poller->wheel, &task->timer, task->next_ns);
+  return task;
+}
+
+
+/*
+  Adds a sequence that is performed whenever an edge arrives on a GPIO line (see i2c_gpio_open_line()), typically a
+  data-ready interrupt. Instead of wasting the bus on polls that return "not ready", we only read when the device tells
+  us there is something to read. Every read is published (the device said the data is new), with the kernel timestamp
+  of the edge rather than the time we got around to reading.
+*/
+struct i2c_poll_task *i2c_poll_add_triggered(struct i2c_poller *poller, int line, int handle, uint16_t *sequence,
+                                             uint32_t sequence_length, i2c_poll_publish_fn publish, void *user) {
+  struct i2c_poll_task *task;
+
+  if(line < 0) return 0;
+  task = new_task(poller, handle, sequence, sequence_length, publish, user);
+  if(!task) return 0;
+  task->trigger = line;
+  task->publish_always = 1;
+  task->next_ns = UINT64_MAX;
+  task->source = i2c_loop_add_fd(poller->loop, line, sizeof(struct gpio_v2_line_event), edge_arrived, task);
+  if(!task->source) {
+    i2c_poll_remove(poller, task);
+    return 0;
+  }
+  return task;
+}
+
+
+/*
+  Sets per-field deadbands. Once fields are set, only the bytes covered by fields are compared (so that e.g. a status
+  byte in the middle of a burst read does not cause publishing). The fields are copied. Returns 0 on success.
+*/
+int i2c_poll_set_fields(struct i2c_poll_task *task, const struct i2c_poll_field *fields, uint32_t field_count) {
+  struct i2c_poll_field *copy = 0;
+  uint32_t i;
+
+  for(i = 0; i < field_count; i++) {
+    if(fields[i].width < 1 || fields[i].width > 2) return -1;
+    if(fields[i].offset + fields[i].width > task->data_length) return -1;
+  }
+  if(field_count) {
+    copy = malloc(field_count * sizeof(struct i2c_poll_field));
+    if(!copy) return -1;
+    memcpy(copy, fields, field_count * sizeof(struct i2c_poll_field));
+  }
+  free(task->fields);
+  task->fields = copy;
+  task->field_count = field_count;
+  return 0;
+}
+
+/* Allows the task to run up to slack_us later than scheduled, see above. Takes effect when the task is next scheduled. */
+void i2c_poll_set_slack(struct i2c_poll_task *task, uint32_t slack_us) {
+  task->slack_us = slack_us;
+}
+
+static void free_task(struct i2c_poll_task *task) {
+  free(task->fields);
+  free(task->current);
+  free(task->previous);
+  free(task);
+}
+
+
+/*
+  Removes a task and frees it. Publish callbacks may remove tasks, including their own: while the poller is running,
+  the task is only marked as removed (it is neither run nor published again) and freed at the end of the iteration, as
+  the poller may still be holding on to it.
+*/
+void i2c_poll_remove(struct i2c_poller *poller, struct i2c_poll_task *task) {
+  struct i2c_poll_task **link = &poller->tasks;
+
+  while(*link && *link != task) link = &(*link)->next;
+  if(!*link || task->removed) return;
+  if(task->source) i2c_loop_remove(poller->loop, task->source);
+  task->source = 0;
+  i2c_wheel_cancel(&poller->wheel, &task->timer);
+  if(poller->running) {
+    task->removed = 1;
+    return;
+  }
+  *link = task->next;
+  free_task(task);
+}
+
+static void free_removed(struct i2c_poller *poller) {
+  struct i2c_poll_task **link = &poller->tasks;
+  struct i2c_poll_task *task;
+
+  while((task = *link)) {
+    if(task->removed) {
+      *link = task->next;
+      free_task(task);
+    } else {
+      link = &task->next;
+    }
+  }
+}
+
+/* The value of a field in data (which the field must fit in). */
+int32_t i2c_poll_field_value(const struct i2c_poll_field *field, const uint8_t *data) {
+  const uint8_t *p = data + field->offset;
+  uint16_t raw;
+
+  if(field->width == 1) {
+    return (field->flags & I2C_FIELD_SIGNED) ? (int32_t)(int8_t)p[0] : (int32_t)p[0];
+  }
+  raw = (field->flags & I2C_FIELD_BIG_ENDIAN) ? (uint16_t)((p[0] << 8) | p[1]) : (uint16_t)((p[1] << 8) | p[0]);
+  return (field->flags & I2C_FIELD_SIGNED) ? (int32_t)(int16_t)raw : (int32_t)raw;
+}
+
+/* Without fields this is a plain memcmp(), so even large snapshots (FIFO dumps, full register maps) are cheap. */
+static int sample_changed(struct i2c_poll_task *task) {
+  uint32_t i;
+  int32_t delta;
+
+  if(!task->published) return 1;
+  if(task->field_count == 0) return memcmp(task->current, task->previous, task->data_length) != 0;
+
+  for(i = 0; i < task->field_count; i++) {
+    delta = i2c_poll_field_value(&task->fields[i], task->current) - i2c_poll_field_value(&task->fields[i], task->previous);
+    if(delta < 0) delta = -delta;
+    if(delta > task->fields[i].deadband) return 1;
+  }
+  return 0;
+}
+
+/* Changes speed polling up quickly, stability slows it down gradually (by 1/8 of the interval per poll). */
+static void adapt_interval(struct i2c_poll_task *task, int changed) {
+  uint32_t interval = task->interval_us;
+
+  if(changed) {
+    interval /= 2;
+  } else {
+    interval += interval / 8 + 1;
+  }
+  if(interval < task->min_interval_us) interval = task->min_interval_us;
+  if(interval > task->max_interval_us) interval = task->max_interval_us;
+  task->interval_us = interval;
+}
+
+/* Everything that happens after the transfer: change detection, publishing and scheduling the next poll. */
+static void finish_task(struct i2c_poller *poller, struct i2c_poll_task *task, uint64_t now, int failed) {
+  uint8_t *swap;
+  int changed;
+
+  task->polls++;
+  if(failed) {
+    task->errors++;
+    changed = 0;
+  } else {
+    changed = task->publish_always || sample_changed(task);
+    if(changed) {
+      /* the new sample becomes the reference for deadband comparisons */
+      swap = task->previous;
+      task->previous = task->current;
+      task->current = swap;
+      task->published = 1;
+      task->publishes++;
+      if(task->publish) task->publish(task, task->previous, task->data_length, now, task->user);
+    }
+  }
+  if(task->trigger >= 0 || task->removed) return;
+  adapt_interval(task, changed);
+
+  /* keep the schedule drift-free, but do not try to catch up on polls we missed */
+  task->next_ns += (uint64_t)task->interval_us * 1000;
+  if(task->next_ns <= now) task->next_ns = now + (uint64_t)task->interval_us * 1000;
+  i2c_wheel_add_slack(&poller->wheel, &task->timer, task->next_ns, (uint64_t)task->slack_us * 1000);
+}
+
+static void run_task(struct i2c_poller *poller, struct i2c_poll_task *task, uint64_t now) {
+  int result;
+
+  if(task->removed) return;     /* by the callback of a task that ran before it */
+  result = i2c_send_sequence(task->handle, task->sequence, task->sequence_length, task->current);
+  poller->transfers++;
+  finish_task(poller, task, now, result < 0);
+}
+
+static int grow_pack_buffers(struct i2c_poller *poller, uint32_t length, uint32_t data_length) {
+  uint16_t *sequence;
+  uint8_t *data;
+
+  if(length > poller->pack_capacity) {
+    sequence = realloc(poller->pack_sequence, length * sizeof(uint16_t));
+    if(!sequence) return -1;
+    poller->pack_sequence = sequence;
+    poller->pack_capacity = length;
+  }
+  if(data_length > poller->pack_data_capacity) {
+    data = realloc(poller->pack_data, data_length);
+    if(!data) return -1;
+    poller->pack_data = data;
+    poller->pack_data_capacity = data_length;
+  }
+  return 0;
+}
+
+
+/*
+  Runs tasks of one bus in a single ioctl. If the packed transfer fails we cannot tell which device is at fault, so the
+  tasks are then retried one by one.
+*/
+static void run_packed(struct i2c_poller *poller, struct i2c_poll_task **tasks, uint32_t count, uint64_t now) {
+  uint32_t length = 0, data_length = 0;
+  uint32_t i;
+
+  if(count == 1) {
+    run_task(poller, tasks[0], now);
+    return;
+  }
+  for(i = 0; i < count; i++) {
+    length += tasks[i]->sequence_length + 1;
+    data_length += tasks[i]->data_length;
+  }
+  if(grow_pack_buffers(poller, length, data_length) < 0) {
+    for(i = 0; i < count; i++) run_task(poller, tasks[i], now);
+    return;
+  }
+
+  length = 0;
+  for(i = 0; i < count; i++) {
+    if(i > 0) poller->pack_sequence[length++] = I2C_RESTART;
+    memcpy(poller->pack_sequence + length, tasks[i]->sequence, tasks[i]->sequence_length * sizeof(uint16_t));
+    length += tasks[i]->sequence_length;
+  }
+  poller->transfers++;
+  if(i2c_send_sequence(tasks[0]->handle, poller->pack_sequence, length, poller->pack_data) < 0) {
+    for(i = 0; i < count; i++) run_task(poller, tasks[i], now);
+    return;
+  }
+
+  data_length = 0;
+  for(i = 0; i < count; i++) {
+    if(!tasks[i]->removed) {
+      memcpy(tasks[i]->current, poller->pack_data + data_length, tasks[i]->data_length);
+      finish_task(poller, tasks[i], now, 0);
+    }
+    data_length += tasks[i]->data_length;
+  }
+}
+
+/* Runs the expired tasks of one bus (taking them out of the expired list): packable ones together, the rest alone. */
+static int run_bus(struct i2c_poller *poller, struct i2c_timer **expired, int handle, uint64_t now) {
+  struct i2c_poll_task *packed[I2C_RDRW_IOCTL_MAX_MSGS];
+  struct i2c_poll_task *task;
+  struct i2c_timer **link = expired;
+  struct i2c_timer *timer;
+  struct i2c_limits limits;
+  const struct i2c_limits *known = (i2c_get_limits(handle, &limits) == 0) ? &limits : 0;
+  uint32_t count = 0, segments = 0;
+  int executed = 0, has_read = 0;
+
+  while((timer = *link)) {
+    task = TASK_OF(timer);
+    if(task->handle != handle) {
+      link = &timer->next;
+      continue;
+    }
+    *link = timer->next;        /* before the timer gets re-armed */
+    if(task->removed) continue;
+    executed++;
+    if(!task->packable || !i2c_can_pack(known, 0, 0, task->segments)) {
+      run_task(poller, task, now);
+      continue;
+    }
+    if(count && !i2c_can_pack(known, segments, has_read, task->segments)) {
+      run_packed(poller, packed, count, now);
+      count = segments = 0;
+      has_read = 0;
+    }
+    packed[count++] = task;
+    segments += task->segments;
+    if(task->data_length) has_read = 1;
+  }
+  if(count) run_packed(poller, packed, count, now);
+  return executed;
+}
+
+/* Runs a triggered task for the edge events read by the loop, and any that came in since. */
+static void edge_arrived(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user) {
+  struct i2c_poll_task *task = user;
+  struct gpio_v2_line_event event;
+  uint64_t timestamp;
+  int events;
+
+  (void)source;
+  if(!data) {
+    /* the loop no longer watches the line */
+    task->source = 0;
+    task->errors++;
+    return;
+  }
+  if(task->removed || length < sizeof(event)) return;
+  memcpy(&event, data + length - sizeof(event), sizeof(event));
+  timestamp = event.timestamp_ns;
+  task->events += length / sizeof(event);
+  events = i2c_gpio_read_events(task->trigger, &timestamp);
+  if(events > 0) task->events += events;
+  run_task(task->poller, task, timestamp);
+  task->poller->executed++;
+}
+
+static void wake_up(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user) {
+  struct i2c_poller *poller = user;
+  struct i2c_timer *expired;
+  uint64_t now = i2c_monotonic_ns();
+
+  (void)source; (void)data; (void)length;
+  expired = i2c_wheel_advance(&poller->wheel, now);
+  while(expired) poller->executed += run_bus(poller, &expired, TASK_OF(expired)->handle, now);
+}
+
+
+/*
+  Waits until the earliest periodic task is due or an edge arrives on one of the trigger lines, then runs all triggered
+  and due tasks. Due tasks are run grouped by bus, so that transactions on one adapter go out back to back (or in one
+  ioctl, see above). Returns the number of tasks that were run, or -1 if there are no tasks.
+*/
+int i2c_poll_run_once(struct i2c_poller *poller) {
+  int result;
+
+  if(!poller->tasks) return -1;
+  i2c_loop_arm_timer(poller->loop, poller->wakeup, i2c_wheel_next_ns(&poller->wheel), 0);
+  poller->executed = 0;
+  poller->running = 1;
+  result = i2c_loop_run_once(poller->loop);
+  poller->running = 0;
+  free_removed(poller);
+  if(result < 0) return -1;
+  poller->wakeups++;
+  return poller->executed;
+}
+
+/* Runs the poller until i2c_poll_stop() is called (from a callback or a signal handler). */
+int i2c_poll_run(struct i2c_poller *poller) {
+  while(!poller->stop) {
+    if(i2c_poll_run_once(poller) < 0) return -1;
+  }
+  return 0;
+}
+
+void i2c_poll_stop(struct i2c_poller *poller) {
+  poller->stop = 1;
+}
+
+void i2c_poll_destroy(struct i2c_poller *poller) {
+  struct i2c_poll_task *task;
+
+  if(!poller) return;
+  while((task = poller->tasks)) {
+    poller->tasks = task->next;
+    free_task(task);
+  }
+  i2c_loop_destroy(poller->loop);
+  free(poller->pack_sequence);
+  free(poller->pack_data);
+  free(poller);
+}
@@ -0,0 +1,130 @@
+/*
+  lsquaredc_poll.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_POLL_H
+#define LSQUAREDC_POLL_H
+
+#include <stdint.h>
+#include "lsquaredc_wheel.h"
+
+/* Field flags, see struct i2c_poll_field. */
+#define I2C_FIELD_BIG_ENDIAN    1   /* multi-byte field is stored MSB first (most I2C devices) */
+#define I2C_FIELD_SIGNED        2   /* field is two's complement */
+
+/*
+  Describes one value inside the received_data buffer of a polled sequence. width is 1 or 2 bytes. A change smaller than
+  or equal to deadband (compared with the last *published* value) is not considered a change.
+*/
+struct i2c_poll_field {
+  uint32_t offset;
+  uint8_t width;
+  uint8_t flags;
+  uint16_t deadband;
+};
+
+struct i2c_poll_task;
+
+/* Called with the received data whenever it differs from what was published last time (or always, see below). */
+typedef void (*i2c_poll_publish_fn)(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length,
+                                    uint64_t timestamp_ns, void *user);
+
+struct i2c_poll_task {
+  int handle;
+  uint16_t *sequence;
+  uint32_t sequence_length;
+  uint32_t data_length;                 /* number of I2C_READ elements in sequence */
+  uint8_t *current;                     /* newest sample */
+  uint8_t *previous;                    /* last published sample */
+  struct i2c_poll_field *fields;        /* optional, 0 means "compare every byte exactly" */
+  uint32_t field_count;
+  uint32_t min_interval_us;
+  uint32_t max_interval_us;
+  uint32_t interval_us;                 /* current, adapted between min and max */
+  uint32_t slack_us;                    /* may run this much later than scheduled, to share a wakeup */
+  uint64_t next_ns;                     /* UINT64_MAX for triggered tasks */
+  struct i2c_timer timer;               /* fires at next_ns */
+  int trigger;                          /* GPIO line fd, or -1 for periodic tasks */
+  int publish_always;                   /* publish every sample, changed or not */
+  int packable;                         /* may share one ioctl (no STOP in between) with other tasks on the bus */
+  uint32_t segments;                    /* number of I2C messages of sequence */
+  int published;
+  i2c_poll_publish_fn publish;
+  void *user;
+  uint32_t polls;
+  uint32_t publishes;
+  uint32_t errors;
+  uint32_t events;                      /* edge events seen by a triggered task */
+  int removed;                          /* removed while the poller was running, freed when it is done */
+  struct i2c_loop_source *source;       /* watches the trigger line */
+  struct i2c_poller *poller;
+  struct i2c_poll_task *next;
+};
+
+struct i2c_loop;
+struct i2c_loop_source;
+
+struct i2c_poller {
+  struct i2c_poll_task *tasks;
+  struct i2c_loop *loop;                /* waits for the trigger lines and the wakeup */
+  struct i2c_loop_source *wakeup;       /* timer for the earliest periodic task */
+  struct i2c_wheel wheel;               /* periodic tasks */
+  uint16_t *pack_sequence;              /* packed sequence of tasks that run together */
+  uint8_t *pack_data;
+  uint32_t pack_capacity;
+  uint32_t pack_data_capacity;
+  uint32_t wakeups;
+  uint32_t transfers;                   /* ioctls issued for tasks */
+  int running;                          /* in i2c_poll_run_once(), see i2c_poll_remove() */
+  int executed;                         /* tasks run by the current iteration */
+  volatile int stop;
+};
+
+struct i2c_poller *i2c_poll_create(void);
+
+int i2c_poll_set_tick(struct i2c_poller *poller, uint32_t tick_us);
+
+struct i2c_poll_task *i2c_poll_add(struct i2c_poller *poller, int handle, uint16_t *sequence, uint32_t sequence_length,
+                                   uint32_t min_interval_us, uint32_t max_interval_us,
+                                   i2c_poll_publish_fn publish, void *user);
+
+struct i2c_poll_task *i2c_poll_add_triggered(struct i2c_poller *poller, int line, int handle, uint16_t *sequence,
+                                             uint32_t sequence_length, i2c_poll_publish_fn publish, void *user);
+
+int i2c_poll_set_fields(struct i2c_poll_task *task, const struct i2c_poll_field *fields, uint32_t field_count);
+
+void i2c_poll_set_slack(struct i2c_poll_task *task, uint32_t slack_us);
+
+int32_t i2c_poll_field_value(const struct i2c_poll_field *field, const uint8_t *data);
+
+void i2c_poll_remove(struct i2c_poller *poller, struct i2c_poll_task *task);
+
+int i2c_poll_run_once(struct i2c_poller *poller);
+
+int i2c_poll_run(struct i2c_poller *poller);
+
+void i2c_poll_stop(struct i2c_poller *poller);
+
+void i2c_poll_destroy(struct i2c_poller *poller);
+
+#endif
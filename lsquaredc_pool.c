@@ -0,0 +1,370 @@
+/*
+  lsquaredc_pool.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lsquaredc_poll.h"
+#include "lsquaredc_pool.h"
+
+/*
+  Compute pool for decoding and post-processing, so that the thread that drives a bus does nothing but transfers. While
+  it decodes, checks CRCs or filters, the bus sits idle; with the pool, it copies the received data into a pool buffer,
+  pushes the buffer to its queue and starts the next transfer.
+
+  Every thread that submits work owns a queue (i2c_pool_add_queue()), and so does every worker. A queue is a
+  Chase-Lev work-stealing deque: the owner pushes at the bottom without any locking, and idle workers steal from the top
+  with a single compare-and-swap, so a bus thread never waits for a worker. Jobs submitted from within a job (say,
+  decoding followed by a heavier analysis) go to the worker's own queue, which it pops from the bottom, the cache-warm
+  end. Workers with nothing to do sleep on a condition variable, and submitters only make a system call to wake one up
+  when some are actually sleeping.
+
+  Buffers come from a fixed set, allocated once, and are recycled through a lock-free free list (a stack whose head
+  carries a tag against the ABA problem). When all buffers are in use or a queue is full, the caller decides what to do;
+  i2c_pool_attach() then runs the job on the bus thread rather than dropping the sample.
+
+  Jobs of the same source can run in parallel on different workers and finish out of order. Work that depends on the
+  previous samples (a filter, for example) has to put them back in order by timestamp first.
+*/
+
+#define FREE_INDEX(head) ((uint32_t)(head))
+#define FREE_TAG(head) ((head) >> 32)
+
+/* Owner side: adds a job at the bottom. Returns -1 if the queue is full. */
+static int push(struct i2c_pool_queue *queue, struct i2c_pool_buffer *buffer) {
+  uint32_t bottom = atomic_load_explicit(&queue->bottom, memory_order_relaxed);
+  uint32_t top = atomic_load_explicit(&queue->top, memory_order_acquire);
+
+  if(bottom - top >= I2C_POOL_QUEUE_SIZE) return -1;
+  atomic_store_explicit(&queue->slots[bottom & (I2C_POOL_QUEUE_SIZE - 1)], buffer, memory_order_relaxed);
+  atomic_store_explicit(&queue->bottom, bottom + 1, memory_order_release);
+  return 0;
+}
+
+/* Owner side: takes the newest job. */
+static struct i2c_pool_buffer *pop(struct i2c_pool_queue *queue) {
+  uint32_t bottom = atomic_load_explicit(&queue->bottom, memory_order_relaxed) - 1;
+  struct i2c_pool_buffer *buffer = 0;
+  uint32_t top;
+
+  atomic_store_explicit(&queue->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  top = atomic_load_explicit(&queue->top, memory_order_relaxed);
+  if((int32_t)(bottom - top) >= 0) {
+    buffer = atomic_load_explicit(&queue->slots[bottom & (I2C_POOL_QUEUE_SIZE - 1)], memory_order_relaxed);
+    if(bottom != top) return buffer;
+    /* the last job: race the thieves for it */
+    if(!atomic_compare_exchange_strong_explicit(&queue->top, &top, top + 1, memory_order_seq_cst,
+                                                memory_order_relaxed)) buffer = 0;
+  }
+  atomic_store_explicit(&queue->bottom, bottom + 1, memory_order_relaxed);
+  return buffer;
+}
+
+/* Any thread: takes the oldest job. Returns 0 if the queue is empty or another thief was faster. */
+static struct i2c_pool_buffer *steal(struct i2c_pool_queue *queue) {
+  uint32_t top = atomic_load_explicit(&queue->top, memory_order_acquire);
+  struct i2c_pool_buffer *buffer;
+  uint32_t bottom;
+
+  atomic_thread_fence(memory_order_seq_cst);
+  bottom = atomic_load_explicit(&queue->bottom, memory_order_acquire);
+  if((int32_t)(bottom - top) <= 0) return 0;
+  buffer = atomic_load_explicit(&queue->slots[top & (I2C_POOL_QUEUE_SIZE - 1)], memory_order_relaxed);
+  if(!atomic_compare_exchange_strong_explicit(&queue->top, &top, top + 1, memory_order_seq_cst,
+                                              memory_order_relaxed)) return 0;
+  return buffer;
+}
+
+static int queue_empty(struct i2c_pool_queue *queue) {
+  return (int32_t)(atomic_load_explicit(&queue->bottom, memory_order_acquire) -
+                   atomic_load_explicit(&queue->top, memory_order_acquire)) <= 0;
+}
+
+static int work_available(struct i2c_pool *pool) {
+  uint32_t count = atomic_load_explicit(&pool->queue_count, memory_order_acquire);
+  uint32_t i;
+
+  for(i = 0; i < count; i++) {
+    if(!queue_empty(pool->queues[i])) return 1;
+  }
+  return 0;
+}
+
+static void run_job(struct i2c_pool *pool, struct i2c_pool_buffer *buffer) {
+  buffer->fn(buffer, buffer->user);
+  atomic_fetch_add_explicit(&pool->executed, 1, memory_order_relaxed);
+  i2c_pool_put(pool, buffer);
+}
+
+static uint32_t worker_index(struct i2c_pool *pool) {
+  pthread_t self = pthread_self();
+  uint32_t i;
+
+  for(i = 0; i < pool->worker_count; i++) {
+    if(pthread_equal(pool->workers[i], self)) return i;
+  }
+  return UINT32_MAX;
+}
+
+static void *worker_thread(void *argument) {
+  struct i2c_pool *pool = argument;
+  struct i2c_pool_buffer *buffer;
+  struct i2c_pool_queue *own;
+  uint32_t count, i, random, index;
+
+  /* pthread_create() may not have stored our id yet */
+  pthread_mutex_lock(&pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+  index = worker_index(pool);
+  own = pool->queues[index];
+  random = index * 2654435761u + 1;
+
+  for(;;) {
+    if((buffer = pop(own))) {
+      run_job(pool, buffer);
+      continue;
+    }
+    /* visit the other queues starting at a random one, so that thieves spread out */
+    count = atomic_load_explicit(&pool->queue_count, memory_order_acquire);
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    for(i = 0; i < count && !buffer; i++) buffer = steal(pool->queues[(random + i) % count]);
+    if(buffer) {
+      atomic_fetch_add_explicit(&pool->stolen, 1, memory_order_relaxed);
+      run_job(pool, buffer);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_fetch_add_explicit(&pool->sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    while(!work_available(pool) && !pool->stopping) pthread_cond_wait(&pool->wake, &pool->lock);
+    atomic_fetch_sub_explicit(&pool->sleeping, 1, memory_order_relaxed);
+    if(pool->stopping && !work_available(pool)) {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return 0;
+}
+
+static struct i2c_pool_queue *new_queue(struct i2c_pool *pool) {
+  struct i2c_pool_queue *queue;
+  uint32_t count = atomic_load_explicit(&pool->queue_count, memory_order_relaxed);
+
+  if(count == I2C_POOL_MAX_QUEUES) {
+    errno = ENOSPC;
+    return 0;
+  }
+  if(posix_memalign((void **)&queue, 64, sizeof(struct i2c_pool_queue))) return 0;
+  memset(queue, 0, sizeof(struct i2c_pool_queue));
+  pool->queues[count] = queue;
+  atomic_store_explicit(&pool->queue_count, count + 1, memory_order_release);
+  return queue;
+}
+
+
+/*
+  Creates a pool of worker threads and buffer_count buffers of buffer_size bytes. Returns the pool, or 0 in case of an
+  error.
+*/
+struct i2c_pool *i2c_pool_create(uint32_t workers, uint32_t buffer_count, uint32_t buffer_size) {
+  struct i2c_pool *pool;
+  uint32_t i;
+
+  if(workers == 0 || workers > I2C_POOL_MAX_WORKERS || buffer_count == 0) {
+    errno = EINVAL;
+    return 0;
+  }
+  if(!(pool = calloc(1, sizeof(struct i2c_pool)))) return 0;
+  buffer_size = (buffer_size + 63) & ~63u;
+  pool->buffers = calloc(buffer_count, sizeof(struct i2c_pool_buffer));
+  if(posix_memalign((void **)&pool->memory, 64, (size_t)buffer_count * buffer_size)) pool->memory = 0;
+  if(!pool->buffers || !pool->memory) {
+    free(pool->buffers);
+    free(pool->memory);
+    free(pool);
+    return 0;
+  }
+  pool->buffer_count = buffer_count;
+  for(i = 0; i < buffer_count; i++) {
+    pool->buffers[i].index = i;
+    pool->buffers[i].capacity = buffer_size;
+    pool->buffers[i].data = pool->memory + (size_t)i * buffer_size;
+    atomic_init(&pool->buffers[i].next, (i + 1 < buffer_count) ? i + 2 : 0);
+  }
+  atomic_init(&pool->free_list, 1);
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->wake, 0);
+
+  for(i = 0; i < workers; i++) {
+    if(!new_queue(pool)) break;
+  }
+  pthread_mutex_lock(&pool->lock);
+  for(; pool->worker_count < i; pool->worker_count++) {
+    if(pthread_create(&pool->workers[pool->worker_count], 0, worker_thread, pool)) break;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  if(pool->worker_count < workers) {
+    i2c_pool_destroy(pool);
+    return 0;
+  }
+  return pool;
+}
+
+/* Creates a queue for a thread that submits jobs, a bus thread typically. Only that thread may submit to it. */
+struct i2c_pool_queue *i2c_pool_add_queue(struct i2c_pool *pool) {
+  struct i2c_pool_queue *queue;
+
+  pthread_mutex_lock(&pool->lock);
+  queue = new_queue(pool);
+  pthread_mutex_unlock(&pool->lock);
+  return queue;
+}
+
+/* Within a job: the queue of the worker running it, for submitting follow-up jobs. 0 on other threads. */
+struct i2c_pool_queue *i2c_pool_current_queue(struct i2c_pool *pool) {
+  uint32_t index = worker_index(pool);
+  return (index == UINT32_MAX) ? 0 : pool->queues[index];
+}
+
+
+/* Takes a free buffer. Returns 0 if all buffers are in use. Never blocks. */
+struct i2c_pool_buffer *i2c_pool_get(struct i2c_pool *pool) {
+  uint64_t head = atomic_load_explicit(&pool->free_list, memory_order_acquire);
+  struct i2c_pool_buffer *buffer;
+  uint64_t next;
+
+  do {
+    if(FREE_INDEX(head) == 0) {
+      atomic_fetch_add_explicit(&pool->shortages, 1, memory_order_relaxed);
+      return 0;
+    }
+    buffer = &pool->buffers[FREE_INDEX(head) - 1];
+    next = ((FREE_TAG(head) + 1) << 32) | atomic_load_explicit(&buffer->next, memory_order_relaxed);
+  } while(!atomic_compare_exchange_weak_explicit(&pool->free_list, &head, next, memory_order_acquire,
+                                                 memory_order_acquire));
+  buffer->length = 0;
+  return buffer;
+}
+
+/* Returns a buffer that was not submitted (submitted buffers are returned after their job has run). */
+void i2c_pool_put(struct i2c_pool *pool, struct i2c_pool_buffer *buffer) {
+  uint64_t head = atomic_load_explicit(&pool->free_list, memory_order_relaxed);
+  uint64_t next;
+
+  do {
+    atomic_store_explicit(&buffer->next, FREE_INDEX(head), memory_order_relaxed);
+    next = ((FREE_TAG(head) + 1) << 32) | (buffer->index + 1);
+  } while(!atomic_compare_exchange_weak_explicit(&pool->free_list, &head, next, memory_order_release,
+                                                 memory_order_relaxed));
+}
+
+
+/*
+  Queues fn to be run on buffer by a worker. queue must be owned by the calling thread (see i2c_pool_add_queue() and
+  i2c_pool_current_queue()). Returns 0, or -1 with errno set to EAGAIN if the queue is full, in which case the buffer is
+  still the caller's.
+*/
+int i2c_pool_submit(struct i2c_pool *pool, struct i2c_pool_queue *queue, struct i2c_pool_buffer *buffer,
+                    i2c_pool_fn fn, void *user) {
+  buffer->fn = fn;
+  buffer->user = user;
+  if(push(queue, buffer) < 0) {
+    errno = EAGAIN;
+    return -1;
+  }
+  atomic_fetch_add_explicit(&pool->submitted, 1, memory_order_relaxed);
+  /* pairs with the increment in worker_thread(): either we see the sleeper, or it sees the job */
+  atomic_thread_fence(memory_order_seq_cst);
+  if(atomic_load_explicit(&pool->sleeping, memory_order_relaxed)) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return 0;
+}
+
+static void sample_published(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length, uint64_t timestamp_ns,
+                             void *user) {
+  struct i2c_pool_source *source = user;
+  struct i2c_pool_buffer *buffer;
+  struct i2c_pool_buffer local;
+
+  (void)task;
+  buffer = i2c_pool_get(source->pool);
+  if(buffer && buffer->capacity >= data_length) {
+    memcpy(buffer->data, data, data_length);
+    buffer->length = data_length;
+    buffer->timestamp_ns = timestamp_ns;
+    if(i2c_pool_submit(source->pool, source->queue, buffer, source->fn, source->user) == 0) {
+      source->offloaded++;
+      return;
+    }
+  }
+  if(buffer) i2c_pool_put(source->pool, buffer);
+
+  memset(&local, 0, sizeof(local));
+  local.length = local.capacity = data_length;
+  local.timestamp_ns = timestamp_ns;
+  local.data = data;
+  source->inline_runs++;
+  source->fn(&local, source->user);
+}
+
+
+/*
+  Hands every published sample of a poller task to the pool: the data is copied into a pool buffer and
+  source->fn is run on it by a worker. source->queue must belong to the thread that runs the poller. If no buffer or no
+  room in the queue is available, fn is run right away on the poller thread instead.
+*/
+void i2c_pool_attach(struct i2c_pool_source *source, struct i2c_poll_task *task) {
+  task->publish = sample_published;
+  task->user = source;
+}
+
+/* Waits until all submitted jobs have run, stops the workers and frees the pool. */
+void i2c_pool_destroy(struct i2c_pool *pool) {
+  uint32_t i, count;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for(i = 0; i < pool->worker_count; i++) pthread_join(pool->workers[i], 0);
+
+  count = atomic_load_explicit(&pool->queue_count, memory_order_relaxed);
+  for(i = 0; i < count; i++) free(pool->queues[i]);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  free(pool->buffers);
+  free(pool->memory);
+  free(pool);
+}
@@ -0,0 +1,109 @@
+/*
+  lsquaredc_pool.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_POOL_H
+#define LSQUAREDC_POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "lsquaredc_poll.h"
+
+#define I2C_POOL_MAX_WORKERS    32
+#define I2C_POOL_MAX_QUEUES     64      /* worker queues included */
+#define I2C_POOL_QUEUE_SIZE     1024    /* jobs per queue, a power of two */
+
+struct i2c_pool_buffer;
+
+/* Does the work on a buffer. The buffer goes back to the pool when this returns. */
+typedef void (*i2c_pool_fn)(struct i2c_pool_buffer *buffer, void *user);
+
+struct i2c_pool_buffer {
+  _Atomic uint32_t next;                /* free list link: index + 1, 0 for none */
+  uint32_t index;
+  uint32_t length;                      /* bytes of data in use */
+  uint32_t capacity;
+  uint64_t timestamp_ns;
+  i2c_pool_fn fn;
+  void *user;
+  uint8_t *data;
+};
+
+/*
+  A work-stealing deque. Only its owner pushes (and pops, for worker queues); any worker may steal from the other end.
+  top and bottom are free-running counters.
+*/
+struct i2c_pool_queue {
+  _Atomic uint32_t top __attribute__((aligned(64)));
+  _Atomic uint32_t bottom __attribute__((aligned(64)));
+  _Atomic(struct i2c_pool_buffer *) slots[I2C_POOL_QUEUE_SIZE];
+};
+
+struct i2c_pool {
+  uint32_t worker_count;
+  pthread_t workers[I2C_POOL_MAX_WORKERS];
+  struct i2c_pool_queue *queues[I2C_POOL_MAX_QUEUES];
+  _Atomic uint32_t queue_count;
+  struct i2c_pool_buffer *buffers;
+  uint32_t buffer_count;
+  uint8_t *memory;
+  _Atomic uint64_t free_list;           /* tag << 32 | (index + 1) */
+  _Atomic uint32_t sleeping;
+  int stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  _Atomic uint64_t submitted;
+  _Atomic uint64_t executed;
+  _Atomic uint64_t stolen;              /* jobs run by a worker that did not own the queue */
+  _Atomic uint64_t shortages;           /* i2c_pool_get() found no free buffer */
+};
+
+/* Hands the samples of a poller task to the pool, see i2c_pool_attach(). */
+struct i2c_pool_source {
+  struct i2c_pool *pool;
+  struct i2c_pool_queue *queue;
+  i2c_pool_fn fn;
+  void *user;
+  uint64_t offloaded;
+  uint64_t inline_runs;                 /* no buffer or no room in the queue: run on the bus thread instead */
+};
+
+struct i2c_pool *i2c_pool_create(uint32_t workers, uint32_t buffer_count, uint32_t buffer_size);
+
+struct i2c_pool_queue *i2c_pool_add_queue(struct i2c_pool *pool);
+
+struct i2c_pool_queue *i2c_pool_current_queue(struct i2c_pool *pool);
+
+struct i2c_pool_buffer *i2c_pool_get(struct i2c_pool *pool);
+
+void i2c_pool_put(struct i2c_pool *pool, struct i2c_pool_buffer *buffer);
+
+int i2c_pool_submit(struct i2c_pool *pool, struct i2c_pool_queue *queue, struct i2c_pool_buffer *buffer,
+                    i2c_pool_fn fn, void *user);
+
+void i2c_pool_attach(struct i2c_pool_source *source, struct i2c_poll_task *task);
+
+void i2c_pool_destroy(struct i2c_pool *pool);
+
+#endif
@@ -0,0 +1,196 @@
+/*
+  lsquaredc_predict.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "lsquaredc.h"
+#include "lsquaredc_predict.h"
+
+/*
+  Conversion time prediction. ADCs and many sensors take a variable amount of time to convert, and the usual way to
+  wait is to read the status register over and over until the ready bit shows up, which keeps the bus busy with reads
+  that return "not yet". Instead, we learn how long conversions take and look only once, when a chosen percentile of
+  conversions (say 95%) would be done. Only when that misses do we fall back to polling the status at a short interval.
+
+  The distribution is a histogram of conversion times. It is fed only by calibration conversions, which are polled at
+  the short interval from the very start: conversions we only looked at once tell us nothing about how long they
+  actually took, and learning from the misses alone would skew the histogram towards the slow ones. The first
+  conversions and then every calibrate_every-th one are calibrations. Old samples are decayed, so the histogram follows
+  changes (temperature, supply voltage, a different oversampling setting).
+*/
+
+#define WARMUP_SAMPLES 16
+#define MAX_SAMPLES 1024            /* counts are halved when we get here */
+#define DEFAULT_CALIBRATE_EVERY 32
+#define TIMEOUT_NS 1000000000ULL
+
+void i2c_predict_init(struct i2c_predictor *predictor, uint32_t bucket_us, uint32_t percentile, uint32_t poll_us) {
+  memset(predictor, 0, sizeof(struct i2c_predictor));
+  predictor->bucket_us = bucket_us ? bucket_us : 100;
+  predictor->percentile = (percentile && percentile <= 100) ? percentile : 95;
+  predictor->poll_us = poll_us ? poll_us : predictor->bucket_us;
+  predictor->calibrate_every = DEFAULT_CALIBRATE_EVERY;
+}
+
+/* Adds a measured conversion time to the histogram. */
+void i2c_predict_observe(struct i2c_predictor *predictor, uint32_t conversion_us) {
+  uint32_t bucket = conversion_us / predictor->bucket_us;
+  uint32_t i;
+
+  if(bucket >= I2C_PREDICT_BUCKETS) bucket = I2C_PREDICT_BUCKETS - 1;
+  predictor->counts[bucket]++;
+  if(++predictor->samples < MAX_SAMPLES) return;
+  predictor->samples = 0;
+  for(i = 0; i < I2C_PREDICT_BUCKETS; i++) {
+    predictor->counts[i] /= 2;
+    predictor->samples += predictor->counts[i];
+  }
+}
+
+/* Time after the start by which percentile % of conversions are done, or 0 if we do not know yet. */
+uint32_t i2c_predict_delay_us(struct i2c_predictor *predictor) {
+  uint64_t target, cumulative = 0;
+  uint32_t i;
+
+  if(predictor->samples < WARMUP_SAMPLES) return 0;
+  target = ((uint64_t)predictor->samples * predictor->percentile + 99) / 100;
+  for(i = 0; i < I2C_PREDICT_BUCKETS; i++) {
+    cumulative += predictor->counts[i];
+    if(cumulative >= target) break;
+  }
+  return (i + 1) * predictor->bucket_us;
+}
+
+/* Mean conversion time and the expected number of status reads when polling every poll_us, from the histogram. */
+static void expectations(struct i2c_predictor *predictor, double *mean_us, double *polls) {
+  double middle;
+  uint32_t i;
+
+  *mean_us = 0;
+  *polls = 1;
+  if(predictor->samples == 0) return;
+  *polls = 0;
+  for(i = 0; i < I2C_PREDICT_BUCKETS; i++) {
+    middle = (i + 0.5) * predictor->bucket_us;
+    *mean_us += predictor->counts[i] * middle;
+    *polls += predictor->counts[i] * (uint32_t)(middle / predictor->poll_us + 1);
+  }
+  *mean_us /= predictor->samples;
+  *polls /= predictor->samples;
+}
+
+
+/*
+  Status reads saved compared with polling every poll_us, and the latency added by waiting for the percentile instead
+  of noticing readiness as soon as possible (the mean over predicted conversions, calibrations excluded). Both are
+  estimates based on the learned distribution.
+*/
+void i2c_predict_report(struct i2c_predictor *predictor, int64_t *saved_status_reads, int64_t *added_latency_us) {
+  uint32_t predicted = predictor->conversions - predictor->calibrations;
+  double mean_us, polls;
+
+  expectations(predictor, &mean_us, &polls);
+  *saved_status_reads = (int64_t)predictor->polling_status_reads - (int64_t)predictor->status_reads;
+  *added_latency_us = predicted ? (int64_t)(predictor->latency_ns / predicted / 1000 - mean_us) : 0;
+}
+
+
+/*
+  Waits for an operation started at start_ns (a conversion, a flash page write...) to finish, first looking when the
+  percentile of them would be done, then every poll_us, and keeps the statistics. ready is called to look: it returns
+  1 when done, 0 when not, or -1 in case of an error. Returns 0 when done, or -1 in case of an error (errno is
+  ETIMEDOUT if it was not done within timeout_ns).
+*/
+int i2c_predict_wait(struct i2c_predictor *predictor, uint64_t start_ns, uint64_t timeout_ns, i2c_predict_ready_fn ready,
+                     void *user) {
+  uint64_t look_ns;
+  uint32_t delay_us;
+  uint32_t reads = 0;
+  double mean_us, polls;
+  int calibrating, done;
+
+  predictor->conversions++;
+  delay_us = i2c_predict_delay_us(predictor);
+  calibrating = delay_us == 0 || predictor->conversions % predictor->calibrate_every == 0;
+  if(calibrating) {
+    predictor->calibrations++;
+    delay_us = predictor->poll_us;
+  }
+
+  for(look_ns = start_ns + (uint64_t)delay_us * 1000;; look_ns += (uint64_t)predictor->poll_us * 1000) {
+    if(look_ns - start_ns > timeout_ns) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    i2c_sleep_until(look_ns);
+    reads++;
+    predictor->status_reads++;
+    if((done = ready(user)) < 0) return -1;
+    if(done) break;
+  }
+
+  if(calibrating) {
+    /* it ended somewhere in the last poll interval */
+    predictor->polling_status_reads += reads;
+    i2c_predict_observe(predictor, (look_ns - start_ns) / 1000 - predictor->poll_us / 2);
+  } else {
+    if(reads == 1) {
+      predictor->hits++;
+    } else {
+      predictor->misses++;
+    }
+    expectations(predictor, &mean_us, &polls);
+    predictor->polling_status_reads += polls;
+    predictor->latency_ns += look_ns - start_ns;
+  }
+  return 0;
+}
+
+static int conversion_ready(void *user) {
+  struct i2c_conversion *conversion = user;
+  uint8_t status;
+
+  if(i2c_send_sequence(conversion->handle, conversion->status, conversion->status_length, &status) < 0) return -1;
+  return (status & conversion->ready_mask) == conversion->ready_value;
+}
+
+
+/*
+  Starts a conversion, waits until it is done and reads the result into data. Returns what i2c_send_sequence() returns
+  for the read (the number of messages transferred), or -1 in case of an error (errno is ETIMEDOUT if the device never
+  became ready, EINVAL if the status sequence does not read exactly one byte).
+*/
+int i2c_predict_convert(struct i2c_conversion *conversion, uint8_t *data) {
+  uint64_t start_ns = i2c_monotonic_ns();
+
+  if(i2c_count_reads(conversion->status, conversion->status_length) != 1) {
+    errno = EINVAL;
+    return -1;
+  }
+  if(i2c_send_sequence(conversion->handle, conversion->start, conversion->start_length, 0) < 0) return -1;
+  if(i2c_predict_wait(&conversion->predictor, start_ns, TIMEOUT_NS, conversion_ready, conversion) < 0) return -1;
+  return i2c_send_sequence(conversion->handle, conversion->read, conversion->read_length, data);
+}
@@ -0,0 +1,79 @@
+/*
+  lsquaredc_predict.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_PREDICT_H
+#define LSQUAREDC_PREDICT_H
+
+#include <stdint.h>
+
+#define I2C_PREDICT_BUCKETS 64
+
+/* Learned distribution of conversion times of one device, see lsquaredc_predict.c. */
+struct i2c_predictor {
+  uint32_t bucket_us;                   /* histogram resolution */
+  uint32_t percentile;                  /* of conversions that should be done when we first look */
+  uint32_t poll_us;                     /* status poll interval when we have to poll */
+  uint32_t calibrate_every;             /* every Nth conversion is polled from the start, to keep learning */
+  uint32_t counts[I2C_PREDICT_BUCKETS]; /* the last bucket also counts everything longer */
+  uint32_t samples;
+  uint32_t conversions;
+  uint32_t calibrations;
+  uint32_t hits;                        /* ready when we first looked */
+  uint32_t misses;
+  uint64_t status_reads;
+  double polling_status_reads;          /* estimate of what polling every poll_us from the start would have needed */
+  uint64_t latency_ns;                  /* sum over predicted conversions, from start until we knew it was ready */
+};
+
+/* Looks whether what is being waited for is done: returns 1 if it is, 0 if not, -1 in case of an error. */
+typedef int (*i2c_predict_ready_fn)(void *user);
+
+/* A device that converts on request and has a ready bit. */
+struct i2c_conversion {
+  int handle;
+  uint16_t *start;                      /* starts a conversion */
+  uint32_t start_length;
+  uint16_t *status;                     /* reads the status byte (exactly one I2C_READ) */
+  uint32_t status_length;
+  uint8_t ready_mask;
+  uint8_t ready_value;                  /* ready when (status & ready_mask) == ready_value */
+  uint16_t *read;                       /* reads the result */
+  uint32_t read_length;
+  struct i2c_predictor predictor;
+};
+
+void i2c_predict_init(struct i2c_predictor *predictor, uint32_t bucket_us, uint32_t percentile, uint32_t poll_us);
+
+void i2c_predict_observe(struct i2c_predictor *predictor, uint32_t conversion_us);
+
+uint32_t i2c_predict_delay_us(struct i2c_predictor *predictor);
+
+int i2c_predict_wait(struct i2c_predictor *predictor, uint64_t start_ns, uint64_t timeout_ns, i2c_predict_ready_fn ready,
+                     void *user);
+
+void i2c_predict_report(struct i2c_predictor *predictor, int64_t *saved_status_reads, int64_t *added_latency_us);
+
+int i2c_predict_convert(struct i2c_conversion *conversion, uint8_t *data);
+
+#endif
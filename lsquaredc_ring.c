@@ -0,0 +1,163 @@
+/*
+  lsquaredc_ring.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "lsquaredc.h"
+#include "lsquaredc_ring.h"
+
+/*
+  Streaming reads into a single-producer, single-consumer ring. i2c_ring_read() points the received_data buffer of
+  i2c_send_sequence() straight at the next free slot, so the kernel copies the data directly into the consumer's memory
+  and nobody has to memcpy it afterwards. Records are variable-length: a record takes as many slots as it needs, and if
+  it does not fit before the end of the ring, a padding record is inserted and the record starts at slot 0, so that the
+  data is always contiguous.
+*/
+
+static struct i2c_ring_record *slot_at(struct i2c_ring *ring, uint32_t position) {
+  return (struct i2c_ring_record *)((uint8_t *)ring + ring->data_offset +
+                                    (size_t)(position & (ring->slot_count - 1)) * ring->slot_size);
+}
+
+
+/*
+  Lays out a ring in the supplied memory (which may be a shared mapping). slot_size is rounded up to a multiple of 8 and
+  must be able to hold at least the record header. The number of slots is the largest power of two that fits. Returns
+  the ring (which is the same address as memory), or 0 if the memory is too small.
+*/
+struct i2c_ring *i2c_ring_init(void *memory, size_t size, uint32_t slot_size) {
+  struct i2c_ring *ring = memory;
+  uint32_t data_offset = (sizeof(struct i2c_ring) + 63) & ~63u;
+  size_t available;
+  uint32_t slot_count = 1;
+
+  slot_size = (slot_size + 7) & ~7u;
+  if(slot_size <= sizeof(struct i2c_ring_record) || size <= data_offset) return 0;
+  available = (size - data_offset) / slot_size;
+  if(available < 2) return 0;
+  while((size_t)slot_count * 2 <= available) slot_count *= 2;
+
+  ring->magic = I2C_RING_MAGIC;
+  ring->slot_size = slot_size;
+  ring->slot_count = slot_count;
+  ring->data_offset = data_offset;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->overruns, 0);
+  atomic_init(&ring->tail, 0);
+  return ring;
+}
+
+/* For the consumer side of a shared ring: checks that the memory holds an initialized ring. */
+struct i2c_ring *i2c_ring_attach(void *memory) {
+  struct i2c_ring *ring = memory;
+  return (ring->magic == I2C_RING_MAGIC) ? ring : 0;
+}
+
+
+/*
+  Performs the sequence with the received data going directly into the next free slot, then publishes the record to the
+  consumer. Returns the result of i2c_send_sequence(). If the consumer has fallen behind and there is no room for the
+  record, nothing is sent to the bus, the overrun counter is incremented and -1 is returned with errno set to ENOBUFS:
+  this is the back-pressure signal, and the producer can decide whether to slow down or drop samples.
+*/
+int i2c_ring_read(int handle, struct i2c_ring *ring, uint16_t *sequence, uint32_t sequence_length) {
+  uint32_t data_length = i2c_count_reads(sequence, sequence_length);
+  uint32_t needed, padding, index, head, tail;
+  struct i2c_ring_record *record;
+  int result;
+
+  needed = (sizeof(struct i2c_ring_record) + data_length + ring->slot_size - 1) / ring->slot_size;
+  if(needed > ring->slot_count) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  index = head & (ring->slot_count - 1);
+  padding = (needed > ring->slot_count - index) ? ring->slot_count - index : 0;
+
+  if((head - tail) + padding + needed > ring->slot_count) {
+    atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+    errno = ENOBUFS;
+    return -1;
+  }
+
+  if(padding) {
+    record = slot_at(ring, head);
+    record->length = I2C_RING_PADDING;
+    record->slots = padding;
+  }
+  record = slot_at(ring, head + padding);
+  result = i2c_send_sequence(handle, sequence, sequence_length, record->data);
+  if(result < 0) {
+    /* the padding record is still valid, so we may as well publish it */
+    if(padding) atomic_store_explicit(&ring->head, head + padding, memory_order_release);
+    return result;
+  }
+  record->length = data_length;
+  record->slots = needed;
+  record->timestamp_ns = i2c_monotonic_ns();
+  atomic_store_explicit(&ring->head, head + padding + needed, memory_order_release);
+  return result;
+}
+
+/* Returns the number of occupied slots. Producers can use this to throttle before the ring actually overflows. */
+uint32_t i2c_ring_fill(struct i2c_ring *ring) {
+  return atomic_load_explicit(&ring->head, memory_order_acquire) -
+    atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+
+/*
+  Consumer side: returns a pointer to the data of the oldest record (valid until i2c_ring_release()), or 0 if the ring
+  is empty.
+*/
+uint8_t *i2c_ring_peek(struct i2c_ring *ring, uint32_t *length, uint64_t *timestamp_ns) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  struct i2c_ring_record *record;
+
+  while(tail != head) {
+    record = slot_at(ring, tail);
+    if(record->length != I2C_RING_PADDING) {
+      if(length) *length = record->length;
+      if(timestamp_ns) *timestamp_ns = record->timestamp_ns;
+      return record->data;
+    }
+    tail += record->slots;
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+  return 0;
+}
+
+/* Consumer side: frees the slots of the record returned by i2c_ring_peek(). */
+void i2c_ring_release(struct i2c_ring *ring) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  if(tail == atomic_load_explicit(&ring->head, memory_order_acquire)) return;
+  atomic_store_explicit(&ring->tail, tail + slot_at(ring, tail)->slots, memory_order_release);
+}
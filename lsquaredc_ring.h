@@ -0,0 +1,70 @@
+/*
+  lsquaredc_ring.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_RING_H
+#define LSQUAREDC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define I2C_RING_MAGIC      0x4c324352  /* "L2CR" */
+#define I2C_RING_PADDING    0xffffffff  /* record length marking a padding record before a wrap */
+
+/*
+  The ring header lives at the start of the ring memory, so that the memory can be a shared mapping with the producer
+  and the consumer in different processes. head is only written by the producer, tail only by the consumer. Both are
+  free-running slot counters.
+*/
+struct i2c_ring {
+  uint32_t magic;
+  uint32_t slot_size;
+  uint32_t slot_count;      /* always a power of two */
+  uint32_t data_offset;     /* offset of the first slot from the start of the ring memory */
+  _Atomic uint32_t head __attribute__((aligned(64)));
+  _Atomic uint32_t overruns;
+  _Atomic uint32_t tail __attribute__((aligned(64)));
+};
+
+/* Every record starts at a slot boundary and may span several consecutive slots. */
+struct i2c_ring_record {
+  uint32_t length;          /* data bytes, or I2C_RING_PADDING */
+  uint32_t slots;           /* number of slots this record occupies */
+  uint64_t timestamp_ns;    /* i2c_monotonic_ns() when the transfer completed */
+  uint8_t data[];
+};
+
+struct i2c_ring *i2c_ring_init(void *memory, size_t size, uint32_t slot_size);
+
+struct i2c_ring *i2c_ring_attach(void *memory);
+
+int i2c_ring_read(int handle, struct i2c_ring *ring, uint16_t *sequence, uint32_t sequence_length);
+
+uint32_t i2c_ring_fill(struct i2c_ring *ring);
+
+uint8_t *i2c_ring_peek(struct i2c_ring *ring, uint32_t *length, uint64_t *timestamp_ns);
+
+void i2c_ring_release(struct i2c_ring *ring);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+  lsquaredc_share.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lsquaredc.h"
+#include "lsquaredc_share.h"
+
+/*
+  Fair sharing of a bus between clients (plugins, threads, subsystems). Left alone, whoever calls i2c_send_sequence()
+  most often gets the bus most often, and a client looping on transfers starves everybody else. Clients of a struct
+  i2c_share call i2c_share_send() instead. When the bus is free and nobody is waiting, the transfer goes out right
+  away; otherwise the transfers wait, and the bus goes to them in weighted fair order.
+
+  The order is start-time fair queuing. Every client has a virtual finish time, advanced by the bus time of each of its
+  transfers divided by its weight. A new transfer gets the start tag max(virtual time, the client's finish time), and
+  the waiting transfer with the smallest start tag goes next. Under contention, each client therefore gets bus time in
+  proportion to its weight, whatever the length of its transfers. A client that does not use its share does not save it
+  up for later (its start tag catches up with the virtual time), and the others get the bus in the meantime.
+
+  The cost of a transfer is first estimated from its SCL clocks at bus_hz, and replaced by the measured duration of the
+  ioctl once it is done. That way clock stretching, slow adapters and the per-transfer overhead are charged to the
+  client that caused them.
+
+  A client that issues one transfer at a time (from a single thread) is not waiting when its own transfer ends, so on
+  its own, the order above would hand the bus to whoever else is waiting, and a client with long transfers would get
+  every other turn, and much more than its share. So the bus is briefly left idle instead: if the waiting transfer that
+  would go next is more than quantum_ns (of its client's bus time) ahead of the virtual time, and a client that would
+  come before it has ended a transfer less than grace_ns ago, the bus is held for that client until its grace runs out.
+  The cost is at most grace_ns of idle bus whenever a client stops using it.
+*/
+
+#define WEIGHT_SCALE 1024               /* virtual time is nanoseconds * WEIGHT_SCALE / weight */
+#define DEFAULT_QUANTUM_NS 100000
+#define DEFAULT_GRACE_NS 1000000
+
+struct i2c_share_waiter {
+  struct i2c_share_client *client;
+  uint64_t start;
+  int go;
+  pthread_cond_t cond;
+  struct i2c_share_waiter *next;
+};
+
+static uint64_t charge(uint64_t ns, uint32_t weight) {
+  return ns * WEIGHT_SCALE / weight;
+}
+
+/* Creates a share of the bus behind handle. bus_hz is used to estimate the cost of transfers (0 means 100 kHz). */
+struct i2c_share *i2c_share_create(int handle, uint32_t bus_hz) {
+  struct i2c_share *share = calloc(1, sizeof(struct i2c_share));
+
+  if(!share) return 0;
+  share->handle = handle;
+  share->bus_hz = bus_hz ? bus_hz : 100000;
+  share->quantum_ns = DEFAULT_QUANTUM_NS;
+  share->grace_ns = DEFAULT_GRACE_NS;
+  pthread_mutex_init(&share->lock, 0);
+  return share;
+}
+
+
+/*
+  Adds a client with the given weight: under contention, its share of the bus is its weight over the sum of the weights
+  of the clients that want the bus. Returns the client, or 0 if there are too many clients or the weight is 0.
+*/
+struct i2c_share_client *i2c_share_add_client(struct i2c_share *share, const char *name, uint32_t weight) {
+  struct i2c_share_client *client = 0;
+
+  if(weight == 0) {
+    errno = EINVAL;
+    return 0;
+  }
+  pthread_mutex_lock(&share->lock);
+  if(share->client_count < I2C_SHARE_MAX_CLIENTS) {
+    client = &share->clients[share->client_count++];
+    memset(client, 0, sizeof(struct i2c_share_client));
+    strncpy(client->name, name ? name : "", sizeof(client->name) - 1);
+    client->weight = weight;
+    client->finish = share->virtual_time;
+  } else {
+    errno = ENOSPC;
+  }
+  pthread_mutex_unlock(&share->lock);
+  return client;
+}
+
+int i2c_share_set_weight(struct i2c_share *share, struct i2c_share_client *client, uint32_t weight) {
+  if(weight == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  pthread_mutex_lock(&share->lock);
+  client->weight = weight;
+  pthread_mutex_unlock(&share->lock);
+  return 0;
+}
+
+/*
+  Returns the time until which the bus should be held for clients that are not waiting but would come before the
+  transfer best, or 0 if it should go now.
+*/
+static uint64_t hold_until(struct i2c_share *share, struct i2c_share_waiter *best, uint64_t now_ns) {
+  struct i2c_share_client *client;
+  uint64_t until = 0, start;
+  uint32_t i;
+
+  if(best->start <= share->virtual_time + charge(share->quantum_ns, best->client->weight)) return 0;
+  for(i = 0; i < share->client_count; i++) {
+    client = &share->clients[i];
+    if(client == best->client || client->waiting || client->last_end_ns + share->grace_ns <= now_ns) continue;
+    start = (client->finish > share->virtual_time) ? client->finish : share->virtual_time;
+    if(start >= best->start) continue;
+    if(!until || client->last_end_ns + share->grace_ns < until) until = client->last_end_ns + share->grace_ns;
+  }
+  return until;
+}
+
+/*
+  Hands the bus to the waiting transfer with the smallest start tag (the oldest one among equals), if any, unless it is
+  held for a client that is about to come back (see hold_until()).
+*/
+static void hand_over(struct i2c_share *share) {
+  struct i2c_share_waiter **link, **best = 0;
+
+  share->busy = 0;
+  share->held_until = 0;
+  for(link = &share->waiters; *link; link = &(*link)->next) {
+    if(!best || (*link)->start < (*best)->start) best = link;
+  }
+  if(!best) return;
+  share->held_until = hold_until(share, *best, i2c_monotonic_ns());
+  if(share->held_until) {
+    /* wakes it up to wait until the hold ends */
+    pthread_cond_signal(&(*best)->cond);
+    return;
+  }
+  share->busy = 1;
+  share->virtual_time = (*best)->start;
+  (*best)->client->waiting--;
+  (*best)->go = 1;
+  pthread_cond_signal(&(*best)->cond);
+  *best = (*best)->next;
+}
+
+/* Waits for the turn of a queued transfer, taking the bus over if it was held for longer than needed. */
+static void wait_turn(struct i2c_share *share, struct i2c_share_waiter *waiter) {
+  struct timespec deadline;
+
+  while(!waiter->go) {
+    if(share->busy || !share->held_until) {
+      pthread_cond_wait(&waiter->cond, &share->lock);
+    } else {
+      deadline.tv_sec = share->held_until / 1000000000ULL;
+      deadline.tv_nsec = share->held_until % 1000000000ULL;
+      if(pthread_cond_timedwait(&waiter->cond, &share->lock, &deadline) == ETIMEDOUT && !waiter->go && !share->busy) {
+        hand_over(share);
+      }
+    }
+  }
+}
+
+/*
+  Performs the sequence (see i2c_send_sequence()) when it is the client's turn. Can be called from any number of
+  threads, for any clients. Returns the result of i2c_send_sequence().
+*/
+int i2c_share_send(struct i2c_share *share, struct i2c_share_client *client, uint16_t *sequence,
+                   uint32_t sequence_length, uint8_t *received_data) {
+  uint64_t wire_ns = (uint64_t)i2c_sequence_clocks(sequence, sequence_length) * 1000000000ULL / share->bus_hz;
+  uint64_t arrived_ns = i2c_monotonic_ns();
+  struct i2c_share_waiter waiter, **tail;
+  pthread_condattr_t attributes;
+  uint64_t begin_ns, end_ns;
+  uint32_t weight;
+  int result;
+
+  pthread_mutex_lock(&share->lock);
+  weight = client->weight;
+  waiter.start = (client->finish > share->virtual_time) ? client->finish : share->virtual_time;
+  /* provisional, so that more transfers of this client (from other threads) queue up behind this one */
+  client->finish = waiter.start + charge(wire_ns, weight);
+  if(!share->busy && !share->waiters) {
+    share->busy = 1;
+    share->virtual_time = waiter.start;
+  } else {
+    waiter.client = client;
+    waiter.go = 0;
+    waiter.next = 0;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&waiter.cond, &attributes);
+    pthread_condattr_destroy(&attributes);
+    for(tail = &share->waiters; *tail; tail = &(*tail)->next);
+    *tail = &waiter;
+    client->waiting++;
+    /* the bus may be held for someone else, who is not necessarily us */
+    if(!share->busy) hand_over(share);
+    wait_turn(share, &waiter);
+    pthread_cond_destroy(&waiter.cond);
+  }
+  pthread_mutex_unlock(&share->lock);
+
+  begin_ns = i2c_monotonic_ns();
+  result = i2c_send_sequence(share->handle, sequence, sequence_length, received_data);
+  end_ns = i2c_monotonic_ns();
+
+  pthread_mutex_lock(&share->lock);
+  client->finish = client->finish - charge(wire_ns, weight) + charge(end_ns - begin_ns, weight);
+  client->last_end_ns = end_ns;
+  client->stats.transfers++;
+  client->stats.bus_ns += end_ns - begin_ns;
+  client->stats.wire_ns += wire_ns;
+  client->stats.wait_ns += begin_ns - arrived_ns;
+  if(result < 0) client->stats.errors++;
+  hand_over(share);
+  pthread_mutex_unlock(&share->lock);
+  return result;
+}
+
+/* Copies the counters of a client. */
+void i2c_share_get_stats(struct i2c_share *share, struct i2c_share_client *client, struct i2c_share_stats *stats) {
+  pthread_mutex_lock(&share->lock);
+  *stats = client->stats;
+  pthread_mutex_unlock(&share->lock);
+}
+
+/* Frees the share. No transfers may be in progress. */
+void i2c_share_destroy(struct i2c_share *share) {
+  pthread_mutex_destroy(&share->lock);
+  free(share);
+}
@@ -0,0 +1,81 @@
+/*
+  lsquaredc_share.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_SHARE_H
+#define LSQUAREDC_SHARE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define I2C_SHARE_MAX_CLIENTS   32
+
+/* Bus time used by one client, see i2c_share_get_stats(). */
+struct i2c_share_stats {
+  uint64_t transfers;
+  uint64_t bus_ns;                      /* measured: from the start to the end of the ioctl */
+  uint64_t wire_ns;                     /* estimated from the number of SCL clocks */
+  uint64_t wait_ns;                     /* spent waiting for the turn */
+  uint64_t errors;
+};
+
+struct i2c_share_client {
+  char name[32];
+  uint32_t weight;
+  uint64_t finish;                      /* virtual finish time of the last request */
+  uint64_t last_end_ns;                 /* when its last transfer ended */
+  uint32_t waiting;                     /* queued transfers */
+  struct i2c_share_stats stats;
+};
+
+struct i2c_share_waiter;
+
+/* Weighted fair sharing of one bus between clients, see lsquaredc_share.c. */
+struct i2c_share {
+  int handle;
+  uint32_t bus_hz;
+  uint64_t quantum_ns;                  /* how far ahead a client can get before the bus is held for the others */
+  uint64_t grace_ns;                    /* how long the bus is held for a client since its last transfer */
+  pthread_mutex_t lock;
+  int busy;
+  uint64_t virtual_time;
+  uint64_t held_until;                  /* the bus is free but held, 0 if not */
+  struct i2c_share_waiter *waiters;
+  uint32_t client_count;
+  struct i2c_share_client clients[I2C_SHARE_MAX_CLIENTS];
+};
+
+struct i2c_share *i2c_share_create(int handle, uint32_t bus_hz);
+
+struct i2c_share_client *i2c_share_add_client(struct i2c_share *share, const char *name, uint32_t weight);
+
+int i2c_share_set_weight(struct i2c_share *share, struct i2c_share_client *client, uint32_t weight);
+
+int i2c_share_send(struct i2c_share *share, struct i2c_share_client *client, uint16_t *sequence,
+                   uint32_t sequence_length, uint8_t *received_data);
+
+void i2c_share_get_stats(struct i2c_share *share, struct i2c_share_client *client, struct i2c_share_stats *stats);
+
+void i2c_share_destroy(struct i2c_share *share);
+
+#endif
@@ -0,0 +1,634 @@
+/*
+  lsquaredc_smbus.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "lsquaredc.h"
+#include "lsquaredc_smbus.h"
+
+/*
+  SMBus compatibility. Code written for the libi2c helpers (i2c_smbus_read_byte_data() and friends) does one ioctl per
+  call, typically reading a multi-byte sample one register at a time. These are drop-in replacements that go through
+  i2c_send_sequence() instead, and cut the number of transfers in two ways:
+
+  - Read-ahead. We learn runs of consecutive register reads (the X, Y and Z bytes of an accelerometer, read one after
+    the other), and the next time the run starts, read all of it in one burst. The rest of the run is then served from
+    the burst, provided it is asked for within READ_AHEAD_US, and every value is served once only: read-ahead never
+    makes a register appear to change less often than it does. As a bonus, the bytes of a sample come from the same
+    transfer, so they cannot tear. This needs a device that auto-increments the register address on reads, so it is
+    only done for addresses enabled with i2c_smbus_auto_increment() or listed in the LSQUAREDC_SMBUS_AUTO_INCREMENT
+    environment variable (7-bit addresses separated by commas).
+
+  - Shared reads. A thread that asks for a register while another thread is reading it on the same file waits for that
+    read and takes its result, rather than doing the same read again, as long as the read started after it asked.
+
+  Any write to a device drops everything read ahead from it and is never delayed or merged.
+
+  The address of the device comes from the I2C_SLAVE ioctl, which lsquaredc cannot see unless told with
+  i2c_smbus_set_slave(), or unless the program is linked with -Wl,--wrap=ioctl, which makes its ioctl() calls go
+  through __wrap_ioctl() below first, without changing the code. Until the address is known, the calls are passed on
+  to the kernel's I2C_SMBUS ioctl unchanged, just like libi2c does. So are all calls on adapters that only do SMBus
+  (I2C_FUNC_I2C is missing from their I2C_FUNCS, as on the i801 and piix4), which cannot take sequences at all. What we
+  know about a file is forgotten when it is set to another address, and freed when it is closed if the program is
+  also linked with -Wl,--wrap=close (the file number may be reused for another bus), or when i2c_smbus_release() is
+  called. The SMBus block reads (with the length sent by the device) and the quick command are always passed on, as
+  they cannot be expressed as sequences. Errors are returned as negative errno values, as in libi2c.
+*/
+
+#define MAX_FILES 1024
+#define READ_AHEAD_US 2000
+#define MAX_RUN 32                  /* I2C_SMBUS_BLOCK_MAX */
+#define RUN_TRACKERS 4              /* threads whose runs are followed at the same time */
+
+#define BIT_SET(bitmap, i) ((bitmap)[(i) >> 3] & (1 << ((i) & 7)))
+
+/* A run of consecutive register reads by one thread, being followed. */
+struct smbus_run {
+  pthread_t thread;
+  uint32_t start;
+  uint32_t next;
+  uint64_t ns;                          /* last read of the run, 0 if the tracker is free */
+};
+
+struct smbus_device {
+  uint8_t address;                      /* 7-bit */
+  uint8_t values[0x100];
+  uint64_t read_ns[0x100];              /* when the read that got the value started, 0 if never */
+  uint8_t ahead[0x20];                  /* read ahead and not used yet, a bitmap */
+  uint8_t runs[0x100];                  /* learned length of the run of reads starting at a register */
+  struct smbus_run trackers[RUN_TRACKERS];
+  struct smbus_device *next;
+};
+
+struct smbus_file {
+  pthread_mutex_t lock;
+  int address;                          /* -1 until we know */
+  int plain_i2c;                        /* the adapter does I2C transfers (I2C_FUNC_I2C), not only SMBus */
+  struct smbus_device *devices;
+  struct i2c_smbus_stats stats;
+};
+
+static struct smbus_file *files[MAX_FILES];
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t environment_once = PTHREAD_ONCE_INIT;
+static uint8_t auto_increment[0x10];    /* by 7-bit address, a bitmap */
+
+static void read_environment(void) {
+  const char *list = getenv("LSQUAREDC_SMBUS_AUTO_INCREMENT");
+  char *end;
+  long address;
+
+  while(list && *list) {
+    address = strtol(list, &end, 0);
+    if(end == list) break;
+    if(address >= 0 && address < 0x80) auto_increment[address >> 3] |= 1 << (address & 7);
+    list = (*end == ',') ? end + 1 : end;
+  }
+}
+
+static struct smbus_file *get_file(int file) {
+  struct smbus_file *state;
+  unsigned long functions;
+
+  if(file < 0 || file >= MAX_FILES) return 0;
+  pthread_once(&environment_once, read_environment);
+  pthread_mutex_lock(&files_lock);
+  if(!(state = files[file]) && (state = calloc(1, sizeof(struct smbus_file)))) {
+    pthread_mutex_init(&state->lock, 0);
+    state->address = -1;
+    state->plain_i2c = ioctl(file, I2C_FUNCS, &functions) == 0 && (functions & I2C_FUNC_I2C);
+    files[file] = state;
+  }
+  pthread_mutex_unlock(&files_lock);
+  return state;
+}
+
+/* With the file locked. */
+static struct smbus_device *get_device(struct smbus_file *state) {
+  struct smbus_device *device;
+
+  for(device = state->devices; device; device = device->next) {
+    if(device->address == state->address) return device;
+  }
+  if(!(device = calloc(1, sizeof(struct smbus_device)))) return 0;
+  device->address = state->address;
+  device->next = state->devices;
+  state->devices = device;
+  return device;
+}
+
+/*
+  Tells the library which device the file talks to, as ioctl(file, I2C_SLAVE, address) tells the kernel. Values read
+  ahead on the file are dropped when the address changes.
+*/
+int i2c_smbus_set_slave(int file, int address) {
+  struct smbus_file *state = get_file(file);
+  struct smbus_device *device;
+
+  if(!state || address < 0 || address >= 0x80) return -1;
+  pthread_mutex_lock(&state->lock);
+  if(state->address != address) {
+    for(device = state->devices; device; device = device->next) {
+      memset(device->ahead, 0, sizeof(device->ahead));
+      memset(device->read_ns, 0, sizeof(device->read_ns));
+    }
+  }
+  state->address = address;
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+/* Forgets everything about a file that is closed. No other thread may be using it. */
+void i2c_smbus_release(int file) {
+  struct smbus_file *state;
+  struct smbus_device *device;
+
+  if(file < 0 || file >= MAX_FILES) return;
+  pthread_mutex_lock(&files_lock);
+  state = files[file];
+  files[file] = 0;
+  pthread_mutex_unlock(&files_lock);
+  if(!state) return;
+  while((device = state->devices)) {
+    state->devices = device->next;
+    free(device);
+  }
+  pthread_mutex_destroy(&state->lock);
+  free(state);
+}
+
+/*
+  Only called when linking with -Wl,--wrap=ioctl, which also makes __real_ioctl() the real ioctl(). Otherwise the weak
+  reference stays unresolved, and nothing calls this.
+*/
+extern int __real_ioctl(int fd, unsigned long request, ...) __attribute__((weak));
+
+int __wrap_ioctl(int fd, unsigned long request, ...) {
+  va_list arguments;
+  void *argument;
+  int result;
+
+  va_start(arguments, request);
+  argument = va_arg(arguments, void *);
+  va_end(arguments);
+  result = __real_ioctl(fd, request, argument);
+  if(result >= 0 && (request == I2C_SLAVE || request == I2C_SLAVE_FORCE)) i2c_smbus_set_slave(fd, (int)(long)argument);
+  return result;
+}
+
+/* Likewise with -Wl,--wrap=close. */
+extern int __real_close(int fd) __attribute__((weak));
+
+int __wrap_close(int fd) {
+  i2c_smbus_release(fd);
+  return __real_close(fd);
+}
+
+/* Allows read-ahead on the device at a 7-bit address, which must auto-increment its register address on reads. */
+void i2c_smbus_auto_increment(int address, int enable) {
+  pthread_once(&environment_once, read_environment);
+  if(address < 0 || address >= 0x80) return;
+  pthread_mutex_lock(&files_lock);
+  if(enable) {
+    auto_increment[address >> 3] |= 1 << (address & 7);
+  } else {
+    auto_increment[address >> 3] &= ~(1 << (address & 7));
+  }
+  pthread_mutex_unlock(&files_lock);
+}
+
+int i2c_smbus_get_stats(int file, struct i2c_smbus_stats *stats) {
+  struct smbus_file *state = get_file(file);
+
+  if(!state) return -1;
+  pthread_mutex_lock(&state->lock);
+  *stats = state->stats;
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+/* The kernel's SMBus ioctl, as libi2c does it. */
+static int32_t smbus_access(struct smbus_file *state, int file, char read_write, uint8_t command, int size,
+                            union i2c_smbus_data *data) {
+  struct i2c_smbus_ioctl_data arguments;
+
+  arguments.read_write = read_write;
+  arguments.command = command;
+  arguments.size = size;
+  arguments.data = data;
+  if(state) {
+    pthread_mutex_lock(&state->lock);
+    state->stats.calls++;
+    state->stats.transfers++;
+    pthread_mutex_unlock(&state->lock);
+  }
+  if(ioctl(file, I2C_SMBUS, &arguments) < 0) return -errno;
+  return 0;
+}
+
+/* With the file locked. */
+static int32_t transfer(struct smbus_file *state, int file, uint16_t *sequence, uint32_t length, uint8_t *data) {
+  state->stats.transfers++;
+  if(i2c_send_sequence(file, sequence, length, data) < 0) return errno ? -errno : -EIO;
+  return 0;
+}
+
+/* With the file locked: nothing read ahead from the device is valid after a write. */
+static void forget(struct smbus_file *state) {
+  struct smbus_device *device = get_device(state);
+
+  if(!device) return;
+  memset(device->ahead, 0, sizeof(device->ahead));
+  memset(device->read_ns, 0, sizeof(device->read_ns));
+}
+
+/*
+  Locks the file if we know the address of the device and the adapter does plain I2C, so that the call can be done
+  with sequences.
+*/
+static struct smbus_file *lock_known(int file) {
+  struct smbus_file *state = get_file(file);
+
+  if(!state) return 0;
+  pthread_mutex_lock(&state->lock);
+  if(state->address >= 0 && state->plain_i2c) {
+    state->stats.calls++;
+    return state;
+  }
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+/* With the file locked. Writes command followed by data, then reads read_length bytes into result if nonzero. */
+static int32_t write_read(struct smbus_file *state, int file, const uint8_t *data, uint32_t length,
+                          uint8_t *result, uint32_t read_length) {
+  uint16_t sequence[2 + 2 + I2C_SMBUS_BLOCK_MAX + 2 + I2C_SMBUS_BLOCK_MAX];
+  uint32_t i = 0, j;
+
+  if(length) {
+    sequence[i++] = state->address << 1;
+    for(j = 0; j < length; j++) sequence[i++] = data[j];
+    if(read_length) sequence[i++] = I2C_RESTART;
+  }
+  if(read_length) {
+    sequence[i++] = (state->address << 1) | 1;
+    for(j = 0; j < read_length; j++) sequence[i++] = I2C_READ;
+  }
+  return transfer(state, file, sequence, i, result);
+}
+
+int32_t i2c_smbus_write_quick(int file, uint8_t value) {
+  return smbus_access(get_file(file), file, value, 0, I2C_SMBUS_QUICK, 0);
+}
+
+int32_t i2c_smbus_read_byte(int file) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  uint8_t value;
+  int32_t result;
+
+  if(!state) {
+    result = smbus_access(get_file(file), file, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data);
+    return result < 0 ? result : data.byte;
+  }
+  result = write_read(state, file, 0, 0, &value, 1);
+  pthread_mutex_unlock(&state->lock);
+  return result < 0 ? result : value;
+}
+
+int32_t i2c_smbus_write_byte(int file, uint8_t value) {
+  struct smbus_file *state = lock_known(file);
+  int32_t result;
+
+  if(!state) return smbus_access(get_file(file), file, I2C_SMBUS_WRITE, value, I2C_SMBUS_BYTE, 0);
+  forget(state);
+  result = write_read(state, file, &value, 1, 0, 0);
+  pthread_mutex_unlock(&state->lock);
+  return result;
+}
+
+/*
+  With the file locked: follows the run of consecutive reads the calling thread is in, learning its length when it
+  ends. Runs are followed per thread, as the reads of threads sharing a file are interleaved.
+*/
+static void learn(struct smbus_device *device, uint8_t command, uint64_t now) {
+  struct smbus_run *run = &device->trackers[0];
+  pthread_t self = pthread_self();
+  uint32_t i;
+
+  for(i = 0; i < RUN_TRACKERS; i++) {
+    if(device->trackers[i].ns && pthread_equal(device->trackers[i].thread, self)) break;
+    if(device->trackers[i].ns < run->ns) run = &device->trackers[i];
+  }
+  if(i < RUN_TRACKERS) {
+    run = &device->trackers[i];
+  } else {
+    run->thread = self;
+    run->start = run->next = command;
+  }
+
+  if(command == run->next && run->next > run->start && now - run->ns < READ_AHEAD_US * 1000ULL &&
+     run->next - run->start < MAX_RUN) {
+    run->next++;
+    if(run->next - run->start > device->runs[run->start]) device->runs[run->start] = run->next - run->start;
+  } else {
+    if(run->next > run->start) device->runs[run->start] = run->next - run->start;
+    run->start = command;
+    run->next = command + 1;
+  }
+  run->ns = now;
+}
+
+int32_t i2c_smbus_read_byte_data(int file, uint8_t command) {
+  uint64_t start_ns = i2c_monotonic_ns();
+  struct smbus_file *state = lock_known(file);
+  struct smbus_device *device;
+  union i2c_smbus_data data;
+  uint8_t burst[MAX_RUN];
+  uint64_t read_ns;
+  uint32_t length, i;
+  int32_t result;
+
+  if(!state || !(device = get_device(state))) {
+    if(state) pthread_mutex_unlock(&state->lock);
+    result = smbus_access(get_file(file), file, I2C_SMBUS_READ, command, I2C_SMBUS_BYTE_DATA, &data);
+    return result < 0 ? result : data.byte;
+  }
+
+  learn(device, command, start_ns);
+  if(BIT_SET(device->ahead, command) && start_ns - device->read_ns[command] < READ_AHEAD_US * 1000ULL) {
+    device->ahead[command >> 3] &= ~(1 << (command & 7));
+    state->stats.read_ahead_hits++;
+    result = device->values[command];
+  } else if(device->read_ns[command] >= start_ns) {
+    state->stats.shared_reads++;
+    result = device->values[command];
+  } else {
+    length = BIT_SET(auto_increment, device->address) ? device->runs[command] : 1;
+    if(length < 1) length = 1;
+    if(command + length > 0x100) length = 0x100 - command;
+    read_ns = i2c_monotonic_ns();
+    result = write_read(state, file, &command, 1, burst, length);
+    if(result == 0) {
+      for(i = 0; i < length; i++) {
+        device->values[command + i] = burst[i];
+        device->read_ns[command + i] = read_ns;
+        if(i > 0) device->ahead[(command + i) >> 3] |= 1 << ((command + i) & 7);
+      }
+      result = burst[0];
+    }
+  }
+  pthread_mutex_unlock(&state->lock);
+  return result;
+}
+
+int32_t i2c_smbus_write_byte_data(int file, uint8_t command, uint8_t value) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  uint8_t bytes[2];
+  int32_t result;
+
+  if(!state) {
+    data.byte = value;
+    return smbus_access(get_file(file), file, I2C_SMBUS_WRITE, command, I2C_SMBUS_BYTE_DATA, &data);
+  }
+  bytes[0] = command;
+  bytes[1] = value;
+  forget(state);
+  result = write_read(state, file, bytes, 2, 0, 0);
+  pthread_mutex_unlock(&state->lock);
+  return result;
+}
+
+int32_t i2c_smbus_read_word_data(int file, uint8_t command) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  uint8_t word[2];
+  int32_t result;
+
+  if(!state) {
+    result = smbus_access(get_file(file), file, I2C_SMBUS_READ, command, I2C_SMBUS_WORD_DATA, &data);
+    return result < 0 ? result : data.word;
+  }
+  result = write_read(state, file, &command, 1, word, 2);
+  pthread_mutex_unlock(&state->lock);
+  return result < 0 ? result : (word[0] | (word[1] << 8));
+}
+
+int32_t i2c_smbus_write_word_data(int file, uint8_t command, uint16_t value) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  uint8_t bytes[3];
+  int32_t result;
+
+  if(!state) {
+    data.word = value;
+    return smbus_access(get_file(file), file, I2C_SMBUS_WRITE, command, I2C_SMBUS_WORD_DATA, &data);
+  }
+  bytes[0] = command;
+  bytes[1] = value & 0xff;
+  bytes[2] = value >> 8;
+  forget(state);
+  result = write_read(state, file, bytes, 3, 0, 0);
+  pthread_mutex_unlock(&state->lock);
+  return result;
+}
+
+int32_t i2c_smbus_process_call(int file, uint8_t command, uint16_t value) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  uint8_t bytes[3], word[2];
+  int32_t result;
+
+  if(!state) {
+    data.word = value;
+    result = smbus_access(get_file(file), file, I2C_SMBUS_WRITE, command, I2C_SMBUS_PROC_CALL, &data);
+    return result < 0 ? result : data.word;
+  }
+  bytes[0] = command;
+  bytes[1] = value & 0xff;
+  bytes[2] = value >> 8;
+  forget(state);
+  result = write_read(state, file, bytes, 3, word, 2);
+  pthread_mutex_unlock(&state->lock);
+  return result < 0 ? result : (word[0] | (word[1] << 8));
+}
+
+/* The device sends the length first, which sequences cannot express: always the kernel's SMBus ioctl. */
+int32_t i2c_smbus_read_block_data(int file, uint8_t command, uint8_t *values) {
+  union i2c_smbus_data data;
+  int32_t result;
+
+  result = smbus_access(get_file(file), file, I2C_SMBUS_READ, command, I2C_SMBUS_BLOCK_DATA, &data);
+  if(result < 0) return result;
+  memcpy(values, &data.block[1], data.block[0]);
+  return data.block[0];
+}
+
+int32_t i2c_smbus_write_block_data(int file, uint8_t command, uint8_t length, const uint8_t *values) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  uint8_t bytes[2 + I2C_SMBUS_BLOCK_MAX];
+  int32_t result;
+
+  if(length > I2C_SMBUS_BLOCK_MAX) length = I2C_SMBUS_BLOCK_MAX;
+  if(!state) {
+    data.block[0] = length;
+    memcpy(&data.block[1], values, length);
+    return smbus_access(get_file(file), file, I2C_SMBUS_WRITE, command, I2C_SMBUS_BLOCK_DATA, &data);
+  }
+  bytes[0] = command;
+  bytes[1] = length;
+  memcpy(bytes + 2, values, length);
+  forget(state);
+  result = write_read(state, file, bytes, 2 + length, 0, 0);
+  pthread_mutex_unlock(&state->lock);
+  return result;
+}
+
+int32_t i2c_smbus_read_i2c_block_data(int file, uint8_t command, uint8_t length, uint8_t *values) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  int32_t result;
+
+  if(length > I2C_SMBUS_BLOCK_MAX) length = I2C_SMBUS_BLOCK_MAX;
+  if(!state) {
+    data.block[0] = length;
+    result = smbus_access(get_file(file), file, I2C_SMBUS_READ, command,
+                          length == 32 ? I2C_SMBUS_I2C_BLOCK_BROKEN : I2C_SMBUS_I2C_BLOCK_DATA, &data);
+    if(result < 0) return result;
+    memcpy(values, &data.block[1], data.block[0]);
+    return data.block[0];
+  }
+  result = write_read(state, file, &command, 1, values, length);
+  pthread_mutex_unlock(&state->lock);
+  return result < 0 ? result : length;
+}
+
+int32_t i2c_smbus_write_i2c_block_data(int file, uint8_t command, uint8_t length, const uint8_t *values) {
+  struct smbus_file *state = lock_known(file);
+  union i2c_smbus_data data;
+  uint8_t bytes[1 + I2C_SMBUS_BLOCK_MAX];
+  int32_t result;
+
+  if(length > I2C_SMBUS_BLOCK_MAX) length = I2C_SMBUS_BLOCK_MAX;
+  if(!state) {
+    data.block[0] = length;
+    memcpy(&data.block[1], values, length);
+    return smbus_access(get_file(file), file, I2C_SMBUS_WRITE, command, I2C_SMBUS_I2C_BLOCK_BROKEN, &data);
+  }
+  bytes[0] = command;
+  memcpy(bytes + 1, values, length);
+  forget(state);
+  result = write_read(state, file, bytes, 1 + length, 0, 0);
+  pthread_mutex_unlock(&state->lock);
+  return result;
+}
+
+/* As with block reads, the length comes from the device: always the kernel's SMBus ioctl. */
+int32_t i2c_smbus_block_process_call(int file, uint8_t command, uint8_t length, uint8_t *values) {
+  struct smbus_file *state = get_file(file);
+  union i2c_smbus_data data;
+  int32_t result;
+
+  if(length > I2C_SMBUS_BLOCK_MAX) length = I2C_SMBUS_BLOCK_MAX;
+  data.block[0] = length;
+  memcpy(&data.block[1], values, length);
+  if(state) {
+    pthread_mutex_lock(&state->lock);
+    forget(state);
+    pthread_mutex_unlock(&state->lock);
+  }
+  result = smbus_access(state, file, I2C_SMBUS_WRITE, command, I2C_SMBUS_BLOCK_PROC_CALL, &data);
+  if(result < 0) return result;
+  memcpy(values, &data.block[1], data.block[0]);
+  return data.block[0];
+}
+
+/*
+  The generic call that all the helpers of libi2c are built on: the kernel's SMBus ioctl with a size (I2C_SMBUS_BYTE
+  etc.). The sizes the helpers above know are done by them, the rest is passed on to the kernel.
+*/
+int32_t i2c_smbus_access(int file, char read_write, uint8_t command, int size, union i2c_smbus_data *data) {
+  struct smbus_file *state;
+  int32_t result;
+  int reading = (read_write == I2C_SMBUS_READ);
+
+  switch(size) {
+  case I2C_SMBUS_QUICK:
+    return i2c_smbus_write_quick(file, read_write);
+  case I2C_SMBUS_BYTE:
+    result = reading ? i2c_smbus_read_byte(file) : i2c_smbus_write_byte(file, command);
+    if(result >= 0 && reading) data->byte = result;
+    break;
+  case I2C_SMBUS_BYTE_DATA:
+    result = reading ? i2c_smbus_read_byte_data(file, command) : i2c_smbus_write_byte_data(file, command, data->byte);
+    if(result >= 0 && reading) data->byte = result;
+    break;
+  case I2C_SMBUS_WORD_DATA:
+    result = reading ? i2c_smbus_read_word_data(file, command) : i2c_smbus_write_word_data(file, command, data->word);
+    if(result >= 0 && reading) data->word = result;
+    break;
+  case I2C_SMBUS_PROC_CALL:
+    result = i2c_smbus_process_call(file, command, data->word);
+    if(result >= 0) data->word = result;
+    break;
+  case I2C_SMBUS_BLOCK_DATA:
+    if(reading) {
+      result = i2c_smbus_read_block_data(file, command, &data->block[1]);
+      if(result >= 0) data->block[0] = result;
+    } else {
+      result = i2c_smbus_write_block_data(file, command, data->block[0], &data->block[1]);
+    }
+    break;
+  case I2C_SMBUS_I2C_BLOCK_BROKEN:
+  case I2C_SMBUS_I2C_BLOCK_DATA:
+    if(reading) {
+      result = i2c_smbus_read_i2c_block_data(file, command, data->block[0], &data->block[1]);
+      if(result >= 0) data->block[0] = result;
+    } else {
+      result = i2c_smbus_write_i2c_block_data(file, command, data->block[0], &data->block[1]);
+    }
+    break;
+  case I2C_SMBUS_BLOCK_PROC_CALL:
+    result = i2c_smbus_block_process_call(file, command, data->block[0], &data->block[1]);
+    if(result >= 0) data->block[0] = result;
+    break;
+  default:
+    if((state = get_file(file)) && !reading) {
+      pthread_mutex_lock(&state->lock);
+      if(state->address >= 0) forget(state);
+      pthread_mutex_unlock(&state->lock);
+    }
+    return smbus_access(state, file, read_write, command, size, data);
+  }
+  return result < 0 ? result : 0;
+}
@@ -0,0 +1,67 @@
+/*
+  lsquaredc_smbus.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_SMBUS_H
+#define LSQUAREDC_SMBUS_H
+
+#include <stdint.h>
+
+/*
+  The SMBus helpers of libi2c (i2c-tools), with the same names and signatures, so that code written for them can be
+  relinked against lsquaredc. See lsquaredc_smbus.c.
+*/
+
+union i2c_smbus_data;
+
+struct i2c_smbus_stats {
+  uint32_t calls;
+  uint32_t transfers;                   /* ioctls the calls needed */
+  uint32_t read_ahead_hits;             /* reads served from an earlier burst read */
+  uint32_t shared_reads;                /* reads served by a read another thread did while we waited */
+};
+
+int32_t i2c_smbus_access(int file, char read_write, uint8_t command, int size, union i2c_smbus_data *data);
+int32_t i2c_smbus_write_quick(int file, uint8_t value);
+int32_t i2c_smbus_read_byte(int file);
+int32_t i2c_smbus_write_byte(int file, uint8_t value);
+int32_t i2c_smbus_read_byte_data(int file, uint8_t command);
+int32_t i2c_smbus_write_byte_data(int file, uint8_t command, uint8_t value);
+int32_t i2c_smbus_read_word_data(int file, uint8_t command);
+int32_t i2c_smbus_write_word_data(int file, uint8_t command, uint16_t value);
+int32_t i2c_smbus_process_call(int file, uint8_t command, uint16_t value);
+int32_t i2c_smbus_read_block_data(int file, uint8_t command, uint8_t *values);
+int32_t i2c_smbus_write_block_data(int file, uint8_t command, uint8_t length, const uint8_t *values);
+int32_t i2c_smbus_read_i2c_block_data(int file, uint8_t command, uint8_t length, uint8_t *values);
+int32_t i2c_smbus_write_i2c_block_data(int file, uint8_t command, uint8_t length, const uint8_t *values);
+int32_t i2c_smbus_block_process_call(int file, uint8_t command, uint8_t length, uint8_t *values);
+
+int i2c_smbus_set_slave(int file, int address);
+
+void i2c_smbus_release(int file);
+
+void i2c_smbus_auto_increment(int address, int enable);
+
+int i2c_smbus_get_stats(int file, struct i2c_smbus_stats *stats);
+
+#endif
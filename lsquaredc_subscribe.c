@@ -0,0 +1,288 @@
+/*
+  lsquaredc_subscribe.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "lsquaredc.h"
+#include "lsquaredc_poll.h"
+#include "lsquaredc_subscribe.h"
+
+/*
+  Subscriptions: consumers say which registers of which device they want and how often, and we work out how to read
+  them. Overlapping or nearly adjacent register ranges of the same device are merged into a single burst read, which is
+  polled at the highest rate any of its subscribers asked for. Every subscriber then gets every Nth result, so that it
+  sees (at least) the rate it asked for.
+
+  The schedule is harmonic: the period of every burst is the fastest requested period times a power of two. All bursts
+  therefore fall on a common time grid, and the poller runs them in the same wakeups whenever they coincide.
+
+  The schedule is recomputed from scratch whenever a subscription is added or removed, which is rare. Subscribers may
+  subscribe and unsubscribe from their callbacks; the schedule is then recomputed once the delivery is over, as the
+  rebuild replaces the burst that is being delivered.
+*/
+
+#define MERGE_GAP 4                 /* reading up to this many unwanted registers is cheaper than a new transaction */
+#define MAX_BURST_LENGTH 128
+
+struct i2c_subscriptions *i2c_subscriptions_create(struct i2c_poller *poller) {
+  struct i2c_subscriptions *subscriptions = calloc(1, sizeof(struct i2c_subscriptions));
+
+  if(subscriptions) subscriptions->poller = poller;
+  return subscriptions;
+}
+
+static int rebuild(struct i2c_subscriptions *subscriptions);
+
+static void fan_out(struct i2c_poll_task *task, uint8_t *data, uint32_t data_length, uint64_t timestamp_ns,
+                    void *user) {
+  struct i2c_burst *burst = user;
+  struct i2c_subscriptions *subscriptions = burst->owner;
+  struct i2c_subscription *subscription;
+
+  (void)task; (void)data_length;
+  subscriptions->delivering = 1;
+  for(subscription = subscriptions->subscriptions; subscription; subscription = subscription->next) {
+    if(subscription->burst != burst || subscription->removed) continue;
+    if(++subscription->phase < subscription->divisor) continue;
+    subscription->phase = 0;
+    subscription->deliver(burst->address, subscription->first_register,
+                          data + (subscription->first_register - burst->first_register), subscription->count,
+                          timestamp_ns, subscription->user);
+  }
+  subscriptions->delivering = 0;
+  /* burst is freed here, but its task stays valid until the poller is done with it (see i2c_poll_remove()) */
+  if(subscriptions->dirty) rebuild(subscriptions);
+}
+
+static void remove_bursts(struct i2c_subscriptions *subscriptions) {
+  struct i2c_burst *burst;
+
+  while((burst = subscriptions->bursts)) {
+    subscriptions->bursts = burst->next;
+    i2c_poll_remove(subscriptions->poller, burst->task);
+    free(burst->sequence);
+    free(burst);
+  }
+}
+
+/* Frees the subscriptions that were unsubscribed during a delivery. */
+static void remove_subscriptions(struct i2c_subscriptions *subscriptions) {
+  struct i2c_subscription **link = &subscriptions->subscriptions;
+  struct i2c_subscription *subscription;
+
+  while((subscription = *link)) {
+    if(subscription->removed) {
+      *link = subscription->next;
+      free(subscription);
+    } else {
+      link = &subscription->next;
+    }
+  }
+}
+
+static int compare_subscriptions(const void *a, const void *b) {
+  const struct i2c_subscription *x = *(const struct i2c_subscription * const *)a;
+  const struct i2c_subscription *y = *(const struct i2c_subscription * const *)b;
+
+  if(x->handle != y->handle) return x->handle - y->handle;
+  if(x->address != y->address) return x->address - y->address;
+  return x->first_register - y->first_register;
+}
+
+static struct i2c_burst *add_burst(struct i2c_subscriptions *subscriptions, struct i2c_subscription *first,
+                                   uint32_t end, uint32_t period_us) {
+  struct i2c_burst *burst = calloc(1, sizeof(struct i2c_burst));
+  uint32_t i;
+
+  if(!burst) return 0;
+  burst->owner = subscriptions;
+  burst->address = first->address;
+  burst->first_register = first->first_register;
+  burst->count = end - first->first_register;
+  burst->period_us = period_us;
+  burst->sequence = malloc((4 + burst->count) * sizeof(uint16_t));
+  if(!burst->sequence) {
+    free(burst);
+    return 0;
+  }
+  burst->sequence[0] = burst->address;
+  burst->sequence[1] = burst->first_register;
+  burst->sequence[2] = I2C_RESTART;
+  burst->sequence[3] = burst->address | 1;
+  for(i = 0; i < burst->count; i++) burst->sequence[4 + i] = I2C_READ;
+
+  burst->task = i2c_poll_add(subscriptions->poller, first->handle, burst->sequence, 4 + burst->count,
+                             period_us, period_us, fan_out, burst);
+  if(!burst->task) {
+    free(burst->sequence);
+    free(burst);
+    return 0;
+  }
+  burst->task->publish_always = 1;
+  burst->next = subscriptions->bursts;
+  subscriptions->bursts = burst;
+  return burst;
+}
+
+/* Bursts are also limited by the longest read the adapter can do. */
+static uint32_t burst_limit(int handle) {
+  struct i2c_limits limits;
+
+  if(i2c_get_limits(handle, &limits) < 0) return MAX_BURST_LENGTH;
+  if(limits.max_read_length && limits.max_read_length < MAX_BURST_LENGTH) return limits.max_read_length;
+  return MAX_BURST_LENGTH;
+}
+
+/* Largest base_us * 2^k that is not longer than period_us. */
+static uint32_t harmonic_period(uint32_t base_us, uint32_t period_us) {
+  uint32_t harmonic = base_us;
+
+  while(harmonic <= period_us / 2) harmonic *= 2;
+  return harmonic;
+}
+
+static int rebuild(struct i2c_subscriptions *subscriptions) {
+  struct i2c_subscription **sorted;
+  struct i2c_subscription *subscription;
+  struct i2c_burst *burst;
+  uint32_t count = 0, i, j, k;
+  uint32_t base_us = UINT32_MAX;
+  uint32_t end, period_us, limit;
+  int result = 0;
+
+  if(subscriptions->delivering) {
+    subscriptions->dirty = 1;
+    return 0;
+  }
+  subscriptions->dirty = 0;
+  remove_subscriptions(subscriptions);
+  remove_bursts(subscriptions);
+  for(subscription = subscriptions->subscriptions; subscription; subscription = subscription->next) {
+    count++;
+    if(subscription->period_us < base_us) base_us = subscription->period_us;
+  }
+  if(count == 0) return 0;
+
+  sorted = malloc(count * sizeof(struct i2c_subscription *));
+  if(!sorted) return -1;
+  for(i = 0, subscription = subscriptions->subscriptions; subscription; subscription = subscription->next) {
+    sorted[i++] = subscription;
+  }
+  qsort(sorted, count, sizeof(struct i2c_subscription *), compare_subscriptions);
+
+  for(i = 0; i < count; i = j) {
+    /* extend the burst while the next range is on the same device and close enough */
+    end = sorted[i]->first_register + sorted[i]->count;
+    period_us = sorted[i]->period_us;
+    limit = burst_limit(sorted[i]->handle);
+    for(j = i + 1; j < count; j++) {
+      if(sorted[j]->handle != sorted[i]->handle || sorted[j]->address != sorted[i]->address) break;
+      if(sorted[j]->first_register > end + MERGE_GAP) break;
+      if(sorted[j]->first_register + sorted[j]->count > (uint32_t)sorted[i]->first_register + limit) break;
+      if(sorted[j]->first_register + sorted[j]->count > end) end = sorted[j]->first_register + sorted[j]->count;
+      if(sorted[j]->period_us < period_us) period_us = sorted[j]->period_us;
+    }
+
+    period_us = harmonic_period(base_us, period_us);
+    burst = add_burst(subscriptions, sorted[i], end, period_us);
+    if(!burst) {
+      result = -1;
+      break;
+    }
+    for(k = i; k < j; k++) {
+      sorted[k]->burst = burst;
+      sorted[k]->divisor = sorted[k]->period_us / period_us;    /* rounds down, so never slower than requested */
+      sorted[k]->phase = sorted[k]->divisor - 1;                /* deliver the first read */
+    }
+  }
+  free(sorted);
+  return result;
+}
+
+
+/*
+  Subscribes to count registers of a device starting at first_register, delivered at (at least) rate_hz. The register
+  address of the device must auto-increment on reads, and the range must fit in a single read of the adapter (see
+  i2c_get_limits()). From a subscriber callback, the subscription starts after the callback. Returns the subscription,
+  or 0 in case of an error.
+*/
+struct i2c_subscription *i2c_subscribe(struct i2c_subscriptions *subscriptions, int handle, uint8_t address,
+                                       uint8_t first_register, uint32_t count, uint32_t rate_hz,
+                                       i2c_subscriber_fn deliver, void *user) {
+  struct i2c_subscription *subscription;
+  struct i2c_limits limits;
+
+  if(count == 0 || count > burst_limit(handle) || first_register + count > 0x100) return 0;
+  if(i2c_get_limits(handle, &limits) == 0 && (limits.flags & I2C_LIMIT_NO_COMBINED)) return 0;
+  if(rate_hz == 0 || rate_hz > 1000000 || !deliver) return 0;
+  subscription = calloc(1, sizeof(struct i2c_subscription));
+  if(!subscription) return 0;
+  subscription->handle = handle;
+  subscription->address = address & 0xfe;
+  subscription->first_register = first_register;
+  subscription->count = count;
+  subscription->period_us = 1000000 / rate_hz;
+  subscription->deliver = deliver;
+  subscription->user = user;
+
+  subscription->next = subscriptions->subscriptions;
+  subscriptions->subscriptions = subscription;
+  if(rebuild(subscriptions) < 0) {
+    i2c_unsubscribe(subscriptions, subscription);
+    return 0;
+  }
+  return subscription;
+}
+
+
+
+/*
+  Ends a subscription. From a subscriber callback, the subscription is not delivered any more and freed when the
+  schedule is rebuilt, after the callback. Returns 0 on success.
+*/
+int i2c_unsubscribe(struct i2c_subscriptions *subscriptions, struct i2c_subscription *subscription) {
+  struct i2c_subscription **link = &subscriptions->subscriptions;
+
+  while(*link && *link != subscription) link = &(*link)->next;
+  if(!*link || subscription->removed) return -1;
+  if(subscriptions->delivering) {
+    subscription->removed = 1;
+  } else {
+    *link = subscription->next;
+    free(subscription);
+  }
+  return rebuild(subscriptions);
+}
+
+void i2c_subscriptions_destroy(struct i2c_subscriptions *subscriptions) {
+  struct i2c_subscription *subscription;
+
+  if(!subscriptions) return;
+  remove_bursts(subscriptions);
+  while((subscription = subscriptions->subscriptions)) {
+    subscriptions->subscriptions = subscription->next;
+    free(subscription);
+  }
+  free(subscriptions);
+}
@@ -0,0 +1,82 @@
+/*
+  lsquaredc_subscribe.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_SUBSCRIBE_H
+#define LSQUAREDC_SUBSCRIBE_H
+
+#include <stdint.h>
+#include "lsquaredc_poll.h"
+
+/* data holds count registers starting at first_register. */
+typedef void (*i2c_subscriber_fn)(uint8_t address, uint8_t first_register, uint8_t *data, uint32_t count,
+                                  uint64_t timestamp_ns, void *user);
+
+struct i2c_burst;
+
+struct i2c_subscription {
+  int handle;
+  uint8_t address;
+  uint8_t first_register;
+  uint32_t count;
+  uint32_t period_us;                   /* requested */
+  uint32_t divisor;                     /* delivered every divisor-th read of the burst */
+  uint32_t phase;
+  i2c_subscriber_fn deliver;
+  void *user;
+  struct i2c_burst *burst;
+  int removed;                          /* unsubscribed during a delivery, freed by the deferred rebuild */
+  struct i2c_subscription *next;
+};
+
+/* A merged read of a register range of one device, serving one or more subscriptions. */
+struct i2c_burst {
+  struct i2c_subscriptions *owner;
+  struct i2c_poll_task *task;
+  uint8_t address;
+  uint8_t first_register;
+  uint32_t count;
+  uint32_t period_us;
+  uint16_t *sequence;
+  struct i2c_burst *next;
+};
+
+struct i2c_subscriptions {
+  struct i2c_poller *poller;
+  struct i2c_subscription *subscriptions;
+  struct i2c_burst *bursts;
+  int delivering;                       /* in a subscriber callback: rebuilds wait until it returns */
+  int dirty;                            /* a rebuild is waiting */
+};
+
+struct i2c_subscriptions *i2c_subscriptions_create(struct i2c_poller *poller);
+
+struct i2c_subscription *i2c_subscribe(struct i2c_subscriptions *subscriptions, int handle, uint8_t address,
+                                       uint8_t first_register, uint32_t count, uint32_t rate_hz,
+                                       i2c_subscriber_fn deliver, void *user);
+
+int i2c_unsubscribe(struct i2c_subscriptions *subscriptions, struct i2c_subscription *subscription);
+
+void i2c_subscriptions_destroy(struct i2c_subscriptions *subscriptions);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+  lsquaredc_verify.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "lsquaredc.h"
+#include "lsquaredc_adapter.h"
+#include "lsquaredc_verify.h"
+
+/*
+  Batched verification of register writes. Reading back every register right after writing it doubles the time an
+  init phase takes. Instead, the writes of the init phase are recorded (by parsing the sequences, so existing init
+  tables need no changes), and verified afterwards with as few block reads as possible: the registers written to a
+  device are grouped into runs, small gaps being read along rather than starting a new transfer. Each run is compared
+  with a single memcmp(), against a buffer in which the registers we do not verify have been filled in from what was
+  read, and only when that fails do we go through it byte by byte to make the list of mismatches.
+
+  The device descriptor says which registers not to verify (write-only ones that read back differently, self-clearing
+  bits, registers that change on their own) and which ones must not be read at all, because reading them has side
+  effects: runs never span those. Devices without auto-incrementing register addresses are read one register at a
+  time.
+*/
+
+#define MERGE_GAP 4                 /* reading up to this many unwanted registers is cheaper than a new transaction */
+
+#define BIT_SET(bitmap, i) ((bitmap)[(i) >> 3] & (1 << ((i) & 7)))
+
+static void set_bits(uint8_t *bitmap, uint8_t first, uint32_t count) {
+  uint32_t i;
+
+  for(i = first; i < (uint32_t)first + count && i < 0x100; i++) bitmap[i >> 3] |= 1 << (i & 7);
+}
+
+void i2c_verify_init(struct i2c_verifier *verifier) {
+  memset(verifier, 0, sizeof(struct i2c_verifier));
+}
+
+/* Starts recording writes to the device at address (8-bit form) on handle. Returns the device, or 0 if out of memory. */
+struct i2c_verify_device *i2c_verify_add_device(struct i2c_verifier *verifier, int handle, uint8_t address,
+                                                int auto_increment) {
+  struct i2c_verify_device *device = calloc(1, sizeof(struct i2c_verify_device));
+
+  if(!device) return 0;
+  device->handle = handle;
+  device->address = address & 0xfe;
+  device->auto_increment = auto_increment;
+  device->next = verifier->devices;
+  verifier->devices = device;
+  return device;
+}
+
+/* Registers that are written but do not read back what was written. */
+void i2c_verify_skip(struct i2c_verify_device *device, uint8_t first_register, uint32_t count) {
+  set_bits(device->skip, first_register, count);
+}
+
+/* Registers that must never be read by the verifier. */
+void i2c_verify_no_read(struct i2c_verify_device *device, uint8_t first_register, uint32_t count) {
+  set_bits(device->skip, first_register, count);
+  set_bits(device->no_read, first_register, count);
+}
+
+static struct i2c_verify_device *find_device(struct i2c_verifier *verifier, int handle, uint8_t address) {
+  struct i2c_verify_device *device;
+
+  for(device = verifier->devices; device; device = device->next) {
+    if(device->handle == handle && device->address == address) return device;
+  }
+  return 0;
+}
+
+/* Records the register writes in a sequence (that has been sent). Transactions to devices we do not know are ignored. */
+void i2c_verify_record(struct i2c_verifier *verifier, int handle, const uint16_t *sequence, uint32_t sequence_length) {
+  struct i2c_verify_device *device;
+  uint32_t start, end, i;
+  uint8_t reg;
+
+  for(start = 0; start < sequence_length; start = end + 1) {
+    for(end = start + 1; end < sequence_length && sequence[end] != I2C_RESTART; end++);
+    /* a write of at least one byte after the register address */
+    if((sequence[start] & 1) || end - start < 3) continue;
+    device = find_device(verifier, handle, sequence[start] & 0xfe);
+    if(!device) continue;
+    reg = sequence[start + 1];
+    for(i = start + 2; i < end; i++) {
+      device->expected[reg] = sequence[i];
+      device->written[reg >> 3] |= 1 << (reg & 7);
+      if(device->auto_increment) reg++;
+    }
+  }
+}
+
+/* i2c_send_sequence() that records the writes it did. */
+int i2c_verify_send(struct i2c_verifier *verifier, int handle, uint16_t *sequence, uint32_t sequence_length,
+                    uint8_t *received_data) {
+  int result = i2c_send_sequence(handle, sequence, sequence_length, received_data);
+
+  if(result >= 0) i2c_verify_record(verifier, handle, sequence, sequence_length);
+  return result;
+}
+
+static int wanted(struct i2c_verify_device *device, uint32_t reg) {
+  return BIT_SET(device->written, reg) && !BIT_SET(device->skip, reg);
+}
+
+/* The last register of the run starting at first: wanted registers with gaps of at most MERGE_GAP readable ones. */
+static uint32_t run_end(struct i2c_verify_device *device, uint32_t first) {
+  uint32_t last = first, reg;
+
+  if(!device->auto_increment) return first;
+  for(reg = first + 1; reg < 0x100 && reg - last <= MERGE_GAP + 1; reg++) {
+    if(BIT_SET(device->no_read, reg)) break;
+    if(wanted(device, reg)) last = reg;
+  }
+  return last;
+}
+
+
+/*
+  Reads back all recorded registers and compares them with what was written. Up to capacity mismatches are stored in
+  mismatches. Returns the number of mismatches (which may be larger than capacity), or -1 in case of an error.
+*/
+int i2c_verify_check(struct i2c_verifier *verifier, struct i2c_verify_mismatch *mismatches, uint32_t capacity) {
+  struct i2c_verify_device *device;
+  uint8_t actual[0x100], compare[0x100];
+  uint32_t reg, last, count, i;
+  int found = 0;
+
+  verifier->bursts = 0;
+  verifier->registers = 0;
+  for(device = verifier->devices; device; device = device->next) {
+    for(reg = 0; reg < 0x100; reg = last + 1) {
+      last = reg;
+      if(!wanted(device, reg)) continue;
+      last = run_end(device, reg);
+      count = last - reg + 1;
+      if(i2c_read_block(device->handle, device->address, reg, actual, count) < 0) return -1;
+      verifier->bursts++;
+
+      for(i = 0; i < count; i++) {
+        if(wanted(device, reg + i)) {
+          compare[i] = device->expected[reg + i];
+          verifier->registers++;
+        } else {
+          compare[i] = actual[i];
+        }
+      }
+      if(memcmp(compare, actual, count) == 0) continue;
+      for(i = 0; i < count; i++) {
+        if(compare[i] == actual[i]) continue;
+        if((uint32_t)found < capacity) {
+          mismatches[found].address = device->address;
+          mismatches[found].reg = reg + i;
+          mismatches[found].expected = compare[i];
+          mismatches[found].actual = actual[i];
+        }
+        found++;
+      }
+    }
+  }
+  return found;
+}
+
+/* Forgets the recorded writes, e.g. to start recording the next phase. */
+void i2c_verify_clear(struct i2c_verifier *verifier) {
+  struct i2c_verify_device *device;
+
+  for(device = verifier->devices; device; device = device->next) memset(device->written, 0, sizeof(device->written));
+}
+
+void i2c_verify_free(struct i2c_verifier *verifier) {
+  struct i2c_verify_device *device;
+
+  while((device = verifier->devices)) {
+    verifier->devices = device->next;
+    free(device);
+  }
+}
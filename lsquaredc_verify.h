@@ -0,0 +1,75 @@
+/*
+  lsquaredc_verify.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_VERIFY_H
+#define LSQUAREDC_VERIFY_H
+
+#include <stdint.h>
+
+/* A device whose register writes are recorded for verification, see lsquaredc_verify.c. */
+struct i2c_verify_device {
+  int handle;
+  uint8_t address;                      /* 8-bit form, as in sequences */
+  int auto_increment;                   /* register address auto-increments on reads and writes */
+  uint8_t skip[32];                     /* registers never verified (write-only, self-clearing, volatile), a bitmap */
+  uint8_t no_read[32];                  /* registers that must not even be read (reading has side effects) */
+  uint8_t written[32];                  /* registers written since the last i2c_verify_clear(), a bitmap */
+  uint8_t expected[256];                /* the last value written to each register */
+  struct i2c_verify_device *next;
+};
+
+struct i2c_verifier {
+  struct i2c_verify_device *devices;
+  uint32_t bursts;                      /* block reads done by the last i2c_verify_check() */
+  uint32_t registers;                   /* registers it verified */
+};
+
+struct i2c_verify_mismatch {
+  uint8_t address;
+  uint8_t reg;
+  uint8_t expected;
+  uint8_t actual;
+};
+
+void i2c_verify_init(struct i2c_verifier *verifier);
+
+struct i2c_verify_device *i2c_verify_add_device(struct i2c_verifier *verifier, int handle, uint8_t address,
+                                                int auto_increment);
+
+void i2c_verify_skip(struct i2c_verify_device *device, uint8_t first_register, uint32_t count);
+
+void i2c_verify_no_read(struct i2c_verify_device *device, uint8_t first_register, uint32_t count);
+
+void i2c_verify_record(struct i2c_verifier *verifier, int handle, const uint16_t *sequence, uint32_t sequence_length);
+
+int i2c_verify_send(struct i2c_verifier *verifier, int handle, uint16_t *sequence, uint32_t sequence_length,
+                    uint8_t *received_data);
+
+int i2c_verify_check(struct i2c_verifier *verifier, struct i2c_verify_mismatch *mismatches, uint32_t capacity);
+
+void i2c_verify_clear(struct i2c_verifier *verifier);
+
+void i2c_verify_free(struct i2c_verifier *verifier);
+
+#endif
@@ -0,0 +1,245 @@
+/*
+  lsquaredc_wheel.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "lsquaredc_wheel.h"
+
+/*
+  A hierarchical timer wheel (Varghese & Lauck), used by the poller so that scheduling costs O(1) per task no matter
+  how many tasks there are. There are four levels of 64 slots. Level 0 slots are one tick each, a level 1 slot covers 64
+  ticks, a level 2 slot 4096 ticks, and so on. A timer goes into the lowest level whose range covers its expiry time.
+  Every 64 ticks the current slot of the level above is "cascaded": its timers are redistributed to the lower levels,
+  so by the time a timer expires it is always in a level 0 slot.
+
+  Timers further in the future than the wheel covers (2^24 ticks) are parked in the top level and re-inserted when they
+  get cascaded. A bitmap of non-empty slots per level makes finding the next expiry cheap.
+*/
+
+#define LEVEL_SHIFT(level) ((level) * I2C_WHEEL_BITS)
+#define SLOT_MASK (I2C_WHEEL_SLOTS - 1)
+#define WHEEL_RANGE ((uint64_t)1 << (I2C_WHEEL_LEVELS * I2C_WHEEL_BITS))
+
+void i2c_wheel_init(struct i2c_wheel *wheel, uint64_t start_ns, uint64_t tick_ns) {
+  memset(wheel, 0, sizeof(struct i2c_wheel));
+  wheel->start_ns = start_ns;
+  wheel->tick_ns = tick_ns ? tick_ns : 1;
+}
+
+static void place(struct i2c_wheel *wheel, struct i2c_timer *timer) {
+  uint64_t expires = timer->expires;
+  uint64_t delta = expires - wheel->now;
+  uint32_t level;
+  uint32_t slot;
+
+  if(delta >= WHEEL_RANGE) expires = wheel->now + WHEEL_RANGE - 1;      /* parked, see above */
+  for(level = 0; level < I2C_WHEEL_LEVELS - 1; level++) {
+    if(delta < ((uint64_t)1 << LEVEL_SHIFT(level + 1))) break;
+  }
+  slot = (expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+
+  timer->next = wheel->slots[level][slot];
+  if(timer->next) timer->next->pprev = &timer->next;
+  timer->pprev = &wheel->slots[level][slot];
+  wheel->slots[level][slot] = timer;
+  wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+static uint64_t ticks_of(struct i2c_wheel *wheel, uint64_t ns) {
+  return (ns > wheel->start_ns) ? (ns - wheel->start_ns) / wheel->tick_ns : 0;
+}
+
+static void arm(struct i2c_wheel *wheel, struct i2c_timer *timer, uint64_t ticks) {
+  if(timer->pprev) i2c_wheel_cancel(wheel, timer);
+  if(ticks <= wheel->now) ticks = wheel->now + 1;
+  timer->expires = ticks;
+  place(wheel, timer);
+  wheel->count++;
+}
+
+/* Arms a timer to expire at expires_ns (rounded up to the next tick). Times in the past expire on the next tick. */
+void i2c_wheel_add(struct i2c_wheel *wheel, struct i2c_timer *timer, uint64_t expires_ns) {
+  arm(wheel, timer, ticks_of(wheel, expires_ns + wheel->tick_ns - 1));
+}
+
+
+/*
+  Like i2c_wheel_add(), but the timer may expire anywhere between expires_ns and expires_ns + slack_ns. Within that
+  window we pick the tick with the most trailing zero bits (the same trick as the Linux kernel's timer slack), so timers
+  whose windows overlap end up on the same tick and share a wakeup, without any knowledge of each other.
+*/
+void i2c_wheel_add_slack(struct i2c_wheel *wheel, struct i2c_timer *timer, uint64_t expires_ns, uint64_t slack_ns) {
+  uint64_t ticks = ticks_of(wheel, expires_ns + wheel->tick_ns - 1);
+  uint64_t limit = ticks_of(wheel, expires_ns + slack_ns);
+  uint64_t mask;
+
+  if(limit > ticks) {
+    mask = ((uint64_t)1 << (63 - __builtin_clzll(ticks ^ limit))) - 1;
+    ticks = limit & ~mask;
+  }
+  arm(wheel, timer, ticks);
+}
+
+void i2c_wheel_cancel(struct i2c_wheel *wheel, struct i2c_timer *timer) {
+  struct i2c_timer **first = &wheel->slots[0][0];
+  ptrdiff_t index;
+
+  if(!timer->pprev) return;
+  *timer->pprev = timer->next;
+  if(timer->next) timer->next->pprev = timer->pprev;
+
+  /* if the timer was the head of its slot, the slot may now be empty */
+  index = timer->pprev - first;
+  if(index >= 0 && index < I2C_WHEEL_LEVELS * I2C_WHEEL_SLOTS && !*timer->pprev) {
+    wheel->occupied[index / I2C_WHEEL_SLOTS] &= ~((uint64_t)1 << (index % I2C_WHEEL_SLOTS));
+  }
+  timer->pprev = 0;
+  timer->next = 0;
+  wheel->count--;
+}
+
+static struct i2c_timer *take_slot(struct i2c_wheel *wheel, uint32_t level, uint32_t slot) {
+  struct i2c_timer *list = wheel->slots[level][slot];
+
+  wheel->slots[level][slot] = 0;
+  wheel->occupied[level] &= ~((uint64_t)1 << slot);
+  return list;
+}
+
+/* Called when the current tick is a multiple of 64: refills the lower levels from the levels above. */
+static void cascade(struct i2c_wheel *wheel) {
+  struct i2c_timer *timer, *next;
+  uint32_t level;
+  uint32_t slot;
+
+  for(level = 1; level < I2C_WHEEL_LEVELS; level++) {
+    slot = (wheel->now >> LEVEL_SHIFT(level)) & SLOT_MASK;
+    for(timer = take_slot(wheel, level, slot); timer; timer = next) {
+      next = timer->next;
+      place(wheel, timer);
+    }
+    if(slot != 0) break;
+  }
+}
+
+
+/*
+  Advances the wheel to now_ns and returns the timers that expired, as a list linked through next, in expiry order. The
+  returned timers are no longer armed.
+*/
+struct i2c_timer *i2c_wheel_advance(struct i2c_wheel *wheel, uint64_t now_ns) {
+  struct i2c_timer *expired = 0;
+  struct i2c_timer **tail = &expired;
+  struct i2c_timer *timer;
+  uint64_t target;
+  uint64_t limit;
+  uint64_t bits;
+  uint32_t first, last, slot;
+
+  if(now_ns < wheel->start_ns) return 0;
+  target = (now_ns - wheel->start_ns) / wheel->tick_ns;
+
+  while(wheel->now < target) {
+    /* expire level 0 slots up to the end of the current rotation (or the target), skipping empty ones */
+    limit = wheel->now | SLOT_MASK;
+    if(limit > target) limit = target;
+    first = (wheel->now & SLOT_MASK) + 1;
+    last = limit & SLOT_MASK;
+    bits = (first > last) ? 0 : (wheel->occupied[0] >> first) << first;
+    if(last < SLOT_MASK) bits &= ((uint64_t)1 << (last + 1)) - 1;
+    while(bits) {
+      slot = __builtin_ctzll(bits);
+      bits &= bits - 1;
+      for(timer = take_slot(wheel, 0, slot); timer; timer = timer->next) {
+        timer->pprev = 0;
+        wheel->count--;
+        *tail = timer;
+        tail = &timer->next;
+      }
+    }
+    wheel->now = limit;
+
+    if(wheel->now < target) {
+      wheel->now++;
+      cascade(wheel);
+      for(timer = take_slot(wheel, 0, 0); timer; timer = timer->next) {
+        timer->pprev = 0;
+        wheel->count--;
+        *tail = timer;
+        tail = &timer->next;
+      }
+    }
+  }
+  *tail = 0;
+  return expired;
+}
+
+/* Start tick of the first non-empty slot of a level. */
+static uint64_t next_slot_tick(struct i2c_wheel *wheel, uint32_t level, uint32_t *slot) {
+  uint32_t shift = LEVEL_SHIFT(level);
+  uint64_t span = (uint64_t)1 << (shift + I2C_WHEEL_BITS);
+  uint64_t base = wheel->now & ~(span - 1);
+  uint32_t current = (wheel->now >> shift) & SLOT_MASK;
+  uint64_t bits = wheel->occupied[level];
+  uint64_t later = (current == SLOT_MASK) ? 0 : (bits >> (current + 1)) << (current + 1);
+
+  if(later) {
+    *slot = __builtin_ctzll(later);
+    return base + ((uint64_t)*slot << shift);
+  }
+  /* slots at or before the current one belong to the next rotation */
+  *slot = __builtin_ctzll(bits);
+  return base + span + ((uint64_t)*slot << shift);
+}
+
+
+/*
+  Returns the time of the next tick at which a timer expires, or UINT64_MAX if no timers are armed. Level 0 slots hold a
+  single tick each, so there the bitmap is enough. For the higher levels the first non-empty slot has to be searched for
+  its earliest timer, but only when that slot starts before the best candidate so far, which is rarely the case when
+  the wheel is busy.
+*/
+uint64_t i2c_wheel_next_ns(struct i2c_wheel *wheel) {
+  struct i2c_timer *timer;
+  uint64_t next = UINT64_MAX;
+  uint64_t tick;
+  uint32_t level;
+  uint32_t slot;
+
+  if(wheel->count == 0) return UINT64_MAX;
+  for(level = 0; level < I2C_WHEEL_LEVELS; level++) {
+    if(!wheel->occupied[level]) continue;
+    tick = next_slot_tick(wheel, level, &slot);
+    if(tick >= next) continue;
+    if(level == 0) {
+      next = tick;
+      continue;
+    }
+    for(timer = wheel->slots[level][slot]; timer; timer = timer->next) {
+      if(timer->expires < next) next = timer->expires;
+    }
+  }
+  return wheel->start_ns + next * wheel->tick_ns;
+}
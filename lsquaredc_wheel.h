@@ -0,0 +1,62 @@
+/*
+  lsquaredc_wheel.h
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LSQUAREDC_WHEEL_H
+#define LSQUAREDC_WHEEL_H
+
+#include <stdint.h>
+
+#define I2C_WHEEL_LEVELS    4
+#define I2C_WHEEL_BITS      6
+#define I2C_WHEEL_SLOTS     (1 << I2C_WHEEL_BITS)
+
+/* Timers are embedded in the structures that use them. */
+struct i2c_timer {
+  uint64_t expires;                     /* in ticks */
+  struct i2c_timer *next;
+  struct i2c_timer **pprev;             /* 0 when the timer is not armed */
+};
+
+struct i2c_wheel {
+  uint64_t start_ns;                    /* tick 0 */
+  uint64_t tick_ns;
+  uint64_t now;                         /* current tick: everything up to and including it has expired */
+  uint32_t count;
+  uint64_t occupied[I2C_WHEEL_LEVELS];  /* one bit per non-empty slot */
+  struct i2c_timer *slots[I2C_WHEEL_LEVELS][I2C_WHEEL_SLOTS];
+};
+
+void i2c_wheel_init(struct i2c_wheel *wheel, uint64_t start_ns, uint64_t tick_ns);
+
+void i2c_wheel_add(struct i2c_wheel *wheel, struct i2c_timer *timer, uint64_t expires_ns);
+
+void i2c_wheel_add_slack(struct i2c_wheel *wheel, struct i2c_timer *timer, uint64_t expires_ns, uint64_t slack_ns);
+
+void i2c_wheel_cancel(struct i2c_wheel *wheel, struct i2c_timer *timer);
+
+struct i2c_timer *i2c_wheel_advance(struct i2c_wheel *wheel, uint64_t now_ns);
+
+uint64_t i2c_wheel_next_ns(struct i2c_wheel *wheel);
+
+#endif
@@ -0,0 +1,118 @@
+/*
+  bench_loop.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "lsquaredc.h"
+#include "lsquaredc_loop.h"
+
+/*
+  Event loop throughput, io_uring against epoll. The callback of every notifier notifies it again, so all notifiers are
+  ready all the time, the way completions keep arriving from busy worker threads. A repeating 1 ms timer runs
+  alongside. For each backend, reports the callbacks per second, the CPU time per callback
+  and the system calls the loop made per callback (the eventfd writes of the notifications are the same for both and
+  are not counted).
+
+  Usage: lsquaredc-bench-loop [notifiers] [seconds]
+*/
+
+#define MAX_NOTIFIERS 256
+
+struct bench {
+  struct i2c_loop *loop;
+  uint64_t ticks;
+};
+
+static void again(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user) {
+  (void)data; (void)length; (void)user;
+  i2c_loop_notify(source);
+}
+
+static void tick(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user) {
+  (void)source; (void)data; (void)length;
+  ((struct bench *)user)->ticks++;
+}
+
+static void finish(struct i2c_loop_source *source, const uint8_t *data, uint32_t length, void *user) {
+  (void)source; (void)data; (void)length;
+  i2c_loop_stop(((struct bench *)user)->loop);
+}
+
+static uint64_t cpu_ns(void) {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL +
+    (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+static void measure(const char *name, int backend, uint32_t notifiers, uint32_t seconds) {
+  struct i2c_loop_source *notifier;
+  struct bench bench;
+  uint64_t start, cpu;
+  uint32_t i;
+
+  memset(&bench, 0, sizeof(bench));
+  if(!(bench.loop = i2c_loop_create(backend))) {
+    printf("  %-8s not available\n", name);
+    return;
+  }
+  for(i = 0; i < notifiers; i++) {
+    if(!(notifier = i2c_loop_add_notifier(bench.loop, again, &bench))) {
+      perror("i2c_loop_add_notifier");
+      exit(1);
+    }
+    i2c_loop_notify(notifier);
+  }
+  start = i2c_monotonic_ns();
+  i2c_loop_add_timer(bench.loop, start + 1000000, 1000000, tick, &bench);
+  i2c_loop_add_timer(bench.loop, start + (uint64_t)seconds * 1000000000ULL, 0, finish, &bench);
+
+  cpu = cpu_ns();
+  start = i2c_monotonic_ns();
+  if(i2c_loop_run(bench.loop) < 0) perror("i2c_loop_run");
+  start = i2c_monotonic_ns() - start;
+  cpu = cpu_ns() - cpu;
+
+  printf("  %-8s %10.0f events/s  %6.0f ns CPU/event  %5.2f syscalls/event  %5.1f events/wakeup  %llu ticks\n", name,
+         bench.loop->events * 1e9 / start, (double)cpu / bench.loop->events,
+         (double)bench.loop->syscalls / bench.loop->events, (double)bench.loop->events / bench.loop->iterations,
+         (unsigned long long)bench.ticks);
+  i2c_loop_destroy(bench.loop);
+}
+
+int main(int argc, char **argv) {
+  uint32_t notifiers = (argc > 1) ? (uint32_t)atoi(argv[1]) : 8;
+  uint32_t seconds = (argc > 2) ? (uint32_t)atoi(argv[2]) : 2;
+
+  if(notifiers == 0 || notifiers > MAX_NOTIFIERS || seconds == 0) return 2;
+  printf("%u notifiers:\n", notifiers);
+  measure("io_uring", I2C_LOOP_URING, notifiers, seconds);
+  measure("epoll", I2C_LOOP_EPOLL, notifiers, seconds);
+  return 0;
+}
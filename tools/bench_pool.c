@@ -0,0 +1,148 @@
+/*
+  bench_pool.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "lsquaredc.h"
+#include "lsquaredc_flash.h"
+#include "lsquaredc_pool.h"
+
+/*
+  Bus utilization with and without offloading, simulated. A bus thread does transfers back to back; a transfer is a
+  sleep of transfer_us (the ioctl blocks while the bytes go over the wire, and the CPU is free meanwhile). Every
+  transfer is followed by decode_us of CPU work on the received data (CRC-32 over it, repeated). Without offloading, the
+  bus thread does the work itself between transfers; with it, the work goes to a lsquaredc_pool.c pool. Utilization is
+  the fraction of the time the bus was busy with transfers.
+
+  Usage: lsquaredc-bench-pool [-w workers] [-t transfer_us] [-d decode_us] [-s seconds]
+*/
+
+#define DATA_LENGTH 64
+
+static uint32_t rounds_per_us;
+static volatile uint32_t sink;
+
+static void decode(const uint8_t *data, uint32_t rounds) {
+  uint32_t crc = 0, i;
+
+  for(i = 0; i < rounds; i++) crc = i2c_crc32(crc, data, DATA_LENGTH);
+  sink = crc;
+}
+
+static void decode_job(struct i2c_pool_buffer *buffer, void *user) {
+  decode(buffer->data, *(uint32_t *)user);
+}
+
+static void transfer(uint8_t *data, uint32_t transfer_us, uint32_t number) {
+  struct timespec duration = {0, (long)transfer_us * 1000};
+  uint32_t i;
+
+  while(nanosleep(&duration, &duration) < 0 && errno == EINTR);
+  for(i = 0; i < DATA_LENGTH; i++) data[i] = number + i;
+}
+
+static void calibrate(void) {
+  uint8_t data[DATA_LENGTH] = {0};
+  uint64_t start = i2c_monotonic_ns(), elapsed;
+  uint32_t rounds = 1000;
+
+  for(;;) {
+    decode(data, rounds);
+    elapsed = i2c_monotonic_ns() - start;
+    if(elapsed > 100000000ULL) break;
+    rounds *= 2;
+    start = i2c_monotonic_ns();
+  }
+  rounds_per_us = rounds / (elapsed / 1000) + 1;
+}
+
+static void report(const char *name, uint64_t transfers, uint64_t elapsed_ns, uint32_t transfer_us,
+                   uint64_t inline_runs) {
+  printf("  %-22s %9.0f transfers/s  bus utilization %5.1f%%  decoded on the bus thread %llu\n", name,
+         transfers * 1e9 / elapsed_ns, 100.0 * transfers * transfer_us * 1000 / elapsed_ns,
+         (unsigned long long)inline_runs);
+}
+
+int main(int argc, char **argv) {
+  uint32_t workers = 2, transfer_us = 200, decode_us = 300, seconds = 2;
+  uint64_t start, duration_ns, transfers, inline_runs;
+  struct i2c_pool_buffer *buffer;
+  struct i2c_pool_queue *queue;
+  struct i2c_pool *pool;
+  uint8_t data[DATA_LENGTH];
+  char name[32];
+  uint32_t rounds;
+  int c;
+
+  while((c = getopt(argc, argv, "w:t:d:s:")) != -1) {
+    switch(c) {
+    case 'w': workers = strtoul(optarg, 0, 0); break;
+    case 't': transfer_us = strtoul(optarg, 0, 0); break;
+    case 'd': decode_us = strtoul(optarg, 0, 0); break;
+    case 's': seconds = strtoul(optarg, 0, 0); break;
+    default:
+      fprintf(stderr, "usage: %s [-w workers] [-t transfer_us] [-d decode_us] [-s seconds]\n", argv[0]);
+      return 2;
+    }
+  }
+  if(workers == 0 || workers > I2C_POOL_MAX_WORKERS || seconds == 0) return 2;
+  duration_ns = (uint64_t)seconds * 1000000000ULL;
+  calibrate();
+  rounds = decode_us * rounds_per_us;
+  printf("%u us transfers, %u us of decoding per transfer, %ld CPUs:\n", transfer_us, decode_us,
+         sysconf(_SC_NPROCESSORS_ONLN));
+
+  transfers = 0;
+  start = i2c_monotonic_ns();
+  while(i2c_monotonic_ns() - start < duration_ns) {
+    transfer(data, transfer_us, transfers++);
+    decode(data, rounds);
+  }
+  report("decode on bus thread", transfers, i2c_monotonic_ns() - start, transfer_us, transfers);
+
+  if(!(pool = i2c_pool_create(workers, 256, DATA_LENGTH)) || !(queue = i2c_pool_add_queue(pool))) {
+    perror("i2c_pool_create");
+    return 1;
+  }
+  transfers = inline_runs = 0;
+  start = i2c_monotonic_ns();
+  while(i2c_monotonic_ns() - start < duration_ns) {
+    buffer = i2c_pool_get(pool);
+    transfer(buffer ? buffer->data : data, transfer_us, transfers++);
+    if(buffer && i2c_pool_submit(pool, queue, buffer, decode_job, &rounds) == 0) continue;
+    /* the workers cannot keep up: decode here, like i2c_pool_attach() does */
+    if(buffer) i2c_pool_put(pool, buffer);
+    decode(buffer ? buffer->data : data, rounds);
+    inline_runs++;
+  }
+  duration_ns = i2c_monotonic_ns() - start;
+  i2c_pool_destroy(pool);
+  snprintf(name, sizeof(name), "pool of %u workers", workers);
+  report(name, transfers, duration_ns, transfer_us, inline_runs);
+  return 0;
+}
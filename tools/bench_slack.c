@@ -0,0 +1,105 @@
+/*
+  bench_slack.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "lsquaredc_wheel.h"
+
+/*
+  Wakeup coalescing simulation. Schedules independent periodic tasks with typical polling periods (10ms to 1s, random
+  phases) spread over a number of buses exactly the way the poller does, in virtual time, and reports the number of
+  wakeups and ioctls per second for different amounts of per-task slack. Every task is assumed to be a two-message
+  register read that may be packed with others, so one ioctl serves up to 21 tasks on a bus.
+
+  Usage: lsquaredc-bench-slack [tasks] [buses]
+*/
+
+#define TICK_NS 100000ULL
+#define SECONDS 60
+#define TASKS_PER_IOCTL 21
+#define MAX_BUSES 64
+
+struct task {
+  uint64_t period_ns;
+  uint64_t next_ns;
+  int bus;
+  struct i2c_timer timer;
+};
+
+static void simulate(struct task *tasks, uint32_t count, uint32_t buses, uint32_t slack_us) {
+  static const uint32_t periods_ms[] = { 10, 20, 50, 100, 200, 250, 500, 1000 };
+  uint32_t per_bus[MAX_BUSES];
+  struct i2c_wheel wheel;
+  struct i2c_timer *timer, *next;
+  struct task *task;
+  uint64_t wakeups = 0, ioctls = 0, polls = 0;
+  double delay_ns = 0;
+  uint64_t now;
+  uint32_t i;
+
+  srand(count);
+  i2c_wheel_init(&wheel, 0, TICK_NS);
+  for(i = 0; i < count; i++) {
+    tasks[i].period_ns = periods_ms[rand() % (sizeof(periods_ms) / sizeof(periods_ms[0]))] * 1000000ULL;
+    tasks[i].next_ns = rand() % tasks[i].period_ns;
+    tasks[i].bus = i % buses;
+    tasks[i].timer.pprev = 0;
+    i2c_wheel_add_slack(&wheel, &tasks[i].timer, tasks[i].next_ns, slack_us * 1000ULL);
+  }
+
+  while((now = i2c_wheel_next_ns(&wheel)) < SECONDS * 1000000000ULL) {
+    wakeups++;
+    for(i = 0; i < buses; i++) per_bus[i] = 0;
+    for(timer = i2c_wheel_advance(&wheel, now); timer; timer = next) {
+      next = timer->next;
+      task = (struct task *)((char *)timer - offsetof(struct task, timer));
+      if(per_bus[task->bus]++ % TASKS_PER_IOCTL == 0) ioctls++;
+      polls++;
+      delay_ns += now - task->next_ns;
+      task->next_ns += task->period_ns;
+      i2c_wheel_add_slack(&wheel, timer, task->next_ns, slack_us * 1000ULL);
+    }
+  }
+  printf("slack %6u us  %8.1f wakeups/s  %8.1f ioctls/s  %8.1f polls/s  %6.2f polls per wakeup  %7.1f us mean delay\n",
+         slack_us, (double)wakeups / SECONDS, (double)ioctls / SECONDS, (double)polls / SECONDS,
+         wakeups ? (double)polls / wakeups : 0.0, polls ? delay_ns / polls / 1000 : 0.0);
+}
+
+int main(int argc, char **argv) {
+  static const uint32_t slacks_us[] = { 0, 500, 1000, 2000, 5000, 10000 };
+  uint32_t count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 50;
+  uint32_t buses = (argc > 2) ? (uint32_t)atoi(argv[2]) : 2;
+  struct task *tasks;
+  uint32_t i;
+
+  if(count == 0 || buses == 0 || buses > MAX_BUSES) return 2;
+  tasks = malloc(count * sizeof(struct task));
+  if(!tasks) return 1;
+  printf("%u tasks on %u buses, %u seconds\n", count, buses, SECONDS);
+  for(i = 0; i < sizeof(slacks_us) / sizeof(slacks_us[0]); i++) simulate(tasks, count, buses, slacks_us[i]);
+  free(tasks);
+  return 0;
+}
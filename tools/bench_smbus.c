@@ -0,0 +1,139 @@
+/*
+  bench_smbus.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include "lsquaredc.h"
+#include "lsquaredc_smbus.h"
+
+/*
+  Runs a typical libi2c access pattern against a real device, first the way libi2c does it (one SMBus ioctl per call)
+  and then through lsquaredc_smbus.c with read-ahead and shared reads, and reports the time and the ioctls needed. The
+  pattern is a sensor sample read one register at a time by several threads: every thread repeatedly reads count
+  consecutive registers from first_register, with i2c_smbus_read_byte_data(). Only reads are done, so any device with
+  an auto-incrementing register address will do.
+
+  Usage: lsquaredc-bench-smbus [-b bus] [-a addr] [-r first_register] [-n count] [-i iterations] [-t threads]
+
+  The address is 7-bit, e.g. -a 0x1c for the MMA8453Q (whose X, Y and Z samples are 6 registers from 0x01).
+*/
+
+#define MAX_THREADS 16
+
+struct run {
+  int file;
+  uint8_t first_register;
+  uint32_t count;
+  uint32_t iterations;
+  int errors;
+};
+
+static void *legacy_pattern(void *argument) {
+  struct run *run = argument;
+  uint32_t i, j;
+
+  for(i = 0; i < run->iterations; i++) {
+    for(j = 0; j < run->count; j++) {
+      if(i2c_smbus_read_byte_data(run->file, run->first_register + j) < 0) run->errors++;
+    }
+  }
+  return 0;
+}
+
+static int measure(const char *name, uint8_t bus, int address, int accelerated, struct run *run, uint32_t threads) {
+  char device_name[16];
+  pthread_t thread[MAX_THREADS];
+  struct run runs[MAX_THREADS];
+  struct i2c_smbus_stats stats;
+  uint64_t start_ns, elapsed_ns;
+  uint32_t i, samples = run->iterations * threads;
+  int errors = 0;
+
+  snprintf(device_name, sizeof(device_name), "/dev/i2c-%d", bus);
+  if((run->file = open(device_name, O_RDWR)) < 0 || ioctl(run->file, I2C_SLAVE, address) < 0) {
+    perror(device_name);
+    return -1;
+  }
+  if(accelerated) {
+    i2c_smbus_set_slave(run->file, address);
+    i2c_smbus_auto_increment(address, 1);
+  }
+
+  start_ns = i2c_monotonic_ns();
+  for(i = 0; i < threads; i++) {
+    runs[i] = *run;
+    pthread_create(&thread[i], 0, legacy_pattern, &runs[i]);
+  }
+  for(i = 0; i < threads; i++) {
+    pthread_join(thread[i], 0);
+    errors += runs[i].errors;
+  }
+  elapsed_ns = i2c_monotonic_ns() - start_ns;
+
+  i2c_smbus_get_stats(run->file, &stats);
+  close(run->file);
+  i2c_smbus_release(run->file);         /* the next run will likely get the same file number */
+  printf("%-8s %8.1f us/sample %6.2f ioctls/sample  %u calls  %u read-ahead  %u shared  %d errors\n", name,
+         elapsed_ns / 1000.0 / samples, (double)stats.transfers / samples, stats.calls, stats.read_ahead_hits,
+         stats.shared_reads, errors);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct run run;
+  uint8_t bus = 1;
+  int address = 0x1c;
+  uint32_t threads = 2;
+  int c;
+
+  run.first_register = 0x01;
+  run.count = 6;
+  run.iterations = 1000;
+  run.errors = 0;
+  while((c = getopt(argc, argv, "b:a:r:n:i:t:")) != -1) {
+    switch(c) {
+    case 'b': bus = strtoul(optarg, 0, 0); break;
+    case 'a': address = strtoul(optarg, 0, 0) & 0x7f; break;
+    case 'r': run.first_register = strtoul(optarg, 0, 0); break;
+    case 'n': run.count = strtoul(optarg, 0, 0); break;
+    case 'i': run.iterations = strtoul(optarg, 0, 0); break;
+    case 't': threads = strtoul(optarg, 0, 0); break;
+    default:
+      fprintf(stderr, "usage: %s [-b bus] [-a addr] [-r first_register] [-n count] [-i iterations] [-t threads]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if(threads == 0 || threads > MAX_THREADS || run.count == 0 || run.iterations == 0) return 2;
+
+  if(measure("libi2c", bus, address, 0, &run, threads) < 0) return 1;
+  if(measure("lsquaredc", bus, address, 1, &run, threads) < 0) return 1;
+  return 0;
+}
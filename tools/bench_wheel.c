@@ -0,0 +1,188 @@
+/*
+  bench_wheel.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "lsquaredc_wheel.h"
+
+/*
+  Scheduler scalability benchmark. Simulates N periodic poll tasks with periods spread log-uniformly between 1ms and 1s
+  for a number of seconds of virtual time (no bus traffic, no sleeping) and reports the CPU time the scheduler needs per
+  simulated second. Three schedulers are compared, all with the same 100us tick:
+
+    scan    a linear scan for the earliest deadline and for due tasks (what the poller used to do)
+    heap    a binary heap ordered by deadline
+    wheel   the hierarchical timer wheel used by the poller now
+
+  The scan is skipped above 10000 tasks, where it would take minutes.
+
+  Usage: lsquaredc-bench-wheel [seconds]
+*/
+
+#define TICK_NS 100000ULL
+#define MAX_SCAN_TASKS 10000
+
+struct task {
+  uint64_t period_ns;
+  uint64_t next_ns;
+  struct i2c_timer timer;
+};
+
+static struct task *tasks;
+static uint32_t task_count;
+
+static double cpu_seconds(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void make_tasks(uint32_t count) {
+  uint32_t i;
+
+  srand(count);
+  for(i = 0; i < count; i++) {
+    tasks[i].period_ns = (uint64_t)(1e6 * pow(1000.0, (double)rand() / RAND_MAX));
+    tasks[i].next_ns = rand() % tasks[i].period_ns;
+    tasks[i].timer.pprev = 0;
+  }
+  task_count = count;
+}
+
+/* All schedulers wake up on a tick boundary at or after the earliest deadline, and run everything due by then. */
+static uint64_t tick_up(uint64_t ns) {
+  return (ns + TICK_NS - 1) / TICK_NS * TICK_NS;
+}
+
+static uint64_t run_scan(uint64_t end_ns) {
+  uint64_t now, earliest, runs = 0;
+  uint32_t i;
+
+  for(;;) {
+    earliest = UINT64_MAX;
+    for(i = 0; i < task_count; i++) {
+      if(tasks[i].next_ns < earliest) earliest = tasks[i].next_ns;
+    }
+    now = tick_up(earliest);
+    if(now >= end_ns) return runs;
+    for(i = 0; i < task_count; i++) {
+      if(tasks[i].next_ns <= now) {
+        tasks[i].next_ns += tasks[i].period_ns;
+        runs++;
+      }
+    }
+  }
+}
+
+static uint32_t *heap;
+
+static void sift_down(uint32_t i) {
+  uint32_t child, top = heap[i];
+
+  while((child = 2 * i + 1) < task_count) {
+    if(child + 1 < task_count && tasks[heap[child + 1]].next_ns < tasks[heap[child]].next_ns) child++;
+    if(tasks[heap[child]].next_ns >= tasks[top].next_ns) break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = top;
+}
+
+static uint64_t run_heap(uint64_t end_ns) {
+  uint64_t now, runs = 0;
+  uint32_t i;
+
+  for(i = 0; i < task_count; i++) heap[i] = i;
+  for(i = task_count / 2; i-- > 0;) sift_down(i);
+
+  for(;;) {
+    now = tick_up(tasks[heap[0]].next_ns);
+    if(now >= end_ns) return runs;
+    while(tasks[heap[0]].next_ns <= now) {
+      tasks[heap[0]].next_ns += tasks[heap[0]].period_ns;
+      sift_down(0);
+      runs++;
+    }
+  }
+}
+
+static uint64_t run_wheel(uint64_t end_ns) {
+  struct i2c_wheel wheel;
+  struct i2c_timer *timer, *next;
+  struct task *task;
+  uint64_t now, runs = 0;
+  uint32_t i;
+
+  i2c_wheel_init(&wheel, 0, TICK_NS);
+  for(i = 0; i < task_count; i++) i2c_wheel_add(&wheel, &tasks[i].timer, tasks[i].next_ns);
+
+  for(;;) {
+    now = i2c_wheel_next_ns(&wheel);
+    if(now >= end_ns) return runs;
+    for(timer = i2c_wheel_advance(&wheel, now); timer; timer = next) {
+      next = timer->next;
+      task = (struct task *)((char *)timer - offsetof(struct task, timer));
+      task->next_ns += task->period_ns;
+      i2c_wheel_add(&wheel, timer, task->next_ns);
+      runs++;
+    }
+  }
+}
+
+static void measure(const char *name, uint64_t (*run)(uint64_t), uint32_t count, uint32_t seconds) {
+  double start, cpu;
+  uint64_t runs;
+
+  make_tasks(count);
+  start = cpu_seconds();
+  runs = run(seconds * 1000000000ULL);
+  cpu = cpu_seconds() - start;
+  printf("%-6s %7u tasks  %9.0f polls/s  %10.1f us CPU per second  %6.1f ns per poll\n", name, count,
+         (double)runs / seconds, 1e6 * cpu / seconds, runs ? 1e9 * cpu / runs : 0.0);
+}
+
+int main(int argc, char **argv) {
+  static const uint32_t counts[] = { 10, 100, 1000, 10000, 100000 };
+  uint32_t seconds = (argc > 1) ? (uint32_t)atoi(argv[1]) : 2;
+  uint32_t i;
+
+  if(seconds == 0) return 2;
+  tasks = malloc(counts[4] * sizeof(struct task));
+  heap = malloc(counts[4] * sizeof(uint32_t));
+  if(!tasks || !heap) return 1;
+
+  for(i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    if(counts[i] <= MAX_SCAN_TASKS) measure("scan", run_scan, counts[i], seconds);
+    measure("heap", run_heap, counts[i], seconds);
+    measure("wheel", run_wheel, counts[i], seconds);
+  }
+  free(tasks);
+  free(heap);
+  return 0;
+}
@@ -0,0 +1,489 @@
+/*
+  cyclic.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/i2c-dev.h>
+#include "lsquaredc.h"
+#include "lsquaredc_buspirate.h"
+
+/*
+  Cyclic executive schedule generator. Reads a task set, one task per line:
+
+    name bus period_us deadline_us [sequence]
+
+  where bus is an index into the array of handles given to the runtime (see lsquaredc_cyclic.c), deadline_us is
+  relative to the release of each job (0 means equal to the period) and the sequence is in Bus Pirate notation (see
+  lsquaredc_buspirate.c). '#' starts a comment.
+
+  The major frame is the least common multiple of the periods. We try minor frame lengths that divide it, longest
+  first, and fill the frames earliest-deadline-first. A job can only go into a frame that starts at or after its release
+  and ends at or before its deadline, and a frame is full when the cost of its transfers reaches its length. The cost of
+  a transfer is its wire time at the given bus speed plus a fixed overhead per ioctl. Jobs of the same bus that end up in
+  the same frame are packed into a single transfer if their devices were marked with -k (packing is not safe for every
+  device: an EEPROM or a read-to-clear register must not see an extra transaction) and the adapter can do the result
+  (see -l), which only costs the wire time of the added transaction.
+
+  If every job gets a frame, the schedule is feasible under the cost model by construction, and the C tables for
+  lsquaredc_cyclic.c are written to standard output. Otherwise the overload is reported and we exit with status 1.
+
+  Usage: lsquaredc-cyclic [-s bus_hz] [-o overhead_us] [-f minor_frame_us] [-k addr] [-l flags] [-p prefix] [file]
+
+    -s bus_hz          bus frequency, default 100000
+    -o overhead_us     fixed cost of an ioctl, default 100
+    -f minor_frame_us  use this minor frame length instead of searching for one
+    -k addr            device may be packed with other transactions (may be repeated)
+    -l flags           I2C_LIMIT_* flags of the adapters (see i2c_get_limits()), e.g. 4 for bcm2835
+    -p prefix          name of the generated schedule, default "schedule"
+*/
+
+#define MAX_SEQUENCE_LENGTH 1024
+#define MAX_JOBS 1000000
+#define MAX_FRAMES 100000
+
+struct task {
+  char name[64];
+  uint32_t bus;
+  uint32_t period_us;
+  uint32_t deadline_us;
+  uint16_t *sequence;
+  uint32_t sequence_length;
+  uint32_t data_length;
+  uint32_t segments;
+  int packable;
+  double wire_us;
+};
+
+struct job {
+  uint32_t task;
+  uint32_t number;                      /* of the task within the major frame */
+  uint32_t first_frame;                 /* window of frames the job may go into */
+  uint32_t last_frame;
+  uint32_t transfer;                    /* assigned transfer */
+  uint32_t next;                        /* next job of the same transfer, or UINT32_MAX */
+};
+
+struct transfer {
+  uint32_t frame;
+  uint32_t bus;
+  int packable;
+  uint32_t segments;
+  int reads;                            /* any of the packed transactions reads */
+  uint32_t first_job;
+  uint32_t last_job;
+};
+
+static struct task *tasks;
+static uint32_t task_count;
+static struct job *jobs;
+static uint32_t job_count;
+static struct transfer *transfers;
+static uint32_t transfer_count;
+static uint32_t transfer_capacity;
+static double overhead_us = 100;
+static struct i2c_limits limits;
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  uint64_t t;
+
+  while(b) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static int read_tasks(FILE *file, uint32_t bus_hz, const uint8_t *packing) {
+  char line[4 * MAX_SEQUENCE_LENGTH];
+  uint16_t buffer[MAX_SEQUENCE_LENGTH];
+  uint32_t capacity = 0, line_number = 0;
+  struct task *task;
+  const char *text;
+  int consumed, length;
+
+  while(fgets(line, sizeof(line), file)) {
+    line_number++;
+    text = line;
+    while(*text == ' ' || *text == '\t') text++;
+    if(*text == '#' || *text == '\n' || *text == 0) continue;
+    if(task_count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      tasks = realloc(tasks, capacity * sizeof(struct task));
+      if(!tasks) return -1;
+    }
+    task = &tasks[task_count];
+    memset(task, 0, sizeof(struct task));
+    if(sscanf(text, "%63s %u %u %u %n", task->name, &task->bus, &task->period_us, &task->deadline_us, &consumed) < 4 ||
+       task->period_us == 0) {
+      fprintf(stderr, "line %u: expected: name bus period_us deadline_us [sequence]\n", line_number);
+      return -1;
+    }
+    if(task->deadline_us == 0) task->deadline_us = task->period_us;
+    if(task->deadline_us > task->period_us) {
+      fprintf(stderr, "line %u: deadline longer than the period is not supported\n", line_number);
+      return -1;
+    }
+    text += consumed;
+    if((length = i2c_parse_sequence(&text, buffer, MAX_SEQUENCE_LENGTH)) <= 0) {
+      fprintf(stderr, "line %u: bad sequence near: %.20s\n", line_number, text);
+      return -1;
+    }
+    task->sequence = malloc(length * sizeof(uint16_t));
+    if(!task->sequence) return -1;
+    memcpy(task->sequence, buffer, length * sizeof(uint16_t));
+    task->sequence_length = length;
+    task->data_length = i2c_count_reads(buffer, length);
+    task->segments = i2c_count_segments(buffer, length);
+    task->packable = packing[(buffer[0] >> 1) & 0x7f] && task->segments <= I2C_RDRW_IOCTL_MAX_MSGS;
+    task->wire_us = 1e6 * i2c_sequence_clocks(buffer, length) / bus_hz;
+    task_count++;
+  }
+  return task_count ? 0 : -1;
+}
+
+static int compare_deadlines(const void *a, const void *b) {
+  const struct job *x = &jobs[*(const uint32_t *)a];
+  const struct job *y = &jobs[*(const uint32_t *)b];
+
+  if(x->last_frame != y->last_frame) return (x->last_frame < y->last_frame) ? -1 : 1;
+  return (x->task < y->task) ? -1 : (x->task > y->task);
+}
+
+static int add_transfer(uint32_t frame, struct job *job, uint32_t index) {
+  struct transfer *transfer;
+
+  if(transfer_count == transfer_capacity) {
+    transfer_capacity = transfer_capacity ? transfer_capacity * 2 : 256;
+    transfers = realloc(transfers, transfer_capacity * sizeof(struct transfer));
+    if(!transfers) return -1;
+  }
+  transfer = &transfers[transfer_count];
+  transfer->frame = frame;
+  transfer->bus = tasks[job->task].bus;
+  transfer->packable = tasks[job->task].packable;
+  transfer->segments = tasks[job->task].segments;
+  transfer->reads = tasks[job->task].data_length > 0;
+  transfer->first_job = transfer->last_job = index;
+  job->transfer = transfer_count++;
+  job->next = UINT32_MAX;
+  return 0;
+}
+
+
+/*
+  Tries to fit all jobs into frames of frame_us. Returns 0 on success, otherwise -1 with *missed set to the job that
+  could not be placed (or UINT32_MAX if we ran out of memory).
+*/
+static int fill_frames(uint64_t major_us, uint32_t frame_us, double *max_load, uint32_t *missed) {
+  uint32_t frame_count = major_us / frame_us;
+  uint32_t *pending = malloc(job_count * sizeof(uint32_t));
+  uint32_t pending_count = 0, released = 0, kept;
+  uint32_t first_transfer;
+  uint32_t frame, i, t;
+  struct transfer *transfer;
+  struct task *task;
+  struct job *job;
+  double load, cost;
+
+  *missed = UINT32_MAX;
+  *max_load = 0;
+  transfer_count = 0;
+  if(!pending) return -1;
+
+  /* jobs are created in order of release, so the released ones are always a prefix */
+  for(frame = 0; frame < frame_count; frame++) {
+    while(released < job_count && jobs[released].first_frame <= frame) pending[pending_count++] = released++;
+    qsort(pending, pending_count, sizeof(uint32_t), compare_deadlines);
+
+    load = 0;
+    first_transfer = transfer_count;
+    for(i = 0, kept = 0; i < pending_count; i++) {
+      job = &jobs[pending[i]];
+      task = &tasks[job->task];
+
+      /* a transfer of this frame on the same bus that can take one more transaction? */
+      transfer = 0;
+      for(t = first_transfer; task->packable && t < transfer_count; t++) {
+        if(transfers[t].bus == task->bus && transfers[t].packable &&
+           i2c_can_pack(&limits, transfers[t].segments, transfers[t].reads, task->segments)) {
+          transfer = &transfers[t];
+          break;
+        }
+      }
+      cost = task->wire_us + (transfer ? 0 : overhead_us);
+      if(load + cost > frame_us) {
+        if(job->last_frame == frame) {
+          *missed = pending[i];
+          free(pending);
+          return -1;
+        }
+        pending[kept++] = pending[i];
+        continue;
+      }
+      load += cost;
+      if(transfer) {
+        transfer->segments += task->segments;
+        transfer->reads |= task->data_length > 0;
+        jobs[transfer->last_job].next = pending[i];
+        transfer->last_job = pending[i];
+        job->transfer = transfer - transfers;
+        job->next = UINT32_MAX;
+      } else if(add_transfer(frame, job, pending[i]) < 0) {
+        free(pending);
+        return -1;
+      }
+    }
+    pending_count = kept;
+    if(load / frame_us > *max_load) *max_load = load / frame_us;
+  }
+  free(pending);
+  return 0;
+}
+
+static int create_jobs(uint64_t major_us, uint32_t frame_us) {
+  uint32_t i, k, n;
+  uint64_t release, deadline;
+  uint32_t task_jobs;
+  uint32_t *next;
+
+  /* create the jobs of all tasks merged in order of release */
+  next = calloc(task_count, sizeof(uint32_t));
+  if(!next) return -1;
+  job_count = 0;
+  for(;;) {
+    k = UINT32_MAX;
+    for(i = 0; i < task_count; i++) {
+      task_jobs = major_us / tasks[i].period_us;
+      if(next[i] < task_jobs &&
+         (k == UINT32_MAX || (uint64_t)next[i] * tasks[i].period_us < (uint64_t)next[k] * tasks[k].period_us)) k = i;
+    }
+    if(k == UINT32_MAX) break;
+    n = next[k]++;
+    release = (uint64_t)n * tasks[k].period_us;
+    deadline = release + tasks[k].deadline_us;
+    jobs[job_count].task = k;
+    jobs[job_count].number = n;
+    jobs[job_count].first_frame = (release + frame_us - 1) / frame_us;
+    if(deadline / frame_us <= jobs[job_count].first_frame) {
+      /* no whole frame between release and deadline */
+      free(next);
+      return -1;
+    }
+    jobs[job_count].last_frame = deadline / frame_us - 1;
+    job_count++;
+  }
+  free(next);
+  return 0;
+}
+
+static void print_sequence(const char *prefix, uint32_t index, struct transfer *transfer) {
+  uint32_t j, i, column = 0;
+
+  printf("static const uint16_t %s_sequence_%u[] = {", prefix, index);
+  for(j = transfer->first_job; j != UINT32_MAX; j = jobs[j].next) {
+    for(i = 0; i < tasks[jobs[j].task].sequence_length; i++) {
+      if(column++ % 8 == 0) printf("\n  ");
+      if(tasks[jobs[j].task].sequence[i] == I2C_READ) printf("I2C_READ, ");
+      else if(tasks[jobs[j].task].sequence[i] == I2C_RESTART) printf("I2C_RESTART, ");
+      else printf("0x%02x, ", tasks[jobs[j].task].sequence[i]);
+    }
+    if(jobs[j].next != UINT32_MAX) {
+      if(column++ % 8 == 0) printf("\n  ");
+      printf("I2C_RESTART, ");
+    }
+  }
+  printf("\n};\n");
+}
+
+/* Transfers with the same jobs (of the same tasks) have the same sequence, which is then only emitted once. */
+static int same_sequence(struct transfer *a, struct transfer *b) {
+  uint32_t x = a->first_job, y = b->first_job;
+
+  if(a->bus != b->bus) return 0;
+  while(x != UINT32_MAX && y != UINT32_MAX && jobs[x].task == jobs[y].task) {
+    x = jobs[x].next;
+    y = jobs[y].next;
+  }
+  return x == UINT32_MAX && y == UINT32_MAX;
+}
+
+static int emit(const char *prefix, uint64_t major_us, uint32_t frame_us) {
+  uint32_t frame_count = major_us / frame_us;
+  uint32_t *sequence_of = malloc((transfer_count ? transfer_count : 1) * sizeof(uint32_t));
+  uint32_t *offset_of = malloc((transfer_count ? transfer_count : 1) * sizeof(uint32_t));
+  uint32_t t, u, j, n, length, offset = 0, max_data = 0, job_index = 0;
+  uint32_t frame, first_transfer, first_job;
+
+  if(!sequence_of || !offset_of) return -1;
+  printf("/* Generated by lsquaredc-cyclic: major frame %llu us, %u minor frames of %u us. Do not edit. */\n\n",
+         (unsigned long long)major_us, frame_count, frame_us);
+  printf("#include <stdint.h>\n#include \"lsquaredc.h\"\n#include \"lsquaredc_cyclic.h\"\n\n");
+
+  for(t = 0, n = 0; t < transfer_count; t++) {
+    for(u = 0; u < t && !same_sequence(&transfers[u], &transfers[t]); u++);
+    if(u < t) {
+      sequence_of[t] = sequence_of[u];
+      continue;
+    }
+    sequence_of[t] = n;
+    print_sequence(prefix, n++, &transfers[t]);
+  }
+
+  /* received data is delivered before the next frame starts, so every frame can use the buffer from the beginning */
+  printf("\nstatic const struct i2c_cyclic_transfer %s_transfers[] = {\n", prefix);
+  for(t = 0; t < transfer_count; t++) {
+    if(t == 0 || transfers[t].frame != transfers[t - 1].frame) offset = 0;
+    for(j = transfers[t].first_job, length = 0; j != UINT32_MAX; j = jobs[j].next) {
+      length += tasks[jobs[j].task].sequence_length + (jobs[j].next != UINT32_MAX);
+    }
+    offset_of[t] = offset;
+    printf("  { %u, %s_sequence_%u, %u, %u },\n", transfers[t].bus, prefix, sequence_of[t], length, offset);
+    for(j = transfers[t].first_job; j != UINT32_MAX; j = jobs[j].next) offset += tasks[jobs[j].task].data_length;
+    if(offset > max_data) max_data = offset;
+  }
+  printf("};\n\nstatic const struct i2c_cyclic_job %s_jobs[] = {\n", prefix);
+  for(t = 0; t < transfer_count; t++) {
+    offset = offset_of[t];
+    for(j = transfers[t].first_job; j != UINT32_MAX; j = jobs[j].next) {
+      printf("  { %u, %u, %u, %u },\n", jobs[j].task, t, offset, tasks[jobs[j].task].data_length);
+      offset += tasks[jobs[j].task].data_length;
+    }
+  }
+  printf("};\n\nstatic const struct i2c_cyclic_frame %s_frames[] = {\n", prefix);
+  for(frame = 0, t = 0; frame < frame_count; frame++) {
+    first_transfer = t;
+    first_job = job_index;
+    for(; t < transfer_count && transfers[t].frame == frame; t++) {
+      for(j = transfers[t].first_job; j != UINT32_MAX; j = jobs[j].next) job_index++;
+    }
+    printf("  { %u, %u, %u, %u },\n", first_transfer, t - first_transfer, first_job, job_index - first_job);
+  }
+  printf("};\n\nstatic const char *const %s_task_names[] = {\n", prefix);
+  for(t = 0; t < task_count; t++) printf("  \"%s\",\n", tasks[t].name);
+  printf("};\n\nuint8_t %s_data[%u];\n\n", prefix, max_data ? max_data : 1);
+  printf("const struct i2c_cyclic_schedule %s = {\n  %u, %u, %u, %u,\n  %s_frames, %s_transfers, %s_jobs, %s_task_names\n"
+         "};\n", prefix, frame_us, frame_count, task_count, max_data, prefix, prefix, prefix, prefix);
+  free(sequence_of);
+  free(offset_of);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  uint8_t packing[128];
+  uint32_t bus_hz = 100000;
+  uint32_t forced_frame_us = 0, frame_us = 0;
+  const char *prefix = "schedule";
+  FILE *file = stdin;
+  uint64_t major_us = 1, divisor, total_jobs = 0;
+  double utilization = 0, wire_utilization = 0, longest_us = 0, cost, max_load = 0;
+  uint32_t missed = UINT32_MAX, missed_frame_us = 0;
+  uint32_t i;
+  int scheduled = 0;
+  int c;
+
+  memset(packing, 0, sizeof(packing));
+  while((c = getopt(argc, argv, "s:o:f:k:l:p:")) != -1) {
+    switch(c) {
+    case 's': bus_hz = strtoul(optarg, 0, 0); break;
+    case 'o': overhead_us = atof(optarg); break;
+    case 'f': forced_frame_us = strtoul(optarg, 0, 0); break;
+    case 'k': packing[strtoul(optarg, 0, 0) & 0x7f] = 1; break;
+    case 'l': limits.flags = strtoul(optarg, 0, 0); break;
+    case 'p': prefix = optarg; break;
+    default:
+      fprintf(stderr, "usage: %s [-s bus_hz] [-o overhead_us] [-f minor_frame_us] [-k addr] [-l flags] [-p prefix] "
+              "[file]\n", argv[0]);
+      return 2;
+    }
+  }
+  if(optind < argc && !(file = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+  if(bus_hz == 0 || read_tasks(file, bus_hz, packing) < 0) return 1;
+
+  for(i = 0; i < task_count; i++) {
+    major_us = major_us / gcd(major_us, tasks[i].period_us) * tasks[i].period_us;
+    if(major_us > 3600000000ULL) {
+      fprintf(stderr, "major frame longer than an hour, make the periods more harmonic\n");
+      return 1;
+    }
+    cost = overhead_us + tasks[i].wire_us;
+    if(cost > longest_us) longest_us = cost;
+    utilization += cost / tasks[i].period_us;
+    wire_utilization += tasks[i].wire_us / tasks[i].period_us;
+  }
+  for(i = 0; i < task_count; i++) total_jobs += major_us / tasks[i].period_us;
+  if(total_jobs > MAX_JOBS) {
+    fprintf(stderr, "%llu jobs per major frame is too many\n", (unsigned long long)total_jobs);
+    return 1;
+  }
+  jobs = malloc(total_jobs * sizeof(struct job));
+  if(!jobs) return 1;
+
+  fprintf(stderr, "%u tasks, major frame %llu us, %llu jobs\n", task_count, (unsigned long long)major_us,
+          (unsigned long long)total_jobs);
+  fprintf(stderr, "utilization %.1f%% unpacked, %.1f%% of it on the wire\n", 100 * utilization,
+          100 * wire_utilization);
+  if(wire_utilization > 1) {
+    fprintf(stderr, "overload: the transactions alone need more time than there is, even packed\n");
+    return 1;
+  }
+
+  /* minor frame lengths that divide the major frame, longest first */
+  for(divisor = 1; divisor <= major_us && !scheduled; divisor++) {
+    if(major_us % divisor) continue;
+    frame_us = major_us / divisor;
+    if(forced_frame_us && frame_us != forced_frame_us) continue;
+    if(frame_us < longest_us) break;
+    if(divisor > MAX_FRAMES) break;
+    if(create_jobs(major_us, frame_us) < 0) continue;
+    if(fill_frames(major_us, frame_us, &max_load, &missed) == 0) {
+      scheduled = 1;
+    } else {
+      missed_frame_us = frame_us;
+    }
+  }
+
+  if(!scheduled) {
+    if(missed != UINT32_MAX) {
+      fprintf(stderr, "overload: with %u us frames, job %u of task %s (released at %llu us, deadline %llu us) "
+              "does not fit\n", missed_frame_us, jobs[missed].number, tasks[jobs[missed].task].name,
+              (unsigned long long)jobs[missed].number * tasks[jobs[missed].task].period_us,
+              (unsigned long long)jobs[missed].number * tasks[jobs[missed].task].period_us +
+              tasks[jobs[missed].task].deadline_us);
+    } else {
+      fprintf(stderr, "no minor frame length fits the longest transaction (%.0f us) and all deadlines\n", longest_us);
+    }
+    return 1;
+  }
+
+  fprintf(stderr, "schedulable: %u minor frames of %u us, %u ioctls for %u jobs per major frame, busiest frame %.1f%%\n",
+          (uint32_t)(major_us / frame_us), frame_us, transfer_count, job_count, 100 * max_load);
+  return emit(prefix, major_us, frame_us) < 0;
+}
@@ -0,0 +1,92 @@
+/*
+  logdump.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lsquaredc_log.h"
+
+/*
+  Prints a log written by lsquaredc_log.c as CSV: the timestamp in nanoseconds, then the values of the record (bytes,
+  or big-endian 16-bit words if the log was written with value_bytes 2), one record per line. With -s, prints only
+  the number of blocks and records and how well they compressed.
+
+  Usage: lsquaredc-logdump [-s] file
+*/
+
+int main(int argc, char **argv) {
+  struct i2c_log_reader reader;
+  struct stat status;
+  uint64_t records = 0, blocks = 0, raw_bytes = 0;
+  int summary = 0;
+  uint8_t *record;
+  uint32_t i, j;
+  int count, c;
+
+  while((c = getopt(argc, argv, "s")) != -1) {
+    switch(c) {
+    case 's': summary = 1; break;
+    default:
+      fprintf(stderr, "usage: %s [-s] file\n", argv[0]);
+      return 2;
+    }
+  }
+  if(optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-s] file\n", argv[0]);
+    return 2;
+  }
+  if(i2c_log_reader_open(&reader, argv[optind]) < 0) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  while((count = i2c_log_reader_next(&reader)) > 0) {
+    blocks++;
+    records += count;
+    raw_bytes += (uint64_t)count * (reader.record_length + sizeof(uint64_t));
+    for(i = 0; !summary && i < (uint32_t)count; i++) {
+      record = reader.data + (size_t)i * reader.record_length;
+      printf("%llu", (unsigned long long)reader.timestamps[i]);
+      for(j = 0; j < reader.record_length; j += reader.value_bytes) {
+        if(reader.value_bytes == 2) {
+          printf(",%u", (record[j] << 8) | ((j + 1 < reader.record_length) ? record[j + 1] : 0));
+        } else {
+          printf(",%u", record[j]);
+        }
+      }
+      printf("\n");
+    }
+  }
+  if(count < 0) perror(argv[optind]);
+
+  if(summary && stat(argv[optind], &status) == 0) {
+    printf("%llu records in %llu blocks, %llu bytes raw (data and 8-byte timestamps), %lld bytes on disk (%.1fx)\n",
+           (unsigned long long)records, (unsigned long long)blocks, (unsigned long long)raw_bytes,
+           (long long)status.st_size, status.st_size ? (double)raw_bytes / status.st_size : 0.0);
+  }
+  i2c_log_reader_close(&reader);
+  return count < 0;
+}
@@ -0,0 +1,177 @@
+/*
+  optimize.c
+
+  Copyright (C) 2014 Jan Rychter
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "lsquaredc.h"
+#include "lsquaredc_buspirate.h"
+#include "lsquaredc_opt.h"
+
+/*
+  Command-line front end for i2c_optimize(). Reads a list of transactions in Bus Pirate notation (see
+  lsquaredc_buspirate.c) from a file or standard input, and prints the number of transactions (ioctls) and the estimated
+  wire time before and after optimization, optionally followed by the optimized list.
+
+  Usage: lsquaredc-optimize [-a addr] [-k addr] [-c addr] [-b bus | -l flags] [-s bus_hz] [-o overhead_us] [-p] [file]
+
+    -a addr         device auto-increments its register address (may be repeated)
+    -k addr         device may be packed with other transactions (may be repeated)
+    -c addr         device reads have no side effects, repeats may be collapsed (may be repeated)
+    -b bus          pack only what the adapter of /dev/i2c-<bus> can do (see i2c_get_limits())
+    -l flags        the same for an adapter that is not at hand: I2C_LIMIT_* flags, e.g. 4 for bcm2835
+    -s bus_hz       bus frequency for the wire time estimate, default 100000
+    -o overhead_us  also estimate total time with this fixed cost per ioctl
+    -p              print the optimized transactions
+
+  Addresses are 7-bit, e.g. -a 0x1c for the MMA8453Q. Devices that are not named get no optimizations at all.
+*/
+
+#define MAX_SEQUENCE_LENGTH 4096
+
+static char *read_all(FILE *file) {
+  size_t size = 0, capacity = 4096;
+  char *text = malloc(capacity);
+  size_t n;
+
+  while(text && (n = fread(text + size, 1, capacity - size - 1, file)) > 0) {
+    size += n;
+    if(capacity - size < 2) text = realloc(text, capacity *= 2);
+  }
+  if(text) text[size] = 0;
+  return text;
+}
+
+static void totals(struct i2c_sequence *sequences, uint32_t count, uint64_t *clocks) {
+  uint32_t i;
+
+  *clocks = 0;
+  for(i = 0; i < count; i++) *clocks += i2c_sequence_clocks(sequences[i].sequence, sequences[i].sequence_length);
+}
+
+static void report(const char *name, uint32_t count, uint64_t clocks, uint32_t bus_hz, double overhead_us) {
+  double wire_us = 1e6 * clocks / bus_hz;
+
+  printf("%-7s %6u transactions  %10.1f us on the wire", name, count, wire_us);
+  if(overhead_us > 0) printf("  %10.1f us total", wire_us + count * overhead_us);
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  uint8_t hints[128];
+  struct i2c_limits limits, *known_limits = 0;
+  int handle;
+  uint16_t buffer[MAX_SEQUENCE_LENGTH];
+  struct i2c_sequence *in = 0, *out = 0;
+  uint32_t in_count = 0, out_count = 0, capacity = 0;
+  uint32_t bus_hz = 100000;
+  double overhead_us = 0;
+  int print = 0;
+  uint64_t clocks;
+  uint32_t *read_map;
+  const char *text;
+  char *all;
+  char line[4 * MAX_SEQUENCE_LENGTH];
+  FILE *file = stdin;
+  uint32_t i;
+  int length;
+  int c;
+
+  memset(hints, 0, sizeof(hints));
+  while((c = getopt(argc, argv, "a:k:c:b:l:s:o:p")) != -1) {
+    switch(c) {
+    case 'a': hints[strtoul(optarg, 0, 0) & 0x7f] |= I2C_HINT_AUTO_INCREMENT; break;
+    case 'k': hints[strtoul(optarg, 0, 0) & 0x7f] |= I2C_HINT_PACKABLE; break;
+    case 'c': hints[strtoul(optarg, 0, 0) & 0x7f] |= I2C_HINT_STABLE_READS; break;
+    case 'b':
+      if((handle = i2c_open(strtoul(optarg, 0, 0))) < 0 || i2c_get_limits(handle, &limits) < 0) {
+        fprintf(stderr, "cannot open bus %s\n", optarg);
+        return 1;
+      }
+      i2c_close(handle);
+      known_limits = &limits;
+      break;
+    case 'l':
+      memset(&limits, 0, sizeof(limits));
+      limits.flags = strtoul(optarg, 0, 0);
+      known_limits = &limits;
+      break;
+    case 's': bus_hz = strtoul(optarg, 0, 0); break;
+    case 'o': overhead_us = atof(optarg); break;
+    case 'p': print = 1; break;
+    default:
+      fprintf(stderr, "usage: %s [-a addr] [-k addr] [-c addr] [-b bus | -l flags] [-s bus_hz] [-o overhead_us] [-p] "
+              "[file]\n", argv[0]);
+      return 2;
+    }
+  }
+  if(optind < argc && !(file = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+  if(!(all = read_all(file)) || bus_hz == 0) return 1;
+
+  text = all;
+  while((length = i2c_parse_sequence(&text, buffer, MAX_SEQUENCE_LENGTH)) > 0) {
+    if(in_count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      in = realloc(in, capacity * sizeof(struct i2c_sequence));
+      if(!in) return 1;
+    }
+    in[in_count].sequence = malloc(length * sizeof(uint16_t));
+    if(!in[in_count].sequence) return 1;
+    memcpy(in[in_count].sequence, buffer, length * sizeof(uint16_t));
+    in[in_count].sequence_length = length;
+    in_count++;
+  }
+  if(length < 0) {
+    fprintf(stderr, "syntax error near: %.20s\n", text);
+    return 1;
+  }
+
+  read_map = malloc((in_count ? in_count : 1) * sizeof(uint32_t));
+  if(!read_map || i2c_optimize(in, in_count, hints, known_limits, &out, &out_count, read_map) < 0) {
+    fprintf(stderr, "optimization failed\n");
+    return 1;
+  }
+
+  totals(in, in_count, &clocks);
+  report("before:", in_count, clocks, bus_hz, overhead_us);
+  totals(out, out_count, &clocks);
+  report("after:", out_count, clocks, bus_hz, overhead_us);
+
+  if(print) {
+    for(i = 0; i < out_count; i++) {
+      if(i2c_format_sequence(out[i].sequence, out[i].sequence_length, line, sizeof(line)) > 0) printf("%s\n", line);
+    }
+  }
+
+  i2c_optimize_free(in, in_count);
+  i2c_optimize_free(out, out_count);
+  free(read_map);
+  free(all);
+  return 0;
+}